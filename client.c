@@ -22,8 +22,22 @@
 #include "tsch-private.h"
 #endif
 #include "movement.h"
+#include "movement-features.h"
+#include "movement-monitor.h"
 #include "energest-log.h"
 #include "led-report.h"
+#include "publish-queue.h"
+#include "publish-store.h"
+#include "publish-filter.h"
+#include "payload.h"
+#include "mqtt-sn.h"
+#include "fast-rejoin.h"
+#include "tsch-sleep.h"
+#include "tsch-hint.h"
+#include "wake-sched.h"
+#include "tx-power.h"
+#include "remote-config.h"
+#include "publish-period.h"
 
 
 #define LOG_MODULE "PD Client"
@@ -43,14 +57,176 @@
 #endif
 #endif
 
+/* The MQTT session is kept across duty cycles only when the radio is
+ * manually duty cycled */
+#if CSMA_MANUAL_DUTY_CYCLING==1 && defined(MQTT_CONF_PERSISTENT_SESSION)
+#define MQTT_PERSISTENT_SESSION   MQTT_CONF_PERSISTENT_SESSION
+#else
+#define MQTT_PERSISTENT_SESSION   0
+#endif
+
+/* Keep the RPL network state across manual duty cycles while not moving */
+#if CSMA_MANUAL_DUTY_CYCLING==1 && defined(CLIENT_CONF_FAST_REJOIN)
+#define CLIENT_FAST_REJOIN        CLIENT_CONF_FAST_REJOIN
+#else
+#define CLIENT_FAST_REJOIN        0
+#endif
+
+/* Publish with MQTT-SN over UDP instead of MQTT over TCP */
+#ifdef MQTT_CONF_TRANSPORT_SN
+#define MQTT_TRANSPORT_SN         MQTT_CONF_TRANSPORT_SN
+#else
+#define MQTT_TRANSPORT_SN         0
+#endif
+
+#if MQTT_TRANSPORT_SN && REMOTE_CONFIG_ENABLED
+#error "The remote configuration needs MQTT, not MQTT-SN"
+#endif
+
+/* QoS level of the messages published with MQTT-SN (-1, 0 or 1) */
+#ifdef MQTT_SN_CONF_QOS
+#define MQTT_SN_QOS               MQTT_SN_CONF_QOS
+#else
+#define MQTT_SN_QOS               MQTT_SN_QOS_LEVEL_1
+#endif
+
+/* Predefined MQTT-SN topic id of the messages published */
+#ifdef MQTT_SN_CONF_TOPIC_ID
+#define MQTT_SN_TOPIC_ID          MQTT_SN_CONF_TOPIC_ID
+#else
+#define MQTT_SN_TOPIC_ID          1
+#endif
+
+/* Time to wait for the acknowledgement of the first message published on a
+ * resumed MQTT connection before considering it dropped */
+#ifdef MQTT_CONF_RESUME_TIMEOUT
+#define MQTT_RESUME_TIMEOUT       MQTT_CONF_RESUME_TIMEOUT
+#else
+#define MQTT_RESUME_TIMEOUT       (3 * STATE_MACHINE_PERIODIC)
+#endif
+
+/* Period at which the reachability of the RPL network is checked after a
+ * parent has been found, until the DAO is acknowledged */
+#define NET_POLL_PERIOD           (CLOCK_SECOND / 8)
+
+/* Time to wait for a RPL parent before checking the network state anyway */
+#define NET_EVENT_TIMEOUT         (10 * STATE_MACHINE_PERIODIC)
+
+/* Time after which the search of the RPL network is abandoned until the next
+ * attempt, when the radio is manually duty cycled (0 to search until the
+ * device moves). Consecutive failed searches double the delay before the next
+ * one, from K up to K << NET_SEARCH_MAX_BACKOFF */
+#if CSMA_MANUAL_DUTY_CYCLING==1 && defined(CLIENT_CONF_NET_SEARCH_TIMEOUT)
+#define NET_SEARCH_TIMEOUT        CLIENT_CONF_NET_SEARCH_TIMEOUT
+#else
+#define NET_SEARCH_TIMEOUT        0
+#endif
+
+#ifdef CLIENT_CONF_NET_SEARCH_MAX_BACKOFF
+#define NET_SEARCH_MAX_BACKOFF    CLIENT_CONF_NET_SEARCH_MAX_BACKOFF
+#else
+#define NET_SEARCH_MAX_BACKOFF    5
+#endif
+
+/* Start joining the network as soon as the newest accelerometer readings are
+ * still, before the stop is confirmed by the whole feature window. The join
+ * stops before connecting to the broker until the stop is confirmed, and it
+ * is abandoned if the device keeps moving or after SPECULATE_TIMEOUT */
+#if !DISABLE_MOVEMENT_SLEEP && defined(CLIENT_CONF_SPECULATE)
+#define SPECULATE                 CLIENT_CONF_SPECULATE
+#else
+#define SPECULATE                 0
+#endif
+
+/* The number of still readings which make a stop likely */
+#ifdef CLIENT_CONF_SPECULATE_READINGS
+#define SPECULATE_READINGS        CLIENT_CONF_SPECULATE_READINGS
+#else
+#define SPECULATE_READINGS        2
+#endif
+
+/* The maximum time the radio is kept on for a stop which is not confirmed */
+#ifdef CLIENT_CONF_SPECULATE_TIMEOUT
+#define SPECULATE_TIMEOUT         CLIENT_CONF_SPECULATE_TIMEOUT
+#else
+#define SPECULATE_TIMEOUT         (2 * MOVEMENT_WINDOW * MOVEMENT_PERIOD)
+#endif
+
 
 process_event_t mqtt_did_connect;
 process_event_t mqtt_did_disconnect;
 process_event_t mqtt_did_publish;
+#if REMOTE_CONFIG_ENABLED
+process_event_t mqtt_did_subscribe;
+#endif
 
 static char is_moving = 1;
 process_event_t mvmt_state_change;
 
+#if SPECULATE
+/** 1 while the device is moving but its newest readings are still. */
+static char stop_likely = 0;
+/** The speculative join of the network. */
+static struct {
+  /** 1 while the radio is on because of stop_likely. */
+  uint8_t active;
+  /** 1 if a join has already been attempted for the current stop_likely. */
+  uint8_t tried;
+  /** 1 if the radio is being turned off after abandoning the join. */
+  uint8_t abandoned;
+  /** When the join started, and when it must be abandoned. */
+  clock_time_t start;
+  struct timer timeout;
+  /** Statistics. */
+  uint16_t attempts;
+  uint16_t hits;
+  /** Sum of the time between the start of the join and the confirmation of
+   * the stop, for the joins which paid off. */
+  clock_time_t lead;
+  /** Sum of the radio on time of the joins abandoned. */
+  clock_time_t wasted;
+} speculation;
+#endif
+
+/** Posted to client_process when a RPL parent is found (data is the parent)
+ * or lost (data is NULL). */
+process_event_t net_state_change;
+
+
+/** The causes of the wakeups of client_process. */
+typedef enum {
+  WAKEUP_TIMER,
+  /* Polled by the state machine itself to proceed to the next state */
+  WAKEUP_CONTINUE,
+  WAKEUP_NET_JOINED,
+  WAKEUP_NET_LOST,
+  WAKEUP_MQTT_CONNECTED,
+  WAKEUP_MQTT_PUBLISHED,
+  WAKEUP_MQTT_DISCONNECTED,
+  WAKEUP_MOVEMENT,
+  /* Any other event (e.g. sensor broadcasts), filtered out */
+  WAKEUP_IGNORED,
+  WAKEUP_CAUSES
+} wakeup_cause_t;
+
+static const char *const wakeup_cause_names[WAKEUP_CAUSES] = {
+  "timer", "continue", "net joined", "net lost", "mqtt connected",
+  "mqtt published", "mqtt disconnected", "movement", "ignored"
+};
+
+/** The number of wakeups of client_process, by cause. */
+static uint32_t client_wakeups[WAKEUP_CAUSES];
+
+#if ENERGEST_LOG_STATES
+/** The names of the states of client_process, for the energest table, in
+ * the order of their declaration. */
+static const char *const mqtt_state_names[] = {
+  "IDLE", "RADIO_ON", "WAIT_IP", "CONNECT_MQTT", "WAIT_MQTT",
+  "CONNECTED_PUBLISH", "CONNECTED_WAIT_PUBLISH", "DISCONNECT",
+  "DISCONNECT_2", "DISCONNECT_3"
+};
+#endif
+
 
 PROCESS(client_process, "mw-iot-person-detection main");
 PROCESS(movement_monitor_process, "mw-iot-person-detection mqtt monitor");
@@ -67,13 +243,116 @@ PROCESS(movement_monitor_process, "mw-iot-person-detection mqtt monitor");
 /** The topic buffer. */
 static char pub_topic_cache[MQTT_MAX_TOPIC_LENGTH] = "";
 
-/** The length of the message buffer. */
-#define MQTT_MAX_CONTENT_LENGTH 256
-
+#if MQTT_TRANSPORT_SN
+/** The current MQTT-SN connection. */
+static struct mqtt_sn_connection conn;
+#if MQTT_SN_QOS == MQTT_SN_QOS_LEVEL_M1
+/* Messages are published without connecting */
+#define client_mqtt_ready()       (conn.out_packet == NULL)
+#else
+#define client_mqtt_ready()       mqtt_sn_ready(&conn)
+#endif
+#define client_mqtt_connected()   mqtt_sn_connected(&conn)
+#define client_mqtt_closed()      (conn.state == MQTT_SN_STATE_NOT_CONNECTED)
+/** Room for the MQTT-SN header before the payload. */
+#define PUBLISH_HEADROOM          MQTT_SN_PUBLISH_HEADROOM
+#else
 /** The current MQTT connection. */
 static struct mqtt_connection conn;
+#define client_mqtt_ready()       (mqtt_ready(&conn) && conn.out_buffer_sent)
+#define client_mqtt_connected()   mqtt_connected(&conn)
+#define client_mqtt_closed()      (conn.state == MQTT_CONN_STATE_NOT_CONNECTED)
+#define PUBLISH_HEADROOM          0
+#endif
 static int mqtt_disconn_received;
 
+#if MQTT_PERSISTENT_SESSION
+/** Set when the connection must be kept open while the radio is off. */
+static uint8_t mqtt_suspend;
+/** Set when a connection kept open has been resumed, until the broker
+ * acknowledges a message on it. */
+static uint8_t mqtt_resume_pending;
+/** The number of connections resumed and found dropped by the broker. */
+static uint16_t mqtt_resumes, mqtt_resumes_dropped;
+#endif
+
+#if REMOTE_CONFIG_ENABLED
+/** Set when the broker holds our subscription to the command topics. */
+static uint8_t cmd_subscribed;
+/** The version of the remote configuration confirmed by the message being
+ * published, if any. */
+static uint16_t publish_config_version;
+#endif
+
+#if PUBLISH_BATCHING
+/** The sequence number of the first record not included in the last 
+ * message published. */
+static uint32_t publish_end_seq;
+#endif
+
+#if PUBLISH_FILTER
+/** The RSSI measured at the last publish. */
+static int last_rssi = -1000;
+#endif
+
+#if NET_SEARCH_TIMEOUT > 0
+/** Expires when the current search of the network must be abandoned. */
+static struct timer net_search;
+/** Expires when a new search of the network can be started. */
+static struct timer net_backoff;
+/** The number of consecutive searches abandoned. */
+static uint8_t net_search_failures;
+/** The number of searches abandoned since startup. */
+static uint16_t net_searches_abandoned;
+#define net_search_allowed()      timer_expired(&net_backoff)
+/* A wait for the network, shortened to the end of the search */
+#define net_search_wait(interval) \
+  MIN((interval), timer_remaining(&net_search))
+#else
+#define net_search_allowed()      1
+#define net_search_wait(interval) (interval)
+#endif
+
+/** The period of the samples while not moving: K, stretched by the time
+ * without moving and by the battery (see publish-period.h). */
+#define sample_period()           publish_period_get(REMOTE_CONFIG_K)
+/** The maximum age of the queued records, stretched like K. */
+#define batch_max_age() \
+  publish_period_scale(PUBLISH_BATCH_MAX_AGE, REMOTE_CONFIG_K)
+
+
+/** Returns the keep alive interval of the MQTT connection, in seconds.
+ *
+ * The broker must hear from us within three times the longest time the
+ * connection stays unused while not moving: K, or with
+ * MQTT_PERSISTENT_SESSION the longest time the radio stays off with the
+ * connection open, that is the longest sample period, plus the longest
+ * maximum age of the queue with batching.
+ * @returns The interval, in seconds. */
+static uint16_t mqtt_keep_alive(void)
+{
+  clock_time_t idle = REMOTE_CONFIG_K;
+  
+  #if MQTT_PERSISTENT_SESSION
+  #if PUBLISH_PERIOD_ENABLED
+  idle = MAX(idle, PUBLISH_PERIOD_MAX);
+  #endif
+  #if PUBLISH_BATCHING
+  idle += (uint64_t)PUBLISH_BATCH_MAX_AGE * idle / REMOTE_CONFIG_K;
+  #endif
+  #endif
+  return MIN(3 * ((idle + CLOCK_SECOND - 1) / CLOCK_SECOND), UINT16_MAX);
+}
+
+#if SPECULATE
+/** Whether the radio can be turned on before the stop is confirmed. */
+#define speculation_allowed() \
+  (is_moving && stop_likely && !speculation.tried && net_search_allowed())
+/** Whether the radio must be kept on while the device is still moving. */
+#define speculation_pending() \
+  (speculation.active && stop_likely && !timer_expired(&speculation.timeout))
+#endif
+
 
 /** Formats a IPv6 address into a string buffer.
  * @param buf     The output buffer. On return, the string in the buffer will
@@ -84,24 +363,34 @@ static int mqtt_disconn_received;
  * @returns       The length of the string written into the buffer. */
 int ipaddr_sprintf(char *buf, uint8_t buf_len, const uip_ipaddr_t *addr)
 {
+  static const char hex[] = "0123456789abcdef";
   uint16_t a;
   uint8_t len = 0;
-  int i, f;
+  int i, f, d;
+
+  if (buf_len == 0)
+    return 0;
   for(i = 0, f = 0; i < sizeof(uip_ipaddr_t); i += 2) {
     a = (addr->u8[i] << 8) + addr->u8[i + 1];
     if(a == 0 && f >= 0) {
       if(f++ == 0) {
-        len += snprintf(&buf[len], buf_len - len, "::");
+        if(len + 1 < buf_len) buf[len++] = ':';
+        if(len + 1 < buf_len) buf[len++] = ':';
       }
     } else {
       if(f > 0) {
         f = -1;
       } else if(i > 0) {
-        len += snprintf(&buf[len], buf_len - len, ":");
+        if(len + 1 < buf_len) buf[len++] = ':';
+      }
+      /* Like "%x", without leading zeros */
+      for(d = 12; d > 0 && (a >> d) == 0; d -= 4);
+      for(; d >= 0; d -= 4) {
+        if(len + 1 < buf_len) buf[len++] = hex[(a >> d) & 0xF];
       }
-      len += snprintf(&buf[len], buf_len - len, "%x", a);
     }
   }
+  buf[len] = '\0';
 
   return len;
 }
@@ -130,6 +419,7 @@ static void update_pub_topic(void)
 }
 
 
+#if !MQTT_TRANSPORT_SN
 /** Returns the string used as the MQTT topic.
  * The MQTT topic string consists of a concatenation of the value of 
  * MQTT_PUBLISH_TOPIC_PREFIX and the IPv6 address of the border router we
@@ -144,6 +434,7 @@ static char *pub_topic(void)
     update_pub_topic();
   return pub_topic_cache;
 }
+#endif
 
 
 /** Returns an ID for the current client. 
@@ -164,6 +455,49 @@ static char *client_id(void)
 }
 
 
+/** Handles the acknowledgement of the last message published. */
+static void mqtt_published(void)
+{
+  LOG_INFO("Publishing complete\n");
+  tx_power_acked();
+  #if PUBLISH_BATCHING
+  publish_queue_release(publish_end_seq);
+  #endif
+  #if REMOTE_CONFIG_ENABLED
+  remote_config_confirmed(publish_config_version);
+  #endif
+  #if CSMA_MANUAL_DUTY_CYCLING==1
+  process_post(&client_process, mqtt_did_publish, NULL);
+  #endif
+}
+
+
+#if MQTT_TRANSPORT_SN
+/** Process an event from the current MQTT-SN connection.
+ * @param m     The MQTT-SN connection the event is associated with.
+ * @param event The event identifier.
+ * @warning     This function is meant to be called by the MQTT-SN module
+ *              only. */
+static void mqtt_sn_event(struct mqtt_sn_connection *m, mqtt_sn_event_t event)
+{
+  switch(event) {
+    case MQTT_SN_EVENT_CONNECTED:
+      LOG_INFO("Application has a MQTT-SN connection!\n");
+      process_post(&client_process, mqtt_did_connect, NULL);
+      break;
+    
+    case MQTT_SN_EVENT_DISCONNECTED: 
+      LOG_INFO("MQTT-SN Disconnect\n");
+      mqtt_disconn_received = 1;
+      process_post(&client_process, mqtt_did_disconnect, NULL);
+      break;
+    
+    case MQTT_SN_EVENT_PUBLISHED:
+      mqtt_published();
+      break;
+  }
+}
+#else
 /** Process an event from the current MQTT connection.
  * @param m     The MQTT connection the event is associated with.
  * @param event The event identifier.
@@ -175,6 +509,18 @@ static void mqtt_event(struct mqtt_connection *m, mqtt_event_t event, void *data
   switch(event) {
     case MQTT_EVENT_CONNECTED:
       LOG_INFO("Application has a MQTT connection!\n");
+      #if MQTT_PERSISTENT_SESSION
+      /* Session present flag of the CONNACK (always clear with MQTT 3.1) */
+      if (m->in_packet.payload[0] & 0x01)
+        LOG_INFO("The broker kept our MQTT session\n");
+      else
+        LOG_INFO("The broker started a new MQTT session\n");
+      #endif
+      #if REMOTE_CONFIG_ENABLED
+      /* The subscription is lost with the session */
+      if (!(m->in_packet.payload[0] & 0x01))
+        cmd_subscribed = 0;
+      #endif
       process_post(&client_process, mqtt_did_connect, NULL);
       break;
     
@@ -185,27 +531,51 @@ static void mqtt_event(struct mqtt_connection *m, mqtt_event_t event, void *data
       break;
     
     case MQTT_EVENT_PUBACK:
-      LOG_INFO("Publishing complete\n");
-      #if CSMA_MANUAL_DUTY_CYCLING==1
-      process_post(&client_process, mqtt_did_publish, NULL);
-      #endif
+      mqtt_published();
+      break;
+    
+    #if REMOTE_CONFIG_ENABLED
+    case MQTT_EVENT_SUBACK:
+      LOG_INFO("Subscribed to the command topics\n");
+      cmd_subscribed = 1;
+      remote_config_subscribed();
+      process_post(&client_process, mqtt_did_subscribe, NULL);
+      break;
+    
+    case MQTT_EVENT_PUBLISH: {
+      struct mqtt_message *msg = data;
+      /* Commands are short enough to be received in a single chunk */
+      if (!msg->first_chunk || msg->payload_chunk_length != msg->payload_length)
+        LOG_WARN("Command on \"%s\" too long\n", msg->topic);
+      else if (remote_config_receive(msg->topic, msg->payload_chunk,
+                                     msg->payload_length))
+        tx_power_apply();
       break;
+    }
+    #endif
     
     default:
       LOG_WARN("Application got a unhandled MQTT event: %i\n", event);
       break;
   }
 }
+#endif
 
 
 /** Publishes a message over the current MQTT connection.
  * The message published contains the ID of the client and other useful
  * information for later analysis including the acceleration values measured,
- * the measured radio signal power, and the uptime of the node in seconds. */
+ * the measured radio signal power, and the uptime of the node in seconds.
+ * When batching is enabled, the message also contains the oldest records
+ * in the publish queue (up to PUBLISH_BATCH_SIZE), which are removed from
+ * the queue when the message is acknowledged. The message is encoded as
+ * specified by PUBLISH_FORMAT (see payload.h). */
 static void publish(void)
 {
   static uint16_t seq_nr_value = 0;
-  static char app_buffer[MQTT_MAX_CONTENT_LENGTH];
+  static uint8_t app_buffer[PUBLISH_HEADROOM + PAYLOAD_MAX_LENGTH];
+  uint8_t *payload = app_buffer + PUBLISH_HEADROOM;
+  payload_t msg;
   int len;
 
   seq_nr_value++;
@@ -214,41 +584,124 @@ static void publish(void)
   int radio_pwr = -1000;
   NETSTACK_RADIO.get_value(RADIO_PARAM_RSSI, &radio_rssi);
   NETSTACK_RADIO.get_value(RADIO_PARAM_TXPOWER, &radio_pwr);
+  #if PUBLISH_FILTER
+  last_rssi = radio_rssi;
+  #endif
   
-  int clk = clock_time();
-
-  len = snprintf(app_buffer, MQTT_MAX_CONTENT_LENGTH, 
-    "{"
-      "\"client_id\":\"%s\","
-      "\"seq_nr_value\":%d,"
-      "\"last_accel\":[%d, %d, %d],"
-      "\"curr_radio_rssi\":%d,"
-      "\"curr_radio_power_dbm\":%d,"
-      "\"uptime\":%d.%02d"
-    "}", 
-    client_id(), 
-    seq_nr_value,
-    last_acc[LAST_ACC_X], last_acc[LAST_ACC_Y], last_acc[LAST_ACC_Z],
-    radio_rssi,
-    radio_pwr,
-    clk / CLOCK_SECOND, (clk % CLOCK_SECOND) * 100 / CLOCK_SECOND); 
-
-  if (len >= MQTT_MAX_CONTENT_LENGTH) {
-    LOG_ERR("Buffer too short; MQTT message has been truncated!\n");
+  msg.client_id[0] = linkaddr_node_addr.u8[0];
+  msg.client_id[1] = linkaddr_node_addr.u8[1];
+  msg.client_id[2] = linkaddr_node_addr.u8[2];
+  msg.client_id[3] = linkaddr_node_addr.u8[5];
+  msg.client_id[4] = linkaddr_node_addr.u8[6];
+  msg.client_id[5] = linkaddr_node_addr.u8[7];
+  msg.seq = seq_nr_value;
+  memcpy(msg.acc, last_acc, sizeof(msg.acc));
+  msg.rssi = radio_rssi;
+  msg.tx_power = radio_pwr;
+  msg.uptime = clock_time();
+  #if REMOTE_CONFIG_ENABLED
+  if (!remote_config_confirmation(&msg.config_version, &msg.config_status))
+    msg.config_version = 0;
+  publish_config_version = msg.config_version;
+  #else
+  msg.config_version = 0;
+  #endif
+  #if PUBLISH_PERIOD_ENABLED
+  msg.period = sample_period();
+  msg.battery = publish_period_battery();
+  #else
+  msg.period = 0;
+  #endif
+  #if PUBLISH_BATCHING && PUBLISH_STORE
+  msg.boot = publish_store_boot();
+  #else
+  msg.boot = 0;
+  #endif
+  #if PUBLISH_BATCHING
+  msg.n_records = publish_queue_load(PUBLISH_BATCH_SIZE);
+  publish_end_seq = publish_queue_first_seq() + msg.n_records;
+  #else
+  msg.n_records = 0;
+  #endif
+
+  len = payload_encode(payload, PAYLOAD_MAX_LENGTH, &msg);
+  if (len < 0) {
+    LOG_ERR("Buffer too short; MQTT message not published!\n");
+    return;
   }
 
-  mqtt_status_t res = mqtt_publish(&conn, NULL, pub_topic(), (uint8_t *)app_buffer,
+  #if MQTT_TRANSPORT_SN
+  mqtt_sn_status_t res = mqtt_sn_publish(&conn, MQTT_SN_TOPIC_ID, 
+               MQTT_SN_TOPIC_TYPE_PREDEFINED, app_buffer, len, MQTT_SN_QOS);
+  int ok = res == MQTT_SN_STATUS_OK;
+  #else
+  mqtt_status_t res = mqtt_publish(&conn, NULL, pub_topic(), payload,
                len, MQTT_QOS_LEVEL_1, MQTT_RETAIN_OFF);
+  int ok = res == MQTT_STATUS_OK;
+  #endif
 
-  if(res == MQTT_STATUS_OK) {
-    LOG_INFO("Publish sent out (length %d, max %d)!\n", len, MQTT_MAX_CONTENT_LENGTH);
-    LOG_INFO("Message = %s\n", app_buffer);
+  if(ok) {
+    LOG_INFO("Publish sent out (length %d, max %d)!\n", len, PAYLOAD_MAX_LENGTH);
+    #if PUBLISH_FORMAT == PUBLISH_FORMAT_JSON
+    LOG_INFO("Message = %s\n", (char *)payload);
+    #endif
   } else {
     LOG_ERR("Error in publishing... %d\n", res);
+    tx_power_failed();
   }
 }
 
 
+#if REMOTE_CONFIG_ENABLED
+/** Subscribes to the command topics, if a check of the commands is due.
+ * @returns 1 if the subscription has been sent, 0 otherwise. */
+static int subscribe(void)
+{
+  if (cmd_subscribed || !remote_config_due())
+    return 0;
+
+  mqtt_status_t res = mqtt_subscribe(&conn, NULL,
+               remote_config_topic(client_id()), MQTT_QOS_LEVEL_1);
+  if (res != MQTT_STATUS_OK) {
+    LOG_ERR("Error in subscribing... %d\n", res);
+    return 0;
+  }
+  LOG_INFO("Subscribing to the command topics\n");
+  return 1;
+}
+#endif
+
+
+#if PUBLISH_FILTER
+/** Decides whether the current sample must be published (see
+ * publish-filter.h). The RSSI is measured again only if the radio is always
+ * on: otherwise the radio is off, and the last RSSI measured is used.
+ * @returns 1 if the sample must be published, 0 otherwise. */
+static int sample_filter(void)
+{
+  #if CSMA_MANUAL_DUTY_CYCLING==0
+  NETSTACK_RADIO.get_value(RADIO_PARAM_RSSI, &last_rssi);
+  #endif
+  return publish_filter_check(last_acc, last_rssi);
+}
+#else
+#define sample_filter()           1
+#endif
+
+
+/** Returns the parameters of the movement decision set remotely. */
+static const movement_monitor_params_t *movement_monitor_params(void)
+{
+  static movement_monitor_params_t params;
+  
+  params.t_mod = REMOTE_CONFIG_T_MOD;
+  params.t_dmod = REMOTE_CONFIG_T_DMOD;
+  params.period = REMOTE_CONFIG_MOVEMENT_PERIOD;
+  params.g = REMOTE_CONFIG_G;
+  return &params;
+}
+
+
 /** The process responsible for monitoring the movements of the device.
  *
  * This process periodically polls the accelerometer and determines if the
@@ -257,14 +710,13 @@ static void publish(void)
 PROCESS_THREAD(movement_monitor_process, ev, data)
 {
   static struct etimer acc_timer;
-  #if !DISABLE_MOVEMENT_SLEEP
-  static int old_movement = 0;
-  #endif
+  static movement_monitor_t monitor;
   
   PROCESS_BEGIN();
   
-  is_moving = 1;
   mvmt_state_change = process_alloc_event();
+  movement_monitor_init(&monitor, movement_monitor_params());
+  is_moving = monitor.is_moving;
   
   etimer_set(&acc_timer, SETUP_WAIT);
   
@@ -281,41 +733,84 @@ PROCESS_THREAD(movement_monitor_process, ev, data)
     } while (!movement_ready(ev, data));
     
     set_led_pattern(LEDS_GREEN, 0b1, 0);
-    int raw_mov = get_movement();
-    
-    #if !DISABLE_MOVEMENT_SLEEP
-    int mov = ABS(raw_mov - GRAVITY*GRAVITY);
-    LOG_INFO("is_moving = %d, read movement of %d Gs\n", is_moving, mov);
+    int raw_movs[MOVEMENT_BATCH_SIZE];
+    int n_movs = get_movement_batch(raw_movs);
+    if (movement_read_retries > 0) {
+      LOG_WARN("accelerometer read with %d failed attempts\n", 
+               movement_read_retries);
+    }
     
-    int moving_rn = mov >= T_MOD || ABS(mov - old_movement) >= T_DMOD;
-    old_movement = mov;
-    #else
-    LOG_INFO("is_moving = 0, read raw movement of %d Gs\n", raw_mov);
-    int moving_rn = 0;
+    #if DISABLE_MOVEMENT_SLEEP
+    for (int i=0; i<n_movs; i++) {
+      LOG_INFO("is_moving = 0, read raw movement of %d Gs\n", raw_movs[i]);
+    }
+    /* An empty reading never shows movement */
+    n_movs = 0;
     #endif
     
     clock_time_t next_wake;
+    movement_monitor_change_t change = 
+      movement_monitor_update(&monitor, movement_monitor_params(),
+                              movement_batch, n_movs, &next_wake);
+    is_moving = monitor.is_moving;
+    #if !DISABLE_MOVEMENT_SLEEP
+    LOG_INFO("is_moving = %d, mean = %ld, var = %lu, sma = %ld, tilt = %ld\n",
+             is_moving, (long)movement_features_mean_abs(&monitor.features),
+             (unsigned long)movement_features_variance(&monitor.features),
+             (long)movement_features_sma(&monitor.features),
+             (long)movement_features_tilt(&monitor.features));
+    #endif
     
-    if(!is_moving && moving_rn) {
+    if(change == MOVEMENT_MONITOR_STARTED) {
       LOG_INFO("User started moving.\n");
-      is_moving = 1;
+      #if SPECULATE
+      stop_likely = 0;
+      #endif
+      #if PUBLISH_BATCHING
+      publish_queue_push(PUBLISH_RECORD_MOVING, last_acc);
+      #endif
+      #if PUBLISH_FILTER
+      publish_filter_reset();
+      #endif
+      publish_period_reset();
       process_post(&client_process, mvmt_state_change, NULL);
-      next_wake = MOVEMENT_PERIOD;
       
-    } else if(is_moving && !moving_rn) {
+    } else if(change == MOVEMENT_MONITOR_STOPPED) {
       LOG_INFO("User stopped moving.\n");
-      is_moving = 0;
+      #if SPECULATE
+      stop_likely = 0;
+      #endif
+      #if PUBLISH_BATCHING
+      publish_queue_push(PUBLISH_RECORD_STOPPED, last_acc);
+      #endif
+      #if PUBLISH_FILTER
+      publish_filter_reset();
+      #endif
+      publish_period_reset();
       process_post(&client_process, mvmt_state_change, NULL);
-      next_wake = G;
       
     } else {
+      #if SPECULATE
+      /* The stop is confirmed only when the movement has left the whole
+       * feature window: let the network stack start earlier */
+      int likely = is_moving && n_movs > 0 &&
+                   movement_features_settling(&monitor.features,
+                                              SPECULATE_READINGS);
+      if (likely != stop_likely) {
+        LOG_INFO(likely ? "User likely stopping.\n" : "User still moving.\n");
+        stop_likely = likely;
+        speculation.tried = 0;
+        #if !PUBLISH_ON_MOVEMENT
+        process_post(&client_process, mvmt_state_change, NULL);
+        #endif
+      }
+      #endif
       #if PUBLISH_ON_MOVEMENT
       process_post(&client_process, mvmt_state_change, NULL);
       #endif
-      next_wake = MOVEMENT_PERIOD;
       
     }
-    etimer_reset_with_new_interval(&acc_timer, next_wake);
+    wake_sched_reset(&acc_timer, next_wake, MOVEMENT_SLACK);
   }
   
   PROCESS_END();
@@ -338,6 +833,138 @@ int rpl_is_reachable_2(void)
 }
 
 
+/** Returns whether a preferred parent has been found in the RPL network,
+ * even if the network is not reachable yet. */
+static int rpl_has_parent(void)
+{
+  return curr_instance.used && curr_instance.dag.preferred_parent != NULL;
+}
+
+
+/** Called by RPL when the preferred parent changes. Notifies client_process,
+ * which would otherwise have to poll the state of the network.
+ * @note  Set as RPL_CALLBACK_PARENT_SWITCH in project-conf.h. */
+void client_rpl_parent_switch(rpl_nbr_t *old, rpl_nbr_t *new)
+{
+  #ifdef MAC_CONF_WITH_TSCH
+  /* Replaces the default callback, which keeps TSCH time source up to date */
+  tsch_rpl_callback_parent_switch(old, new);
+  #endif
+  tx_power_parent(new);
+  process_post(&client_process, net_state_change, new);
+}
+
+
+/** Classifies an event received by client_process, and counts it.
+ * @param timer The event timer of client_process.
+ * @returns The cause of the wakeup. The state machine must not run when 
+ *          it is WAKEUP_IGNORED. */
+static wakeup_cause_t client_wakeup(process_event_t ev, process_data_t data,
+                                    struct etimer *timer)
+{
+  wakeup_cause_t cause;
+
+  if (ev == PROCESS_EVENT_TIMER && data == timer)
+    cause = WAKEUP_TIMER;
+  else if (ev == PROCESS_EVENT_POLL)
+    cause = WAKEUP_CONTINUE;
+  else if (ev == net_state_change)
+    cause = data != NULL ? WAKEUP_NET_JOINED : WAKEUP_NET_LOST;
+  else if (ev == mqtt_did_connect)
+    cause = WAKEUP_MQTT_CONNECTED;
+  #if REMOTE_CONFIG_ENABLED
+  else if (ev == mqtt_did_subscribe)
+    cause = WAKEUP_MQTT_CONNECTED;
+  #endif
+  else if (ev == mqtt_did_publish)
+    cause = WAKEUP_MQTT_PUBLISHED;
+  else if (ev == mqtt_did_disconnect)
+    cause = WAKEUP_MQTT_DISCONNECTED;
+  else if (ev == mvmt_state_change)
+    cause = WAKEUP_MOVEMENT;
+  else
+    cause = WAKEUP_IGNORED;
+
+  client_wakeups[cause]++;
+  return cause;
+}
+
+
+#if NET_SEARCH_TIMEOUT > 0
+/** Abandons the search of the network, and delays the next one. */
+static void net_search_abandon(void)
+{
+  clock_time_t delay;
+
+  if (net_search_failures < NET_SEARCH_MAX_BACKOFF)
+    net_search_failures++;
+  net_searches_abandoned++;
+  delay = REMOTE_CONFIG_K << net_search_failures;
+  timer_set(&net_backoff, delay);
+  LOG_WARN("No network found, next search in %lu s (%u abandoned)\n",
+           (unsigned long)(delay / CLOCK_SECOND), net_searches_abandoned);
+}
+
+
+/** Allows a new search of the network right away, because the network has
+ * been found or the device has moved. */
+static void net_search_reset(void)
+{
+  net_search_failures = 0;
+  timer_set(&net_backoff, 0);
+}
+#endif
+
+
+#if SPECULATE
+/** Starts joining the network because a stop is likely. */
+static void speculation_start(void)
+{
+  speculation.active = 1;
+  speculation.tried = 1;
+  speculation.attempts++;
+  speculation.start = clock_time();
+  timer_set(&speculation.timeout, SPECULATE_TIMEOUT);
+  LOG_INFO("Stop likely, joining the network ahead\n");
+}
+
+
+/** Ends the speculative join in progress, if any.
+ * @param hit 1 if the stop has been confirmed, 0 if the join is abandoned. */
+static void speculation_end(int hit)
+{
+  clock_time_t elapsed = clock_time() - speculation.start;
+
+  if (!speculation.active)
+    return;
+  speculation.active = 0;
+  if (hit) {
+    speculation.hits++;
+    speculation.lead += elapsed;
+  } else {
+    speculation.wasted += elapsed;
+    speculation.abandoned = 1;
+  }
+  LOG_INFO("Speculative join %s after %lu ms (%u of %u paid off, %lu ms "
+           "wasted)\n", hit ? "paid off" : "abandoned",
+           (unsigned long)(elapsed * 1000 / CLOCK_SECOND), speculation.hits,
+           speculation.attempts,
+           (unsigned long)(speculation.wasted * 1000 / CLOCK_SECOND));
+}
+#endif
+
+
+/** Logs the number of wakeups of client_process by cause. */
+static void log_wakeups(void)
+{
+  LOG_DBG("Wakeups:");
+  for (int i=0; i<WAKEUP_CAUSES; i++)
+    LOG_DBG_(" %s %lu%s", wakeup_cause_names[i],
+             (unsigned long)client_wakeups[i],
+             i < WAKEUP_CAUSES-1 ? "," : "\n");
+}
+
+
 /** The network management process.
  *
  * When the device is moving, as verified by movement_monitor_process,
@@ -347,7 +974,13 @@ int rpl_is_reachable_2(void)
  * When movement_monitor_process detects the device is not moving anymore,
  * this process does a best effort to connect to the first available 
  * network and starts periodically sending MQTT messages using the publish()
- * function. */
+ * function.
+ *
+ * The state machine runs only when an event it is interested in is received:
+ * its own timer, a poll made by itself to proceed to the next state, a
+ * change of the RPL parent, a MQTT connection, acknowledgement or 
+ * disconnection, and a change of the movement state. Any other event is
+ * counted and ignored. */
 PROCESS_THREAD(client_process, ev, data)
 {
   static int mqtt_fake_disconnect = 0;
@@ -391,24 +1024,48 @@ PROCESS_THREAD(client_process, ev, data)
   log_set_level("mac", LOG_LEVEL_DBG);
   
   led_report_init();
+  remote_config_init();
+  publish_period_init();
+  #if PUBLISH_BATCHING
+  publish_queue_init();
+  #endif
+  #if PUBLISH_FILTER
+  publish_filter_init();
+  #endif
+  tx_power_init();
+  energest_log_set_state_names(mqtt_state_names, 
+    sizeof(mqtt_state_names) / sizeof(mqtt_state_names[0]));
+  energest_log_state(mqtt_state);
   
   process_start(&movement_monitor_process, NULL);
   
   mqtt_did_connect = process_alloc_event();
   mqtt_did_disconnect = process_alloc_event();
   mqtt_did_publish = process_alloc_event();
+  #if REMOTE_CONFIG_ENABLED
+  mqtt_did_subscribe = process_alloc_event();
+  #endif
+  net_state_change = process_alloc_event();
   
+  #if MQTT_TRANSPORT_SN
+  if (mqtt_sn_register(&conn, MQTT_SN_GATEWAY_IP_ADDR, MQTT_SN_GATEWAY_PORT,
+                       client_id(), mqtt_sn_event) != MQTT_SN_STATUS_OK)
+    LOG_ERR("Invalid MQTT-SN gateway address\n");
+  #else
   /* Register MQTT connection
    * Registering MQTT multiple times causes memory corruption!! */
   mqtt_register(&conn, &client_process, client_id(), mqtt_event, MAX_TCP_SEGMENT_SIZE);
   mqtt_set_username_password(&conn, "use-token-auth", MQTT_AUTH_TOKEN);
   /* _register() will set auto_reconnect. We don't want that. */
   conn.auto_reconnect = 0;
+  #endif
   
   /* Turn off MAC and radio for consistency with initial state = moving */
   #ifndef MAC_CONF_WITH_TSCH
   NETSTACK_MAC.off();
   NETSTACK_RADIO.off();
+  #elif TSCH_SLEEP_ENABLED
+  tsch_sleep_enter();
   #endif
 
   etimer_set(&timer, STATE_MACHINE_PERIODIC);
@@ -419,10 +1076,52 @@ PROCESS_THREAD(client_process, ev, data)
      * iteration */
     switch (mqtt_state) {
       case MQTT_STATE_IDLE:
-        #if CSMA_MANUAL_DUTY_CYCLING==1 && PUBLISH_ON_MOVEMENT==0
+        #if CLIENT_FAST_REJOIN
+        /* We will most likely reach a different network after moving */
+        if (is_moving)
+          fast_rejoin_forget();
+        #endif
+        #if NET_SEARCH_TIMEOUT > 0
+        /* The device may have been carried within reach of a network */
+        if (is_moving)
+          net_search_reset();
+        #endif
+        #if SPECULATE
+        if (speculation_allowed()) {
+          speculation_start();
+          mqtt_state = MQTT_STATE_RADIO_ON;
+          break;
+        }
+        #endif
+        #if PUBLISH_BATCHING
+        /* Take a sample every K, but turn on the radio only when the
+         * queue is due to be flushed, or to publish a stop (together with
+         * the start queued before it) right away */
         if (!is_moving && etimer_expired(&timer)) {
+          if (sample_filter())
+            publish_queue_push(PUBLISH_RECORD_SAMPLE, last_acc);
+          if (publish_queue_due(batch_max_age()) && net_search_allowed())
+            mqtt_state = MQTT_STATE_RADIO_ON;
+          else
+            wake_sched_reset(&timer, sample_period(), K_SLACK);
+        } else if (!is_moving && ev == mvmt_state_change &&
+                   net_search_allowed()) {
           mqtt_state = MQTT_STATE_RADIO_ON;
-        } 
+        }
+        #elif CSMA_MANUAL_DUTY_CYCLING==1 && PUBLISH_ON_MOVEMENT==0
+        /* A sample suppressed by the filter costs no radio cycle */
+        if (!is_moving && etimer_expired(&timer) && net_search_allowed() &&
+            sample_filter()) {
+          mqtt_state = MQTT_STATE_RADIO_ON;
+        } else if (!is_moving && etimer_expired(&timer)) {
+          wake_sched_reset(&timer, sample_period(), K_SLACK);
+        }
+        #elif CSMA_MANUAL_DUTY_CYCLING==1
+        /* A message for each reading of the accelerometer */
+        if (!is_moving && ev == mvmt_state_change && net_search_allowed() &&
+            sample_filter()) {
+          mqtt_state = MQTT_STATE_RADIO_ON;
+        }
         #else
         if (!is_moving) {
           mqtt_state = MQTT_STATE_RADIO_ON;
@@ -439,9 +1138,45 @@ PROCESS_THREAD(client_process, ev, data)
         uip_ds6_addr_t *ip = uip_ds6_get_global(ADDR_PREFERRED);
         LOG_INFO("rpl is reachable = %d\n", reachable);
         LOG_INFO("uip_ds6_get_global(ADDR_PREFERRED) == %p\n", ip);
+        #if SPECULATE
+        if (is_moving) {
+          /* Joining ahead of the stop: wait for its confirmation */
+        } else
+        #endif
         if (ip != NULL && reachable) {
+          #if MQTT_TRANSPORT_SN && MQTT_SN_QOS == MQTT_SN_QOS_LEVEL_M1
+          /* QoS -1 messages are published without connecting */
+          mqtt_disconn_received = 0;
+          mqtt_state = MQTT_STATE_CONNECTED_PUBLISH;
+          #else
+          #if MQTT_PERSISTENT_SESSION
+          if (client_mqtt_connected()) {
+            /* The connection was kept open while the radio was off: skip
+             * the handshake, and publish right away */
+            LOG_INFO("Resuming MQTT connection\n");
+            #if !MQTT_TRANSPORT_SN
+            ctimer_restart(&conn.keep_alive_timer);
+            #endif
+            mqtt_resumes++;
+            mqtt_resume_pending = 1;
+            mqtt_fake_disconnect = 0;
+            mqtt_state = MQTT_STATE_CONNECTED_PUBLISH;
+            update_pub_topic();
+          } else
+          #endif
           mqtt_state = MQTT_STATE_CONNECT_MQTT;
+          #endif
+          #if NET_SEARCH_TIMEOUT > 0
+          net_search_reset();
+          #endif
+        }
+        #if NET_SEARCH_TIMEOUT > 0
+        else if (timer_expired(&net_search)) {
+          /* Give up until the next attempt: the records stay queued */
+          net_search_abandon();
+          mqtt_state = MQTT_STATE_DISCONNECT;
         }
+        #endif
         break;
       }
         
@@ -449,7 +1184,7 @@ PROCESS_THREAD(client_process, ev, data)
         mqtt_state = MQTT_STATE_WAIT_MQTT;
 
       case MQTT_STATE_WAIT_MQTT:
-        if (ev == mqtt_did_connect || mqtt_connected(&conn)) {
+        if (ev == mqtt_did_connect || client_mqtt_connected()) {
           LOG_INFO("Connected!\n");
           mqtt_fake_disconnect = 0;
           mqtt_state = MQTT_STATE_CONNECTED_PUBLISH;
@@ -461,20 +1196,49 @@ PROCESS_THREAD(client_process, ev, data)
         
       case MQTT_STATE_CONNECTED_PUBLISH:
         mqtt_state = MQTT_STATE_CONNECTED_WAIT_PUBLISH;
-        break;
-        
+        /* Fall through: only the events awaited in the next state wake us
+         * up, and the first one may already be here */
+
       case MQTT_STATE_CONNECTED_WAIT_PUBLISH:
+        #if REMOTE_CONFIG_ENABLED
+        if (ev == mqtt_did_subscribe) {
+          mqtt_state = MQTT_STATE_CONNECTED_PUBLISH;
+          break;
+        }
+        #endif
         #if CSMA_MANUAL_DUTY_CYCLING==1
         if (ev == mqtt_did_publish) {
+          #if PUBLISH_BATCHING
+          /* Flush the whole queue while we are connected */
+          if (publish_queue_count() > 0)
+            mqtt_state = MQTT_STATE_CONNECTED_PUBLISH;
+          else
+          #endif
           mqtt_state = MQTT_STATE_DISCONNECT;
+          #if MQTT_PERSISTENT_SESSION
+          mqtt_resume_pending = 0;
+          mqtt_suspend = mqtt_state == MQTT_STATE_DISCONNECT;
+          #endif
         }
+        #if MQTT_PERSISTENT_SESSION
+        else if (mqtt_resume_pending && etimer_expired(&timer)) {
+          /* The broker may have silently dropped the connection */
+          mqtt_resumes_dropped++;
+          LOG_INFO("Resumed MQTT connection is not responding\n");
+          mqtt_resume_pending = 0;
+          mqtt_state = MQTT_STATE_DISCONNECT;
+        }
+        #endif
         #else
         #if PUBLISH_ON_MOVEMENT==0
         if (ev == PROCESS_EVENT_TIMER && data == &timer) {
-          mqtt_state = MQTT_STATE_CONNECTED_PUBLISH;
+          if (sample_filter())
+            mqtt_state = MQTT_STATE_CONNECTED_PUBLISH;
+          else
+            wake_sched_reset(&timer, sample_period(), K_SLACK);
         }
         #else
-        if (ev == mvmt_state_change) {
+        if (ev == mvmt_state_change && sample_filter()) {
           mqtt_state = MQTT_STATE_CONNECTED_PUBLISH;
         }
         #endif
@@ -484,7 +1248,7 @@ PROCESS_THREAD(client_process, ev, data)
       case MQTT_STATE_DISCONNECT_2:
       case MQTT_STATE_DISCONNECT:
         LOG_INFO("mqtt state = %d\n", conn.state);
-        if (conn.state == MQTT_CONN_STATE_NOT_CONNECTED || mqtt_fake_disconnect)
+        if (client_mqtt_closed() || mqtt_fake_disconnect)
           mqtt_state = MQTT_STATE_DISCONNECT_3;
         else
           mqtt_state = MQTT_STATE_DISCONNECT_2;
@@ -496,7 +1260,16 @@ PROCESS_THREAD(client_process, ev, data)
     }
     
     /* Global triggers */
+    #if SPECULATE
+    if (!is_moving)
+      speculation_end(1);
+    else if (!speculation_pending())
+      speculation_end(0);
+    #endif
     if (is_moving && 
+        #if SPECULATE
+        !speculation.active &&
+        #endif
         mqtt_state != MQTT_STATE_IDLE && 
         mqtt_state != MQTT_STATE_DISCONNECT && 
         mqtt_state != MQTT_STATE_DISCONNECT_2 &&
@@ -511,10 +1284,22 @@ PROCESS_THREAD(client_process, ev, data)
         mqtt_state == MQTT_STATE_CONNECTED_WAIT_PUBLISH) {
       if (mqtt_disconn_received || !rpl_is_reachable_2()) {
         LOG_INFO("MQTT disconnected...\n");
+        #if MQTT_PERSISTENT_SESSION
+        if (mqtt_resume_pending && mqtt_disconn_received) {
+          /* Typically the broker reset a connection it did not know */
+          mqtt_resumes_dropped++;
+          mqtt_resume_pending = 0;
+        } else
+        #endif
+        if (mqtt_disconn_received)
+          tx_power_failed();
         mqtt_state = MQTT_STATE_WAIT_IP;
       }
     }
         
+    /* Energy used from now on is attributed to the new state */
+    energest_log_state(mqtt_state);
+    
     /* States */
     switch(mqtt_state) {
       case MQTT_STATE_IDLE:
@@ -523,7 +1308,15 @@ PROCESS_THREAD(client_process, ev, data)
       case MQTT_STATE_RADIO_ON:
         set_led_pattern(LEDS_RED, 0b1, 20);
         LOG_INFO("Turning radio on\n");
-        #ifdef MAC_CONF_WITH_TSCH
+        #if defined(MAC_CONF_WITH_TSCH) && TSCH_HINT_ENABLED
+        /* Scan the channel of the last association first */
+        tsch_hint_wake();
+        #endif
+        #if defined(MAC_CONF_WITH_TSCH) && TSCH_SLEEP_ENABLED
+        /* TSCH was stopped when we started moving: it starts again from a
+         * scan, as we will probably join a new network */
+        tsch_sleep_wake();
+        #elif defined(MAC_CONF_WITH_TSCH)
         /* TSCH-only: we know that probably we'll join a new network once we
          * are back up, so we disassociate manually */
         if (tsch_is_associated)
@@ -532,13 +1325,31 @@ PROCESS_THREAD(client_process, ev, data)
         NETSTACK_RADIO.on();
         NETSTACK_MAC.on();
         #endif
-        NETSTACK_RADIO.set_value(RADIO_PARAM_TXPOWER, CLIENT_RADIO_POWER_CONF);
-        etimer_set(&timer, STATE_MACHINE_PERIODIC);
+        /* The power last used with the parent kept, if any */
+        tx_power_apply();
+        #if CLIENT_FAST_REJOIN
+        fast_rejoin_resume();
+        #endif
+        #if NET_SEARCH_TIMEOUT > 0
+        timer_set(&net_search, NET_SEARCH_TIMEOUT);
+        #endif
+        process_poll(&client_process);
         break;
         
       case MQTT_STATE_WAIT_IP:
         LOG_INFO("Waiting IP address\n");
-        etimer_set(&timer, STATE_MACHINE_PERIODIC);
+        if (rpl_has_parent())
+          /* Only the DAO-ACK is missing, and it is not notified */
+          etimer_set(&timer, net_search_wait(NET_POLL_PERIOD));
+        else
+          /* net_state_change wakes us up as soon as a parent is found */
+          etimer_set(&timer, net_search_wait(NET_EVENT_TIMEOUT));
+        #if SPECULATE
+        /* Once joined, nothing happens until the stop is confirmed */
+        if (speculation.active && (rpl_is_reachable_2() ||
+            timer_remaining(&speculation.timeout) < NET_EVENT_TIMEOUT))
+          etimer_set(&timer, timer_remaining(&speculation.timeout));
+        #endif
         break;
         
       case MQTT_STATE_CONNECT_MQTT:
@@ -546,10 +1357,24 @@ PROCESS_THREAD(client_process, ev, data)
         LOG_INFO("We have an IP; connection attempt to MQTT\n");
 
         mqtt_disconn_received = 0;
+        #if MQTT_TRANSPORT_SN
+        if (mqtt_sn_connect(&conn, mqtt_keep_alive(),
+                            !MQTT_PERSISTENT_SESSION) != MQTT_SN_STATUS_OK)
+          mqtt_disconn_received = 1;
+        #else
         mqtt_status_t stat;
-        stat = mqtt_connect(&conn, MQTT_BROKER_IP_ADDR, MQTT_BROKER_PORT, K * 3);
+        stat = mqtt_connect(&conn, MQTT_BROKER_IP_ADDR, MQTT_BROKER_PORT,
+                            mqtt_keep_alive());
         if (stat != MQTT_STATUS_OK)
           mqtt_disconn_received = 1;
+        #endif
+        if (mqtt_disconn_received)
+          process_poll(&client_process);
+        #if MQTT_PERSISTENT_SESSION && !MQTT_TRANSPORT_SN
+        /* mqtt_connect() always asks for a clean session, but the CONNECT
+         * message is built only later by the MQTT process */
+        conn.connect_vhdr_flags &= ~MQTT_VHDR_CLEAN_SESSION_FLAG;
+        #endif
         break;
         
       case MQTT_STATE_WAIT_MQTT:
@@ -558,15 +1383,35 @@ PROCESS_THREAD(client_process, ev, data)
         
       case MQTT_STATE_CONNECTED_PUBLISH:
         LOG_INFO("Should publish\n");
-        if (mqtt_ready(&conn) && conn.out_buffer_sent) {
+        #if REMOTE_CONFIG_ENABLED
+        if (client_mqtt_ready() && subscribe()) {
+          /* Publish once the subscription is acknowledged: the commands
+           * retained by the broker are received meanwhile */
+        } else
+        #endif
+        if (client_mqtt_ready()) {
           set_led_pattern(LEDS_RED | LEDS_GREEN, 0b0101, 0);
           publish();
         } else {
+          /* The last message has not been acknowledged within K */
+          tx_power_failed();
+          #if MQTT_TRANSPORT_SN
+          LOG_INFO("Still publishing... (MQTT-SN state=%d)\n", conn.state);
+          #else
           LOG_INFO("Still publishing... (MQTT state=%d, q=%u)\n", conn.state,
             conn.out_queue_full);
+          #endif
         }
         #if CSMA_MANUAL_DUTY_CYCLING==0 && PUBLISH_ON_MOVEMENT==0
-        etimer_set(&timer, K);
+        /* Keep the period when woken by the timer, start it otherwise */
+        if (ev == PROCESS_EVENT_TIMER && data == &timer)
+          wake_sched_reset(&timer, sample_period(), K_SLACK);
+        else
+          wake_sched_set(&timer, sample_period(), K_SLACK);
+        #endif
+        #if MQTT_PERSISTENT_SESSION
+        if (mqtt_resume_pending)
+          etimer_set(&timer, MQTT_RESUME_TIMEOUT);
         #endif
         break;
         
@@ -575,15 +1420,38 @@ PROCESS_THREAD(client_process, ev, data)
 
       case MQTT_STATE_DISCONNECT:
         set_led_pattern(LEDS_RED, 0b00010101, 0);
+        #if MQTT_PERSISTENT_SESSION
+        if (mqtt_suspend) {
+          /* Leave the connection open, to resume it at the next cycle */
+          LOG_INFO("Suspending MQTT connection (%u resumed, %u dropped)\n",
+                   mqtt_resumes, mqtt_resumes_dropped);
+          #if !MQTT_TRANSPORT_SN
+          /* A PINGREQ sent with the radio off would be retransmitted until
+           * TCP gives up on the connection */
+          ctimer_stop(&conn.keep_alive_timer);
+          #endif
+          mqtt_suspend = 0;
+          mqtt_fake_disconnect = 1;
+          process_poll(&client_process);
+          break;
+        }
+        #endif
         LOG_INFO("Disconnecting MQTT\n");
+        #if MQTT_TRANSPORT_SN
+        /* A MQTT-SN connection attempt can always be abandoned */
+        if (!client_mqtt_closed())
+          mqtt_sn_disconnect(&conn);
+        #else
         if (conn.state == MQTT_CONN_STATE_CONNECTED_TO_BROKER)
           mqtt_disconnect(&conn);
+        #endif
         else {
           /* When mqtt_disconnect is called on a non-completely-connected
            * MQTT connection object, the MQTT thread goes in an inconsistent
            * state, but we still have to do something about this */
           LOG_INFO("MQTT is not connected; skipping");
           mqtt_fake_disconnect = 1;
+          process_poll(&client_process);
         }
         break;
         
@@ -592,21 +1460,39 @@ PROCESS_THREAD(client_process, ev, data)
         
       case MQTT_STATE_DISCONNECT_3:
         LOG_INFO("Shutting down radio\n");
+        #if CLIENT_FAST_REJOIN
+        if (!is_moving) {
+          fast_rejoin_suspend();
+        } else {
+          fast_rejoin_forget();
+          rpl_dag_leave();
+        }
+        #else
         rpl_dag_leave();
+        #endif
         #ifndef MAC_CONF_WITH_TSCH
         NETSTACK_MAC.off();
         NETSTACK_RADIO.off();
+        #elif TSCH_SLEEP_ENABLED
+        /* Turning off MAC does not work for TSCH: stop the TSCH processes
+         * instead, or they would keep scanning with the radio on */
+        tsch_sleep_enter();
         #endif
-        /* TSCH-only issue: turning off MAC does not work for TSCH.
-         * If TSCH is still in scanning mode, then we are *wasting power* and
-         * we can do nothing about it because the TSCH stack is poorly written
-         * and patching it to stop operating is not easy. */
         #if CSMA_MANUAL_DUTY_CYCLING == 1
         /* setup a wake for publishing again instead of waiting indefinitely
          * The state machine will automatically reconnect and publish because  
          * the MQTT_STATE_INIT transition trigger always checks is_moving */
-        etimer_set(&timer, K);
+        #if SPECULATE
+        if (speculation.abandoned) {
+          /* An abandoned speculative join does not delay the next cycle */
+          speculation.abandoned = 0;
+          etimer_stop(&timer);
+        } else
+        #endif
+        wake_sched_set(&timer, sample_period(), K_SLACK);
         #endif
+        log_wakeups();
+        process_poll(&client_process);
         break;
 
       /* Should never happen */
@@ -615,7 +1501,9 @@ PROCESS_THREAD(client_process, ev, data)
         break;
     }
     
-    PROCESS_YIELD();
+    do {
+      PROCESS_YIELD();
+    } while (client_wakeup(ev, data, &timer) == WAKEUP_IGNORED);
     LOG_DBG("MQTT thd woke, state=%d, ev=0x%02X, data=%p\n", mqtt_state, ev, data);
   }
   
@@ -9,6 +9,7 @@
 #include "sys/log.h"
 #include "project-conf.h"
 #include "energest-log.h"
+#include "wake-sched.h"
 
 
 #define LOG_MODULE "Energy Log"
@@ -22,6 +23,99 @@
 PROCESS(energest_process, "Energest print process");
 
 
+#if ENERGEST_LOG_STATES
+
+/** The energest types, in the order of energest_log_type_t. */
+static const energest_type_t types[ENERGEST_LOG_TYPES] = {
+  ENERGEST_TYPE_CPU, ENERGEST_TYPE_LPM, ENERGEST_TYPE_DEEP_LPM,
+  ENERGEST_TYPE_LISTEN, ENERGEST_TYPE_TRANSMIT
+};
+
+static const char *const *state_names;
+static int n_state_names;
+/** The state being accounted for, or -1 before the first one. */
+static int curr_state = -1;
+/** The energest times when curr_state was entered. */
+static uint64_t entered[ENERGEST_LOG_TYPES];
+/** The energest times attributed to each state. */
+static uint64_t state_times[ENERGEST_LOG_MAX_STATES][ENERGEST_LOG_TYPES];
+
+
+void energest_log_set_state_names(const char *const *names, int n)
+{
+  state_names = names;
+  n_state_names = n;
+}
+
+
+void energest_log_state(int state)
+{
+  if (state == curr_state || state < 0 || state >= ENERGEST_LOG_MAX_STATES)
+    return;
+
+  energest_flush();
+  for (int i=0; i<ENERGEST_LOG_TYPES; i++) {
+    uint64_t now = energest_type_time(types[i]);
+    if (curr_state >= 0)
+      state_times[curr_state][i] += now - entered[i];
+    entered[i] = now;
+  }
+  curr_state = state;
+}
+
+
+uint64_t energest_log_state_time(int state, energest_log_type_t type)
+{
+  if (state != curr_state)
+    return state_times[state][type];
+  energest_flush();
+  return state_times[state][type] + energest_type_time(types[type]) -
+         entered[type];
+}
+
+
+/** Formats an unsigned 64 bit integer, which printf may not support.
+ * @param buf The output buffer, at least 21 characters long.
+ * @returns   The formatted string, at the end of buf. */
+static char *u64_str(char *buf, uint64_t v)
+{
+  char *p = buf + 20;
+  *p = '\0';
+  do {
+    *--p = '0' + v % 10;
+    v /= 10;
+  } while (v > 0);
+  return p;
+}
+
+
+/** Logs the energest times attributed to each state so far. */
+static void log_states(void)
+{
+  char buf[ENERGEST_LOG_TYPES][21];
+  char *t[ENERGEST_LOG_TYPES];
+
+  LOG_INFO("%-22s %10s %10s %10s %10s %10s ticks\n", "State", "CPU", "LPM",
+           "Deep LPM", "Listen", "Transmit");
+  for (int s=0; s<ENERGEST_LOG_MAX_STATES; s++) {
+    int used = s == curr_state;
+    for (int i=0; i<ENERGEST_LOG_TYPES; i++) {
+      uint64_t v = energest_log_state_time(s, i);
+      t[i] = u64_str(buf[i], v);
+      used |= v != 0;
+    }
+    if (!used)
+      continue;
+    LOG_INFO("%-22s %10s %10s %10s %10s %10s\n",
+             s < n_state_names ? state_names[s] : "?", t[ENERGEST_LOG_CPU],
+             t[ENERGEST_LOG_LPM], t[ENERGEST_LOG_DEEP_LPM],
+             t[ENERGEST_LOG_LISTEN], t[ENERGEST_LOG_TRANSMIT]);
+  }
+}
+
+#endif
+
+
 PROCESS_THREAD(energest_process, ev, data)
 {
   static struct etimer et;
@@ -33,7 +127,7 @@ PROCESS_THREAD(energest_process, ev, data)
 
   while(1) {
     PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
-    etimer_reset(&et);
+    wake_sched_reset(&et, ENERGEST_LOG_DELAY, ENERGEST_LOG_SLACK);
 
     /* Flush all energest times so we can read latest values */
     energest_flush();
@@ -45,6 +139,9 @@ PROCESS_THREAD(energest_process, ev, data)
     LOG_INFO("Radio: Listen: %lu Transmit: %lu seconds\n",
            (unsigned long)(energest_type_time(ENERGEST_TYPE_LISTEN) / ENERGEST_SECOND),
            (unsigned long)(energest_type_time(ENERGEST_TYPE_TRANSMIT) / ENERGEST_SECOND));
+    #if ENERGEST_LOG_STATES
+    log_states();
+    #endif
   }
   PROCESS_END();
 }
@@ -1,5 +1,11 @@
 /** @file 
  * @brief Energest Log Module
+ *
+ * Periodically logs the energest times of the whole device. When 
+ * ENERGEST_LOG_CONF_STATES is 1, the times are also attributed to the states
+ * of a state machine, which reports each change of state with 
+ * energest_log_state(), and the per-state totals are logged as a table in
+ * energest ticks. When it is 0, energest_log_state() compiles to nothing.
  * 
  * @author Marco Bacis
  * @author Daniele Cattaneo */
@@ -10,8 +16,55 @@
 #include "contiki.h"
 
 
+/* Attribute the energest times to the states of a state machine */
+#if defined(ENERGEST_LOG_CONF_STATES) && ENERGEST_CONF_ON == 1
+#define ENERGEST_LOG_STATES ENERGEST_LOG_CONF_STATES
+#else
+#define ENERGEST_LOG_STATES 0
+#endif
+
+/** Maximum number of states energest times can be attributed to. */
+#define ENERGEST_LOG_MAX_STATES 16
+
+
+/** The energest types accounted for each state. */
+typedef enum {
+  ENERGEST_LOG_CPU,
+  ENERGEST_LOG_LPM,
+  ENERGEST_LOG_DEEP_LPM,
+  ENERGEST_LOG_LISTEN,
+  ENERGEST_LOG_TRANSMIT,
+  ENERGEST_LOG_TYPES
+} energest_log_type_t;
+
+
 /** The process to launch to get energest statistics. */
 PROCESS_NAME(energest_process);
 
 
+#if ENERGEST_LOG_STATES
+
+/** Sets the names of the states, used when logging the per-state table.
+ * @param names Array of n names, indexed by state. Must stay valid. */
+void energest_log_set_state_names(const char *const *names, int n);
+
+/** Attributes the energest times elapsed since the previous call to the
+ * previous state, and starts accounting for a new state. Does nothing if
+ * the state did not change.
+ * @param state The new state, between 0 and ENERGEST_LOG_MAX_STATES-1. */
+void energest_log_state(int state);
+
+/** @returns The energest time attributed to a state so far, in energest
+ *           ticks, including the time spent in it if it is the current 
+ *           state. */
+uint64_t energest_log_state_time(int state, energest_log_type_t type);
+
+#else
+
+#define energest_log_set_state_names(names, n)
+#define energest_log_state(state)
+
+#endif
+
+
 #endif
@@ -0,0 +1,106 @@
+/** @file
+ * @brief Fast RPL Rejoin implementation
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#include "contiki.h"
+#include "rpl.h"
+#include "sys/log.h"
+#include "fast-rejoin.h"
+
+
+#define LOG_MODULE "Fast Rejoin"
+#ifdef LOG_CONF_LEVEL_FAST_REJOIN
+#define LOG_LEVEL  LOG_CONF_LEVEL_FAST_REJOIN
+#else
+#define LOG_LEVEL  LOG_LEVEL_ERR
+#endif
+
+
+/** 1 if the DAG has been kept while the radio is off. */
+static uint8_t kept;
+/** The DAG kept. */
+static uip_ipaddr_t kept_dag_id;
+/** The address of the preferred parent in the DAG kept. */
+static uip_ipaddr_t kept_parent;
+/** The timer of the fast rejoin in progress. */
+static struct ctimer timeout;
+/** Statistics. */
+static uint16_t attempts, failures;
+
+
+/** Checks the result of the fast rejoin in progress, and falls back to the
+ * normal discovery if the network is not reachable yet. */
+static void check_rejoin(void *ptr)
+{
+  if (rpl_is_reachable())
+    return;
+
+  failures++;
+  LOG_WARN("no answer from the parent, starting discovery\n");
+  rpl_dag_leave();
+  rpl_icmp6_dis_output(NULL);
+}
+
+
+void fast_rejoin_suspend(void)
+{
+  ctimer_stop(&timeout);
+
+  if (!curr_instance.used || curr_instance.dag.preferred_parent == NULL ||
+      !rpl_is_reachable()) {
+    kept = 0;
+    rpl_dag_leave();
+    return;
+  }
+
+  uip_ipaddr_copy(&kept_dag_id, &curr_instance.dag.dag_id);
+  uip_ipaddr_copy(&kept_parent,
+                  rpl_neighbor_get_ipaddr(curr_instance.dag.preferred_parent));
+  /* Nothing can be sent or received while the radio is off: don't let the
+   * probing and the DAO retransmissions dismantle the DAG in the meantime */
+  rpl_timers_stop_dag_timers();
+  kept = 1;
+  LOG_DBG("DAG kept (%u fast rejoins, %u failed)\n", attempts, failures);
+}
+
+
+void fast_rejoin_forget(void)
+{
+  ctimer_stop(&timeout);
+  if (kept) {
+    kept = 0;
+    LOG_DBG("DAG forgotten\n");
+    rpl_dag_leave();
+  }
+}
+
+
+int fast_rejoin_resume(void)
+{
+  if (!kept)
+    return 0;
+  kept = 0;
+
+  if (!curr_instance.used || curr_instance.dag.preferred_parent == NULL ||
+      !uip_ipaddr_cmp(&kept_dag_id, &curr_instance.dag.dag_id)) {
+    /* The DAG was left while the radio was off */
+    rpl_dag_leave();
+    return 0;
+  }
+
+  attempts++;
+  LOG_DBG("probing the parent\n");
+  /* The network is reachable again only once the DAO is acknowledged */
+  curr_instance.dag.state = DAG_JOINED;
+  rpl_icmp6_dis_output(&kept_parent);
+  rpl_timers_dio_reset("Fast rejoin");
+  #if RPL_WITH_PROBING
+  rpl_schedule_probing();
+  #endif
+  rpl_timers_schedule_dao();
+
+  ctimer_set(&timeout, FAST_REJOIN_TIMEOUT, check_rejoin, NULL);
+  return 1;
+}
@@ -0,0 +1,49 @@
+/** @file
+ * @brief Fast RPL Rejoin
+ *
+ * When the radio is manually duty cycled and the device has not moved, the
+ * RPL network found at the next cycle is most likely the same one. Instead
+ * of leaving the DAG when the radio is turned off, its state (DAG, preferred
+ * parent, and the address built from the DAG prefix) is kept with the RPL
+ * timers stopped. When the radio is turned on again, a unicast DIS is sent
+ * to the parent and a DAO is scheduled right away: the network is reachable
+ * again as soon as the DAO is acknowledged, without waiting for the DIO
+ * trickle timers of the neighbors.
+ *
+ * If the DAO is not acknowledged within FAST_REJOIN_TIMEOUT, the DAG is left
+ * and the normal discovery is started.
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#ifndef _FAST_REJOIN_H_
+#define _FAST_REJOIN_H_
+
+#include "contiki.h"
+
+
+/** The time allowed to the parent to acknowledge the DAO after the radio
+ * is turned on, before falling back to the normal discovery. */
+#ifdef FAST_REJOIN_CONF_TIMEOUT
+#define FAST_REJOIN_TIMEOUT FAST_REJOIN_CONF_TIMEOUT
+#else
+#define FAST_REJOIN_TIMEOUT (2 * CLOCK_SECOND)
+#endif
+
+
+/** Keeps the state of the RPL network while the radio is off. The DAG is
+ * left instead if the network is not reachable.
+ * @note  Must be called before turning the radio off. */
+void fast_rejoin_suspend(void);
+
+/** Leaves the DAG kept by fast_rejoin_suspend(), if any. To be called when
+ * the network is unlikely to be the same at the next cycle. */
+void fast_rejoin_forget(void);
+
+/** Starts a fast rejoin of the DAG kept by fast_rejoin_suspend(), if any.
+ * @returns 1 if a fast rejoin has been started.
+ * @note  Must be called after turning the radio on. */
+int fast_rejoin_resume(void);
+
+
+#endif
@@ -7,6 +7,7 @@
 #include "contiki.h"
 #include "sys/log.h"
 #include "led-report.h"
+#include "wake-sched.h"
 
 
 #define LOG_MODULE "Leds"
@@ -103,6 +104,8 @@ void led_report_init(void)
   
   PROCESS_CONTEXT_BEGIN(&led_report_process);
   etimer_set(&led_timer, 0);
+  /* Other timers can be aligned to the LED transitions, not the reverse */
+  wake_sched_register(&led_timer);
   t_last_shift = etimer_start_time(&led_timer);
   t_last_update = etimer_start_time(&led_timer);
   PROCESS_CONTEXT_END(&led_report_process);
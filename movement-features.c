@@ -0,0 +1,262 @@
+/** @file 
+ * @brief Motion Feature Extractor Implementation
+ * 
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#include <string.h>
+#include "movement.h"
+#include "movement-features.h"
+
+
+void movement_features_init(movement_features_t *f)
+{
+  memset(f, 0, sizeof(movement_features_t));
+}
+
+
+void movement_features_add(movement_features_t *f, const int acc[3])
+{
+  int32_t mod = acc[LAST_ACC_X]*acc[LAST_ACC_X] + 
+                acc[LAST_ACC_Y]*acc[LAST_ACC_Y] + 
+                acc[LAST_ACC_Z]*acc[LAST_ACC_Z] - GRAVITY*GRAVITY;
+  
+  /* The first sample has no predecessor, so it does not contribute to SMA */
+  int32_t sma = 0;
+  if (f->count > 0) {
+    sma = ABS(acc[LAST_ACC_X] - f->last[LAST_ACC_X]) +
+          ABS(acc[LAST_ACC_Y] - f->last[LAST_ACC_Y]) +
+          ABS(acc[LAST_ACC_Z] - f->last[LAST_ACC_Z]);
+  }
+  #if MOVEMENT_TILT_TRIGGER
+  movement_tilt_t tilt_now;
+  int32_t tilt = 0;
+  movement_tilt(acc, &tilt_now);
+  if (f->count > 0)
+    tilt = movement_tilt_delta(&tilt_now, &f->last_tilt);
+  f->last_tilt = tilt_now;
+  #endif
+  
+  uint8_t i;
+  if (f->count < MOVEMENT_WINDOW) {
+    i = (f->head + f->count) % MOVEMENT_WINDOW;
+    f->count++;
+  } else {
+    /* Window full: the new sample replaces the oldest one */
+    i = f->head;
+    f->head = (f->head + 1) % MOVEMENT_WINDOW;
+    f->sum -= f->mods[i];
+    f->sum_abs -= ABS(f->mods[i]);
+    f->sum_sq -= (int64_t)f->mods[i] * f->mods[i];
+    f->sum_sma -= f->smas[i];
+    #if MOVEMENT_TILT_TRIGGER
+    f->sum_tilt -= f->tilts[i];
+    #endif
+  }
+  
+  f->mods[i] = mod;
+  f->smas[i] = sma;
+  f->sum += mod;
+  f->sum_abs += ABS(mod);
+  f->sum_sq += (int64_t)mod * mod;
+  f->sum_sma += sma;
+  #if MOVEMENT_TILT_TRIGGER
+  f->tilts[i] = tilt;
+  f->sum_tilt += tilt;
+  #endif
+  
+  f->last[LAST_ACC_X] = acc[LAST_ACC_X];
+  f->last[LAST_ACC_Y] = acc[LAST_ACC_Y];
+  f->last[LAST_ACC_Z] = acc[LAST_ACC_Z];
+}
+
+
+int32_t movement_features_mean(const movement_features_t *f)
+{
+  if (f->count == 0)
+    return 0;
+  return f->sum / f->count;
+}
+
+
+int32_t movement_features_mean_abs(const movement_features_t *f)
+{
+  if (f->count == 0)
+    return 0;
+  return f->sum_abs / f->count;
+}
+
+
+uint32_t movement_features_variance(const movement_features_t *f)
+{
+  if (f->count == 0)
+    return 0;
+  /* var = (n * sum(x^2) - sum(x)^2) / n^2, which is never negative */
+  int64_t n = f->count;
+  int64_t var = (n * f->sum_sq - (int64_t)f->sum * f->sum) / (n * n);
+  return var > UINT32_MAX ? UINT32_MAX : (uint32_t)var;
+}
+
+
+int32_t movement_features_sma(const movement_features_t *f)
+{
+  if (f->count == 0)
+    return 0;
+  return f->sum_sma / f->count;
+}
+
+
+int32_t movement_features_tilt(const movement_features_t *f)
+{
+  #if MOVEMENT_TILT_TRIGGER
+  if (f->count == 0)
+    return 0;
+  return f->sum_tilt / f->count;
+  #else
+  return 0;
+  #endif
+}
+
+
+int movement_features_exceed(const movement_features_t *f, 
+                             int32_t t_mod, int32_t t_dmod, int32_t t_sma,
+                             int32_t t_tilt)
+{
+  if (f->count == 0)
+    return 0;
+  return movement_features_mean_abs(f) >= t_mod ||
+         movement_features_variance(f) >= (uint32_t)t_dmod * t_dmod ||
+         movement_features_sma(f) >= t_sma ||
+         (MOVEMENT_TILT_TRIGGER && movement_features_tilt(f) >= t_tilt);
+}
+
+
+int movement_features_moving(const movement_features_t *f)
+{
+  return movement_features_exceed(f, T_MOD, T_DMOD, T_SMA, T_TILT);
+}
+
+
+int movement_features_settling(const movement_features_t *f, int n)
+{
+  if (n <= 0 || f->count < n)
+    return 0;
+  for (int i=1; i<=n; i++) {
+    int j = (f->head + f->count - i) % MOVEMENT_WINDOW;
+    if (ABS(f->mods[j]) >= T_MOD || f->smas[j] >= T_SMA)
+      return 0;
+    #if MOVEMENT_TILT_TRIGGER
+    if (f->tilts[j] >= T_TILT)
+      return 0;
+    #endif
+  }
+  return 1;
+}
+
+
+/** Number of CORDIC iterations. */
+#define CORDIC_ITERATIONS  14
+/** Inverse of the CORDIC gain, multiplied by 2^16. */
+#define CORDIC_INV_GAIN    39797
+/** The inputs are scaled up to at least this magnitude for precision. */
+#define CORDIC_MIN_INPUT   (1L << 20)
+
+/** atan(2^-i) in hundredths of degree. */
+static const int16_t cordic_atan[CORDIC_ITERATIONS] = {
+  4500, 2657, 1404, 713, 358, 179, 90, 45, 22, 11, 6, 3, 1, 1
+};
+
+
+/** Rotates the vector (x, y) onto the positive X axis with CORDIC.
+ * @param x     On return, the modulo of the vector (scaled by the CORDIC
+ *              gain and by 2^shift).
+ * @param shift On return, the scale applied to the input.
+ * @returns The angle of the vector in hundredths of degree. */
+static int32_t cordic_vector(int32_t *x, int32_t y, int *shift)
+{
+  int32_t angle = 0;
+  
+  *shift = 0;
+  if (*x == 0 && y == 0)
+    return 0;
+  
+  /* Inputs must not exceed 2^30 after the scaling and the gain */
+  while (ABS(*x) < CORDIC_MIN_INPUT && ABS(y) < CORDIC_MIN_INPUT) {
+    *x <<= 1;
+    y <<= 1;
+    (*shift)++;
+  }
+  
+  /* CORDIC converges for angles in [-99.9, 99.9] degrees: rotate by 180 
+   * degrees the vectors in the left half-plane */
+  if (*x < 0) {
+    angle = y >= 0 ? 18000 : -18000;
+    *x = -*x;
+    y = -y;
+  }
+  
+  for (int i=0; i<CORDIC_ITERATIONS; i++) {
+    int32_t x1;
+    if (y > 0) {
+      x1 = *x + (y >> i);
+      y = y - (*x >> i);
+      angle += cordic_atan[i];
+    } else {
+      x1 = *x - (y >> i);
+      y = y + (*x >> i);
+      angle -= cordic_atan[i];
+    }
+    *x = x1;
+  }
+  
+  if (angle > 18000)
+    angle -= 36000;
+  else if (angle < -18000)
+    angle += 36000;
+  return angle;
+}
+
+
+int movement_atan2(int32_t y, int32_t x)
+{
+  int shift;
+  return cordic_vector(&x, y, &shift);
+}
+
+
+void movement_tilt(const int acc[3], movement_tilt_t *tilt)
+{
+  int shift;
+  int32_t x = acc[LAST_ACC_X], y = acc[LAST_ACC_Y], z = acc[LAST_ACC_Z];
+  
+  /* The angle on the XY plane is just noise when the device lies flat */
+  int32_t xy = x;
+  int32_t alfa = cordic_vector(&xy, y, &shift);
+  xy = (int32_t)(((int64_t)xy * CORDIC_INV_GAIN) >> (16 + shift));
+  tilt->alfa = xy >= GRAVITY / 4 ? alfa : MOVEMENT_ANGLE_UNDEFINED;
+  
+  /* Keep the modulo on the YZ plane scaled, to avoid losing precision */
+  int32_t yz = z;
+  cordic_vector(&yz, y, &shift);
+  yz = (int32_t)(((int64_t)yz * CORDIC_INV_GAIN) >> 16);
+  tilt->gamma = movement_atan2(-x * (1L << shift), yz);
+}
+
+
+/** @returns The absolute difference between two angles in hundredths of 
+ *           degree, taking into account the wrap around at 180 degrees. */
+static int angle_delta(int a, int b)
+{
+  int d = ABS(a - b);
+  return d > 18000 ? 36000 - d : d;
+}
+
+
+int movement_tilt_delta(const movement_tilt_t *a, const movement_tilt_t *b)
+{
+  int delta = angle_delta(a->gamma, b->gamma);
+  if (a->alfa != MOVEMENT_ANGLE_UNDEFINED && 
+      b->alfa != MOVEMENT_ANGLE_UNDEFINED)
+    delta = MAX(delta, angle_delta(a->alfa, b->alfa));
+  return delta;
+}
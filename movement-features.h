@@ -0,0 +1,156 @@
+/** @file 
+ * @brief Motion Feature Extractor
+ *
+ * Computes, over a sliding window of acceleration samples, the features
+ * used to decide if the device is moving: the mean and the variance of
+ * the deviation of the squared acceleration modulo from the gravity, and
+ * the signal magnitude area (SMA) of the acceleration changes and, with
+ * MOVEMENT_TILT_TRIGGER, the mean change of the tilt angles.
+ * All features are updated in constant time for each sample, and only
+ * integer arithmetic is used.
+ * 
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#ifndef _MOVEMENT_FEATURES_H_
+#define _MOVEMENT_FEATURES_H_
+
+#include "contiki.h"
+
+
+/** The number of samples in the feature window. */
+#ifdef MOVEMENT_CONF_WINDOW
+#define MOVEMENT_WINDOW MOVEMENT_CONF_WINDOW
+#else
+#define MOVEMENT_WINDOW 4
+#endif
+
+/** Whether the change of the tilt of the device is a feature too. */
+#ifndef MOVEMENT_TILT_TRIGGER
+#define MOVEMENT_TILT_TRIGGER 0
+#endif
+
+/** Value of an angle which cannot be determined. */
+#define MOVEMENT_ANGLE_UNDEFINED INT16_MIN
+
+/** Tilt angles of the device, in hundredths of degree. */
+typedef struct {
+  /** Rotation around the Z axis, atan2(y, x); MOVEMENT_ANGLE_UNDEFINED if
+   * the projection of the acceleration on the XY plane is too small. */
+  int16_t alfa;
+  /** Inclination of the X axis, atan2(-x, sqrt(y^2 + z^2)). */
+  int16_t gamma;
+} movement_tilt_t;
+
+
+/** The state of the motion feature extractor. */
+typedef struct {
+  /** Ring buffer of the values of |a|^2 - GRAVITY^2 in the window. */
+  int32_t mods[MOVEMENT_WINDOW];
+  /** Ring buffer of the SMA terms |dx|+|dy|+|dz| in the window. */
+  int32_t smas[MOVEMENT_WINDOW];
+  /** Sum of mods[]. */
+  int32_t sum;
+  /** Sum of the absolute values of mods[]. */
+  int32_t sum_abs;
+  /** Sum of the squares of mods[]. */
+  int64_t sum_sq;
+  /** Sum of smas[]. */
+  int32_t sum_sma;
+  #if MOVEMENT_TILT_TRIGGER
+  /** Ring buffer of the tilt changes, in hundredths of degree. */
+  int32_t tilts[MOVEMENT_WINDOW];
+  /** Sum of tilts[]. */
+  int32_t sum_tilt;
+  /** The tilt of the last sample added. */
+  movement_tilt_t last_tilt;
+  #endif
+  /** The last sample added. */
+  int last[3];
+  /** The index of the oldest sample in the ring buffers. */
+  uint8_t head;
+  /** The number of samples in the ring buffers. */
+  uint8_t count;
+} movement_features_t;
+
+
+/** Empties the feature window.
+ * @param f The feature extractor. */
+void movement_features_init(movement_features_t *f);
+
+/** Adds an acceleration sample to the feature window, discarding the
+ * oldest one if the window is full.
+ * @param f   The feature extractor.
+ * @param acc The acceleration vector, scaled like last_acc. */
+void movement_features_add(movement_features_t *f, const int acc[3]);
+
+/** @returns The mean of |a|^2 - GRAVITY^2 over the window. */
+int32_t movement_features_mean(const movement_features_t *f);
+
+/** @returns The mean of the absolute value of |a|^2 - GRAVITY^2 over the 
+ *          window. */
+int32_t movement_features_mean_abs(const movement_features_t *f);
+
+/** @returns The variance of |a|^2 - GRAVITY^2 over the window. */
+uint32_t movement_features_variance(const movement_features_t *f);
+
+/** @returns The signal magnitude area of the acceleration changes over the
+ *          window, normalized to the number of samples. 
+ * @note    The first sample added after movement_features_init() has no
+ *          predecessor, thus its contribution is zero. */
+int32_t movement_features_sma(const movement_features_t *f);
+
+/** @returns The mean change of the tilt between consecutive samples over
+ *          the window, in hundredths of degree, or 0 without
+ *          MOVEMENT_TILT_TRIGGER. Like the SMA, the first sample added does
+ *          not contribute. */
+int32_t movement_features_tilt(const movement_features_t *f);
+
+/** Decides if the device is moving from the current features.
+ *
+ * The device is moving if the mean absolute deviation from the gravity is at
+ * least `t_mod`, if the standard deviation is at least `t_dmod`, if the SMA
+ * is at least `t_sma`, or (with MOVEMENT_TILT_TRIGGER) if the mean tilt
+ * change is at least `t_tilt`.
+ * @returns 1 if the device is moving, 0 otherwise (including when the window
+ *          is empty). */
+int movement_features_exceed(const movement_features_t *f, 
+                             int32_t t_mod, int32_t t_dmod, int32_t t_sma,
+                             int32_t t_tilt);
+
+/** Decides if the device is moving from the current features, using the
+ * T_MOD, T_DMOD, T_SMA and T_TILT thresholds.
+ * @returns 1 if the device is moving, 0 otherwise (including when the window
+ *          is empty). */
+int movement_features_moving(const movement_features_t *f);
+
+/** Decides if the newest samples of the window are still, even if the
+ * features of the whole window may still show movement.
+ *
+ * Each of the `n` newest samples must deviate from the gravity by less than
+ * T_MOD, and change from its predecessor by less than T_SMA (and its tilt
+ * by less than T_TILT, with MOVEMENT_TILT_TRIGGER). Once the older
+ * samples have left the window, movement_features_moving() is likely to
+ * return 0 as well.
+ * @returns 1 if the `n` newest samples are still, 0 otherwise (including
+ *          when the window holds fewer than `n` samples). */
+int movement_features_settling(const movement_features_t *f, int n);
+
+/** Computes the arc tangent of y/x using the signs of both arguments to
+ * determine the quadrant, with integer arithmetic only.
+ * @returns The angle in hundredths of degree, in the range [-18000, 18000].
+ *          The result for x = y = 0 is 0. */
+int movement_atan2(int32_t y, int32_t x);
+
+/** Computes the tilt angles corresponding to an acceleration vector.
+ * @param acc  The acceleration vector, scaled like last_acc.
+ * @param tilt On return, the tilt angles. */
+void movement_tilt(const int acc[3], movement_tilt_t *tilt);
+
+/** Computes how much the tilt of the device has changed.
+ * @returns The largest absolute difference between the defined angles of
+ *          `a` and `b`, in hundredths of degree. */
+int movement_tilt_delta(const movement_tilt_t *a, const movement_tilt_t *b);
+
+
+#endif
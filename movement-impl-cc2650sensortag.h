@@ -5,9 +5,75 @@
  * @author Daniele Cattaneo */
  
 #include "board-peripherals.h"
+#include "board-i2c.h"
+#include "sensor-common.h"
 
 #define READING_ERROR CC26XX_SENSOR_READING_ERROR
 
+/* MPU-9250 registers and bits accessed directly
+ * (see the MPU-9250 Register Map and Descriptions document). The MPU is on
+ * the second I2C interface, like in the SENSOR_SELECT() of the driver. */
+#define MPU_I2C_INTERFACE         BOARD_I2C_INTERFACE_1
+#define MPU_I2C_ADDRESS           0x68
+#define MPU_ACCEL_CONFIG_2        0x1D
+#define MPU_LP_ACCEL_ODR          0x1E
+#define MPU_FIFO_EN               0x23
+#define MPU_INT_STATUS            0x3A
+#define MPU_ACCEL_XOUT_H          0x3B
+#define MPU_USER_CTRL             0x6A
+#define MPU_PWR_MGMT_1            0x6B
+#define MPU_PWR_MGMT_2            0x6C
+#define MPU_FIFO_COUNT_H          0x72
+#define MPU_FIFO_R_W              0x74
+
+/* Raw accelerometer units per g in the default +/-2g range */
+#define MPU_RAW_PER_G             16384
+
+
+#if MOVEMENT_BATCH_SIZE > 1
+
+/* Output data rate of the accelerometer in low power (cycle) mode, which
+ * fills the FIFO between wakes: the rate is 1000 / 4096 Hz * 2^odr, from
+ * 0 (0.24 Hz) to 11 (500 Hz). The default gives 0.98 Hz, so that the FIFO
+ * holds about 87 s of samples, more than the longest time between wakes. */
+#ifdef MOVEMENT_CONF_FIFO_ODR
+#define MOVEMENT_FIFO_ODR MOVEMENT_CONF_FIFO_ODR
+#else
+#define MOVEMENT_FIFO_ODR 2
+#endif
+
+#define MPU_ACCEL_FCHOICE_B       0x08
+#define MPU_ACCEL_DLPF_LP         0x01
+#define MPU_FIFO_EN_ACCEL         0x08
+#define MPU_INT_STATUS_FIFO_OFLOW 0x10
+#define MPU_USER_CTRL_FIFO_EN     0x40
+#define MPU_USER_CTRL_FIFO_RST    0x04
+#define MPU_PWR_MGMT_1_CYCLE      0x20
+#define MPU_PWR_MGMT_2_DIS_G      0x07
+
+/* Size of the FIFO, and of a FIFO frame when only the accelerometer is
+ * enabled */
+#define MPU_FIFO_SIZE             512
+#define MPU_FIFO_FRAME            6
+/* Number of FIFO frames read with a single I2C transaction */
+#define MPU_FIFO_FRAMES_PER_READ  8
+
+/* The time the FIFO takes to fill up, in clock ticks */
+#define MOVEMENT_FIFO_SPAN \
+  ((MPU_FIFO_SIZE / MPU_FIFO_FRAME) * 4096UL * CLOCK_SECOND / \
+   (1000UL << MOVEMENT_FIFO_ODR))
+
+/* Overflows are recovered with a direct reading, but they lose the batch */
+#if MOVEMENT_FIFO_SPAN <= G || MOVEMENT_FIFO_SPAN <= MOVEMENT_PERIOD_MAX_STILL \
+    || MOVEMENT_FIFO_SPAN <= MOVEMENT_PERIOD_MAX_MOVING
+#error "MOVEMENT_CONF_FIFO_ODR too high: the FIFO overflows between wakes"
+#endif
+
+/** 1 if the accelerometer is sampling into its FIFO in background. */
+static int fifo_running = 0;
+
+#endif
+
 
 int movement_ready(process_event_t ev, process_data_t data)
 {
@@ -17,34 +83,169 @@ int movement_ready(process_event_t ev, process_data_t data)
 
 void init_movement_reading(void)
 {
+  #if MOVEMENT_BATCH_SIZE > 1
+  if (fifo_running) {
+    /* The accelerometer was never turned off; it's ready right away */
+    sensors_changed(&mpu_9250_sensor);
+    return;
+  }
+  #endif
   mpu_9250_sensor.configure(SENSORS_ACTIVE, MPU_9250_SENSOR_TYPE_ACC);
 }
 
 
-int get_mvmt_value_reliable(int vid)
+/** Converts a big endian raw accelerometer value to the scale of last_acc. */
+static int acc_convert(const uint8_t *raw)
 {
-  int try = 5;
-  int val = CC26XX_SENSOR_READING_ERROR;
-  while (try > 0 && val == CC26XX_SENSOR_READING_ERROR) {
-    val = mpu_9250_sensor.value(vid);
-    try--;
+  return (int)(int16_t)((raw[0] << 8) | raw[1]) * GRAVITY / MPU_RAW_PER_G;
+}
+
+
+/** Reads all the axes of the accelerometer at once, with a single I2C
+ * transaction, retrying up to MOVEMENT_READ_ATTEMPTS times overall.
+ * Updates movement_read_retries.
+ * @param acc On return, the acceleration values, or READING_ERROR if all the
+ *            attempts failed. */
+static void read_acc(int acc[3])
+{
+  uint8_t buf[6];
+  int ok = 0;
+  
+  board_i2c_select(MPU_I2C_INTERFACE, MPU_I2C_ADDRESS);
+  for (movement_read_retries = 0; 
+       movement_read_retries < MOVEMENT_READ_ATTEMPTS; 
+       movement_read_retries++) {
+    ok = sensor_common_read_reg(MPU_ACCEL_XOUT_H, buf, sizeof(buf));
+    if (ok)
+      break;
   }
-  if (val == CC26XX_SENSOR_READING_ERROR) {
+  board_i2c_deselect();
+  
+  if (!ok) {
     LOG_ERR("mvmt read failed\n");
-  } else {
-    LOG_DBG("mvmt read succeeded with %d retry attempts left\n", try);
+    acc[LAST_ACC_X] = acc[LAST_ACC_Y] = acc[LAST_ACC_Z] = READING_ERROR;
+    return;
+  }
+  
+  LOG_DBG("mvmt read succeeded after %d retries\n", movement_read_retries);
+  acc[LAST_ACC_X] = acc_convert(&buf[0]);
+  acc[LAST_ACC_Y] = acc_convert(&buf[2]);
+  acc[LAST_ACC_Z] = acc_convert(&buf[4]);
+}
+
+
+#if MOVEMENT_BATCH_SIZE > 1
+
+static bool mpu_write(uint8_t reg, uint8_t val)
+{
+  return sensor_common_write_reg(reg, &val, 1);
+}
+
+
+/** Configures the accelerometer (which must be already active) to store
+ * its samples in the FIFO at MOVEMENT_FIFO_ODR, in low power cycle mode with
+ * the gyroscope off. */
+static void fifo_start(void)
+{
+  board_i2c_select(MPU_I2C_INTERFACE, MPU_I2C_ADDRESS);
+  fifo_running = 
+    mpu_write(MPU_PWR_MGMT_2, MPU_PWR_MGMT_2_DIS_G) &&
+    mpu_write(MPU_ACCEL_CONFIG_2, MPU_ACCEL_FCHOICE_B | MPU_ACCEL_DLPF_LP) &&
+    mpu_write(MPU_LP_ACCEL_ODR, MOVEMENT_FIFO_ODR) &&
+    mpu_write(MPU_FIFO_EN, MPU_FIFO_EN_ACCEL) &&
+    mpu_write(MPU_USER_CTRL, MPU_USER_CTRL_FIFO_EN | MPU_USER_CTRL_FIFO_RST) &&
+    mpu_write(MPU_PWR_MGMT_1, MPU_PWR_MGMT_1_CYCLE);
+  board_i2c_deselect();
+  
+  if (!fifo_running) {
+    LOG_ERR("mvmt FIFO setup failed\n");
   }
-  return val;
 }
 
 
-void platform_get_movement(void)
+/** Reads all the samples in the FIFO, and keeps the most recent ones.
+ * @returns The number of samples stored in batch, or 0 if the FIFO 
+ *          has overflowed or could not be read. */
+static int fifo_drain(int batch[][3], int max)
 {
-  last_acc[LAST_ACC_X] = get_mvmt_value_reliable(MPU_9250_SENSOR_TYPE_ACC_X);
-  last_acc[LAST_ACC_Y] = get_mvmt_value_reliable(MPU_9250_SENSOR_TYPE_ACC_Y);
-  last_acc[LAST_ACC_Z] = get_mvmt_value_reliable(MPU_9250_SENSOR_TYPE_ACC_Z);
+  static uint8_t buf[MPU_FIFO_FRAME * MPU_FIFO_FRAMES_PER_READ];
+  int ring[MOVEMENT_BATCH_SIZE][3];
+  int n = 0;
+  
+  board_i2c_select(MPU_I2C_INTERFACE, MPU_I2C_ADDRESS);
+  
+  if (!sensor_common_read_reg(MPU_INT_STATUS, buf, 1) || 
+      (buf[0] & MPU_INT_STATUS_FIFO_OFLOW)) {
+    /* Frames are not aligned anymore after an overflow */
+    LOG_INFO("mvmt FIFO overflow\n");
+    mpu_write(MPU_USER_CTRL, MPU_USER_CTRL_FIFO_EN | MPU_USER_CTRL_FIFO_RST);
+    board_i2c_deselect();
+    return 0;
+  }
+  
+  if (!sensor_common_read_reg(MPU_FIFO_COUNT_H, buf, 2)) {
+    board_i2c_deselect();
+    return 0;
+  }
+  int frames = (((buf[0] & 0x1F) << 8) | buf[1]) / MPU_FIFO_FRAME;
+  
+  while (frames > 0) {
+    int chunk = MIN(frames, MPU_FIFO_FRAMES_PER_READ);
+    if (!sensor_common_read_reg(MPU_FIFO_R_W, buf, chunk * MPU_FIFO_FRAME))
+      break;
+      
+    for (int i=0; i<chunk; i++) {
+      uint8_t *frame = &buf[i * MPU_FIFO_FRAME];
+      int *acc = ring[n % max];
+      acc[LAST_ACC_X] = acc_convert(&frame[0]);
+      acc[LAST_ACC_Y] = acc_convert(&frame[2]);
+      acc[LAST_ACC_Z] = acc_convert(&frame[4]);
+      n++;
+    }
+    frames -= chunk;
+  }
+  
+  board_i2c_deselect();
+  
+  /* Unroll the ring buffer so that the oldest sample comes first */
+  int first = n > max ? n % max : 0;
+  n = MIN(n, max);
+  for (int i=0; i<n; i++) {
+    int *acc = ring[(first + i) % max];
+    batch[i][LAST_ACC_X] = acc[LAST_ACC_X];
+    batch[i][LAST_ACC_Y] = acc[LAST_ACC_Y];
+    batch[i][LAST_ACC_Z] = acc[LAST_ACC_Z];
+  }
+  
+  LOG_INFO("mvmt FIFO read: %d samples\n", n);
+  return n;
+}
+
+#endif
+
+
+int platform_get_movement_batch(int batch[][3], int max)
+{
+  #if MOVEMENT_BATCH_SIZE > 1
+  if (fifo_running) {
+    movement_read_retries = 0;
+    int n = fifo_drain(batch, max);
+    if (n > 0)
+      return n;
+  } else {
+    /* First reading after power on; the FIFO will be ready from the next
+     * reading on */
+    fifo_start();
+  }
+  /* No samples available from the FIFO; read the current ones */
+  #endif
+  
+  read_acc(batch[0]);
   
   LOG_INFO("mvmt read: %d %d %d\n", 
-           last_acc[LAST_ACC_X], last_acc[LAST_ACC_Y], last_acc[LAST_ACC_Z]);
+           batch[0][LAST_ACC_X], batch[0][LAST_ACC_Y], batch[0][LAST_ACC_Z]);
+  #if MOVEMENT_BATCH_SIZE == 1
   SENSORS_DEACTIVATE(mpu_9250_sensor);
+  #endif
+  return 1;
 }
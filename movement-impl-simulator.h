@@ -8,6 +8,13 @@
 
 #define READING_ERROR             ((int)0x80000000)
 
+/* Probability, in percent, that an attempt to read the accelerometer fails */
+#ifdef MOVEMENT_CONF_SIM_ERROR_RATE
+#define MOVEMENT_SIM_ERROR_RATE MOVEMENT_CONF_SIM_ERROR_RATE
+#else
+#define MOVEMENT_SIM_ERROR_RATE 0
+#endif
+
 
 process_event_t fakesens_event = PROCESS_EVENT_NONE;
 
@@ -27,18 +34,44 @@ void init_movement_reading(void)
 }
 
 
-void platform_get_movement(void)
+/** Simulates an attempt to read the accelerometer.
+ * @returns 1 if the attempt succeeded, 0 otherwise. */
+static int sim_read_attempt(void)
+{
+  /* Deterministic pseudo-random sequence, to make failures reproducible */
+  static uint32_t seed = 1;
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 16) % 100 >= MOVEMENT_SIM_ERROR_RATE;
+}
+
+
+int platform_get_movement_batch(int batch[][3], int max)
 {
   static int mov_idx = 0;
 
-  last_acc[LAST_ACC_X] = movements[mov_idx][0];
-  last_acc[LAST_ACC_Y] = movements[mov_idx][1];
-  last_acc[LAST_ACC_Z] = movements[mov_idx][2];
+  movement_read_retries = 0;
+  while (!sim_read_attempt()) {
+    if (++movement_read_retries == MOVEMENT_READ_ATTEMPTS) {
+      LOG_ERR("mvmt read failed\n");
+      batch[0][LAST_ACC_X] = READING_ERROR;
+      batch[0][LAST_ACC_Y] = READING_ERROR;
+      batch[0][LAST_ACC_Z] = READING_ERROR;
+      return 1;
+    }
+  }
+
+  for (int i=0; i<max; i++) {
+    batch[i][LAST_ACC_X] = movements[mov_idx][0];
+    batch[i][LAST_ACC_Y] = movements[mov_idx][1];
+    batch[i][LAST_ACC_Z] = movements[mov_idx][2];
 
-  if(mov_idx < MOVEMENTS-1) {
-    mov_idx++;
-  } else {
-    mov_idx = 0;
+    if(mov_idx < MOVEMENTS-1) {
+      mov_idx++;
+    } else {
+      mov_idx = 0;
+    }
   }
+  
+  return max;
 }
 
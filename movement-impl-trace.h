@@ -0,0 +1,294 @@
+/** @file
+ * @brief Accelerator Trace Replay Implementation
+ *
+ * Replays the acceleration values recorded in a trace file. The trace can be
+ * either a log of the MQTT messages published by the client, one message per
+ * line (as produced by `mosquitto_sub -v`, see the files in data/), or a
+ * binary trace converted by tools/trace-convert.py. The file is mapped in
+ * memory and parsed one record at a time, and it is replayed in a loop.
+ *
+ * The trace file is MOVEMENT_TRACE_FILE, unless the MOVEMENT_TRACE
+ * environment variable is set.
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define READING_ERROR             ((int)0x80000000)
+
+/* Replay speed relative to the timestamps in the trace. If zero, every
+ * reading returns the next records in the trace, regardless of time. */
+#ifdef MOVEMENT_CONF_TRACE_SPEED
+#define MOVEMENT_TRACE_SPEED MOVEMENT_CONF_TRACE_SPEED
+#else
+#define MOVEMENT_TRACE_SPEED 0
+#endif
+
+/* Time between two records, in ms, for traces without uptime */
+#ifdef MOVEMENT_CONF_TRACE_PERIOD_MS
+#define MOVEMENT_TRACE_PERIOD_MS MOVEMENT_CONF_TRACE_PERIOD_MS
+#else
+#define MOVEMENT_TRACE_PERIOD_MS 500
+#endif
+
+/* Binary trace format: a magic string followed by fixed size records
+ * (little endian): uint32 uptime in ms, int16 x, y, z, uint16 reserved */
+#define TRACE_BIN_MAGIC           "MVTRACE1"
+#define TRACE_BIN_MAGIC_LEN       8
+#define TRACE_BIN_RECORD_LEN      12
+
+
+/** A record of the trace. */
+typedef struct {
+  /** The acceleration values. */
+  int acc[3];
+  /** The time of the record in ms since the start of the replay. */
+  uint32_t t;
+} trace_record_t;
+
+/** The state of the trace being replayed. */
+static struct {
+  /** The contents of the trace file, or NULL if not opened yet. */
+  const char *data;
+  /** The length of the trace file. */
+  size_t len;
+  /** The offset of the first record. */
+  size_t start;
+  /** The offset of the record after next. */
+  size_t pos;
+  /** 1 if the trace is in the binary format. */
+  int binary;
+  /** The next record to be replayed. */
+  trace_record_t next;
+  /** The uptime of the last record parsed, as found in the file. */
+  uint32_t last_uptime;
+  /** Clock time at the start of the replay. */
+  clock_time_t t_start;
+} trace;
+
+
+process_event_t fakesens_event = PROCESS_EVENT_NONE;
+
+
+int movement_ready(process_event_t ev, process_data_t data)
+{
+  return ev == fakesens_event;
+}
+
+
+void init_movement_reading(void)
+{
+  if (fakesens_event == PROCESS_EVENT_NONE) {
+    fakesens_event = process_alloc_event();
+  }
+  process_post(PROCESS_BROADCAST, fakesens_event, NULL);
+}
+
+
+/** Finds a string in a memory region.
+ * @returns A pointer to the first character after the string found,
+ *          or NULL if the string does not occur in the region. */
+static const char *trace_find(const char *p, const char *end, const char *s)
+{
+  size_t len = strlen(s);
+  for (; p + len <= end; p++) {
+    if (memcmp(p, s, len) == 0)
+      return p + len;
+  }
+  return NULL;
+}
+
+
+/** Parses the next integer in a memory region, skipping any character
+ * before it.
+ * @returns 1 if an integer was found, 0 otherwise. */
+static int trace_parse_int(const char **p, const char *end, int32_t *out)
+{
+  while (*p < end && **p != '-' && (**p < '0' || **p > '9'))
+    (*p)++;
+  if (*p == end)
+    return 0;
+
+  int neg = **p == '-';
+  if (neg)
+    (*p)++;
+  int32_t v = 0;
+  while (*p < end && **p >= '0' && **p <= '9') {
+    v = v * 10 + (**p - '0');
+    (*p)++;
+  }
+  *out = neg ? -v : v;
+  return 1;
+}
+
+
+/** Parses the record at trace.pos.
+ * @param uptime On return, the uptime of the record in ms, or UINT32_MAX
+ *               if the record has no uptime.
+ * @returns 1 if a record was read, 0 at the end of the trace. */
+static int trace_parse(int acc[3], uint32_t *uptime)
+{
+  const char *end = trace.data + trace.len;
+
+  if (trace.binary) {
+    if (trace.pos + TRACE_BIN_RECORD_LEN > trace.len)
+      return 0;
+    const uint8_t *r = (const uint8_t *)trace.data + trace.pos;
+    *uptime = r[0] | (r[1] << 8) | (r[2] << 16) | ((uint32_t)r[3] << 24);
+    for (int i=0; i<3; i++)
+      acc[i] = (int16_t)(r[4+2*i] | (r[5+2*i] << 8));
+    trace.pos += TRACE_BIN_RECORD_LEN;
+    return 1;
+  }
+
+  while (trace.pos < trace.len) {
+    const char *line = trace.data + trace.pos;
+    const char *eol = memchr(line, '\n', end - line);
+    if (eol == NULL)
+      eol = end;
+    trace.pos = eol - trace.data + 1;
+
+    const char *p = trace_find(line, eol, "\"last_accel\":");
+    int32_t v[3];
+    if (p == NULL || !trace_parse_int(&p, eol, &v[0]) ||
+        !trace_parse_int(&p, eol, &v[1]) || !trace_parse_int(&p, eol, &v[2]))
+      continue;
+    acc[0] = v[0];
+    acc[1] = v[1];
+    acc[2] = v[2];
+
+    *uptime = UINT32_MAX;
+    p = trace_find(line, eol, "\"uptime\":");
+    int32_t secs;
+    if (p != NULL && trace_parse_int(&p, eol, &secs)) {
+      uint32_t ms = 0, scale = 100;
+      if (p < eol && *p == '.') {
+        for (p++; p < eol && *p >= '0' && *p <= '9'; p++) {
+          ms += (*p - '0') * scale;
+          scale /= 10;
+        }
+      }
+      *uptime = secs * 1000 + ms;
+    }
+    return 1;
+  }
+  return 0;
+}
+
+
+/** Loads the next record to be replayed into trace.next, going back to the
+ * beginning of the trace when it ends.
+ * @returns 1 on success, 0 if the trace contains no records. */
+static int trace_advance(void)
+{
+  uint32_t uptime;
+  if (!trace_parse(trace.next.acc, &uptime)) {
+    LOG_INFO("trace replay restarted\n");
+    trace.pos = trace.start;
+    if (!trace_parse(trace.next.acc, &uptime))
+      return 0;
+  }
+
+  /* Keep the replay time monotonic when the trace restarts or the uptime
+   * jumps back (because the device was rebooted while recording) */
+  uint32_t dt = MOVEMENT_TRACE_PERIOD_MS;
+  if (uptime != UINT32_MAX && trace.last_uptime != UINT32_MAX &&
+      uptime > trace.last_uptime)
+    dt = uptime - trace.last_uptime;
+  trace.last_uptime = uptime;
+  trace.next.t += dt;
+  return 1;
+}
+
+
+/** Maps the trace file in memory and loads its first record.
+ * @returns 1 on success, 0 on failure. */
+static int trace_open(void)
+{
+  const char *path = getenv("MOVEMENT_TRACE");
+  if (path == NULL)
+    path = MOVEMENT_TRACE_FILE;
+
+  struct stat st;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+    LOG_ERR("cannot open trace %s\n", path);
+    if (fd >= 0)
+      close(fd);
+    return 0;
+  }
+
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    LOG_ERR("cannot map trace %s\n", path);
+    return 0;
+  }
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+  trace.data = data;
+  trace.len = st.st_size;
+  trace.binary = trace.len >= TRACE_BIN_MAGIC_LEN &&
+                 memcmp(data, TRACE_BIN_MAGIC, TRACE_BIN_MAGIC_LEN) == 0;
+  trace.start = trace.pos = trace.binary ? TRACE_BIN_MAGIC_LEN : 0;
+  trace.last_uptime = UINT32_MAX;
+  trace.next.t = 0;
+  trace.t_start = clock_time();
+
+  if (!trace_advance()) {
+    LOG_ERR("no records in trace %s\n", path);
+    munmap(data, st.st_size);
+    trace.data = NULL;
+    return 0;
+  }
+  trace.next.t = 0;
+
+  LOG_INFO("replaying %s trace %s\n", trace.binary ? "binary" : "text", path);
+  return 1;
+}
+
+
+int platform_get_movement_batch(int batch[][3], int max)
+{
+  static int last[3];
+
+  movement_read_retries = 0;
+  if (trace.data == NULL && !trace_open()) {
+    movement_read_retries = MOVEMENT_READ_ATTEMPTS;
+    batch[0][LAST_ACC_X] = READING_ERROR;
+    batch[0][LAST_ACC_Y] = READING_ERROR;
+    batch[0][LAST_ACC_Z] = READING_ERROR;
+    return 1;
+  }
+
+  /* Replay all records whose time has come, but return only the most
+   * recent ones, as a real accelerometer FIFO would */
+  uint32_t now = UINT32_MAX;
+  #if MOVEMENT_TRACE_SPEED > 0
+  now = (uint32_t)((uint64_t)(clock_time() - trace.t_start) * 1000 *
+                   MOVEMENT_TRACE_SPEED / CLOCK_SECOND);
+  #endif
+
+  int n = 0;
+  while ((MOVEMENT_TRACE_SPEED == 0 && n < max) ||
+         (MOVEMENT_TRACE_SPEED > 0 && trace.next.t <= now)) {
+    memcpy(last, trace.next.acc, sizeof(last));
+    if (n == max) {
+      memmove(batch[0], batch[1], sizeof(batch[0]) * (max - 1));
+      n--;
+    }
+    memcpy(batch[n++], trace.next.acc, sizeof(batch[0]));
+    trace_advance();
+  }
+
+  if (n == 0) {
+    /* No new records yet: the acceleration did not change */
+    memcpy(batch[n++], last, sizeof(batch[0]));
+  }
+  return n;
+}
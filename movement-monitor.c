@@ -0,0 +1,89 @@
+/** @file
+ * @brief Movement state decision implementation
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#include "contiki.h"
+#include "sys/log.h"
+#include "movement-monitor.h"
+
+
+#define LOG_MODULE "Mvmt Monitor"
+#ifdef LOG_CONF_LEVEL_MOVEMENT_MONITOR
+#define LOG_LEVEL  LOG_CONF_LEVEL_MOVEMENT_MONITOR
+#else
+#define LOG_LEVEL  LOG_LEVEL_ERR
+#endif
+
+
+/** Resets the reading period to the minimum.
+ * @note Must be called when the movement state changes. */
+static void period_reset(movement_monitor_t *m,
+                         const movement_monitor_params_t *p)
+{
+  m->period = p->period;
+  m->readings = 0;
+}
+
+
+/** Updates the reading period after a reading which did not change the
+ * movement state.
+ *
+ * The period is doubled every MOVEMENT_BACKOFF_READINGS readings, up to
+ * the maximum period for the current movement state. */
+static void period_backoff(movement_monitor_t *m,
+                           const movement_monitor_params_t *p)
+{
+  /* Never shorter than the period set remotely */
+  clock_time_t max = MAX(p->period,
+                         m->is_moving ? MOVEMENT_PERIOD_MAX_MOVING :
+                                        MOVEMENT_PERIOD_MAX_STILL);
+
+  if (++m->readings >= MOVEMENT_BACKOFF_READINGS) {
+    m->readings = 0;
+    m->period = MIN(m->period * 2, max);
+    LOG_INFO("movement reading period is now %lu ticks\n",
+             (unsigned long)m->period);
+  }
+}
+
+
+void movement_monitor_init(movement_monitor_t *m,
+                           const movement_monitor_params_t *p)
+{
+  movement_features_init(&m->features);
+  m->is_moving = 1;
+  period_reset(m, p);
+}
+
+
+movement_monitor_change_t movement_monitor_update(movement_monitor_t *m,
+    const movement_monitor_params_t *p, int batch[][3], int n,
+    clock_time_t *next_wake)
+{
+  for (int i=0; i<n; i++) {
+    movement_features_add(&m->features, batch[i]);
+  }
+
+  /* A failed reading is considered as movement */
+  int moving_rn = n < 0 ||
+                  movement_features_exceed(&m->features, p->t_mod, p->t_dmod,
+                                           T_SMA, T_TILT);
+
+  if (!m->is_moving && moving_rn) {
+    m->is_moving = 1;
+    period_reset(m, p);
+    *next_wake = m->period;
+    return MOVEMENT_MONITOR_STARTED;
+  }
+  if (m->is_moving && !moving_rn) {
+    m->is_moving = 0;
+    period_reset(m, p);
+    *next_wake = p->g;
+    return MOVEMENT_MONITOR_STOPPED;
+  }
+  period_backoff(m, p);
+  *next_wake = m->period;
+  return MOVEMENT_MONITOR_NO_CHANGE;
+}
@@ -0,0 +1,77 @@
+/** @file
+ * @brief Movement state decision
+ *
+ * Decides, after each reading of the accelerometer, whether the device has
+ * started or stopped moving, and when the accelerometer must be read next:
+ * the reading period is doubled every MOVEMENT_BACKOFF_READINGS readings
+ * without a change of state, up to MOVEMENT_PERIOD_MAX_MOVING or
+ * MOVEMENT_PERIOD_MAX_STILL, and the first reading after a stop is delayed
+ * by G.
+ *
+ * This is the decision taken by movement_monitor_process, kept apart from
+ * the process so that the parameter sweep in tools/sweep replays exactly
+ * the same logic over recorded traces.
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#ifndef _MOVEMENT_MONITOR_H_
+#define _MOVEMENT_MONITOR_H_
+
+#include "contiki.h"
+#include "movement-features.h"
+
+
+/** The parameters of the decision, which may be changed remotely. */
+typedef struct {
+  /** Threshold of the mean absolute deviation from the gravity. */
+  int32_t t_mod;
+  /** Threshold of the standard deviation from the gravity. */
+  int32_t t_dmod;
+  /** The minimum reading period, in clock ticks. */
+  clock_time_t period;
+  /** The time between a stop and the next reading, in clock ticks. */
+  clock_time_t g;
+} movement_monitor_params_t;
+
+/** The state of the decision. */
+typedef struct {
+  /** The features of the last readings. */
+  movement_features_t features;
+  /** The current reading period, in clock ticks. */
+  clock_time_t period;
+  /** The number of readings since the last change of period. */
+  uint8_t readings;
+  /** Whether the device is moving. */
+  uint8_t is_moving;
+} movement_monitor_t;
+
+/** The outcome of a reading. */
+typedef enum {
+  MOVEMENT_MONITOR_NO_CHANGE = 0,
+  MOVEMENT_MONITOR_STARTED,
+  MOVEMENT_MONITOR_STOPPED
+} movement_monitor_change_t;
+
+
+/** Initializes the decision. The device is assumed to be moving.
+ * @param m The state of the decision.
+ * @param p The parameters. */
+void movement_monitor_init(movement_monitor_t *m,
+                           const movement_monitor_params_t *p);
+
+/** Adds the samples of a reading and decides the movement state.
+ * @param m         The state of the decision.
+ * @param p         The parameters.
+ * @param batch     The samples read, scaled like last_acc.
+ * @param n         The number of samples, or -1 if the reading failed. A
+ *                  failed reading is considered as movement.
+ * @param next_wake On return, the time until the next reading, in clock
+ *                  ticks.
+ * @returns Whether the device has started or stopped moving. */
+movement_monitor_change_t movement_monitor_update(movement_monitor_t *m,
+    const movement_monitor_params_t *p, int batch[][3], int n,
+    clock_time_t *next_wake);
+
+
+#endif
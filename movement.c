@@ -19,38 +19,73 @@
 
 
 int last_acc[3];
+int movement_batch[MOVEMENT_BATCH_SIZE][3];
+int movement_read_retries;
 
-/** Updates last_acc[] with the accelerometer readings; then turn off the
- * accelerometer. */
-void platform_get_movement(void);
+/** Reads the acceleration samples buffered by the accelerometer; then turns 
+ * off the accelerometer if MOVEMENT_BATCH_SIZE is 1. Also updates 
+ * movement_read_retries.
+ * @param batch The array where the samples are stored, oldest first.
+ * @param max   The maximum number of samples to be read. If more samples are
+ *              available, only the most recent ones are returned.
+ * @returns The number of samples stored in batch. */
+int platform_get_movement_batch(int batch[][3], int max);
 
 
 /* Each platform-dependent implementation must:
  *  - implement init_movement_reading()
  *  - implement movement_ready()
- *  - implement platform_get_movement() 
+ *  - implement platform_get_movement_batch() 
  *  - define the value of READING_ERROR */
  
 #if BOARD_SENSORTAG
 #include "movement-impl-cc2650sensortag.h"
+#elif defined(CONTIKI_TARGET_NATIVE) && defined(MOVEMENT_TRACE_FILE)
+#include "movement-impl-trace.h"
 #else
 #include "movement-impl-simulator.h"
 #endif
 
 
-int get_movement()
+int get_movement_batch(int *mods)
 {
-  platform_get_movement();
-  
-  if (last_acc[LAST_ACC_X] == READING_ERROR || 
-      last_acc[LAST_ACC_Y] == READING_ERROR || 
-      last_acc[LAST_ACC_Z] == READING_ERROR) {
+  int n = platform_get_movement_batch(movement_batch, MOVEMENT_BATCH_SIZE);
+  if (n <= 0)
     return -1;
+  
+  last_acc[LAST_ACC_X] = movement_batch[n-1][LAST_ACC_X];
+  last_acc[LAST_ACC_Y] = movement_batch[n-1][LAST_ACC_Y];
+  last_acc[LAST_ACC_Z] = movement_batch[n-1][LAST_ACC_Z];
+  
+  for (int i=0; i<n; i++) {
+    int *acc = movement_batch[i];
+    if (acc[LAST_ACC_X] == READING_ERROR || 
+        acc[LAST_ACC_Y] == READING_ERROR || 
+        acc[LAST_ACC_Z] == READING_ERROR) {
+      return -1;
+    }
+    
+    mods[i] = acc[LAST_ACC_X]*acc[LAST_ACC_X] + 
+              acc[LAST_ACC_Y]*acc[LAST_ACC_Y] + 
+              acc[LAST_ACC_Z]*acc[LAST_ACC_Z];
   }
   
-  return last_acc[LAST_ACC_X]*last_acc[LAST_ACC_X] + 
-         last_acc[LAST_ACC_Y]*last_acc[LAST_ACC_Y] + 
-         last_acc[LAST_ACC_Z]*last_acc[LAST_ACC_Z];
+  return n;
 }
 
 
+int get_movement()
+{
+  int mods[MOVEMENT_BATCH_SIZE];
+  int n = get_movement_batch(mods);
+  if (n < 0)
+    return -1;
+  
+  int res = -1;
+  for (int i=0; i<n; i++) {
+    if (res < 0 || ABS(mods[i] - GRAVITY*GRAVITY) > ABS(res - GRAVITY*GRAVITY))
+      res = mods[i];
+  }
+  return res;
+}
+
@@ -29,6 +29,31 @@ extern int last_acc[3];
  * Sets the scale of the values in last_acc and returned by get_movement(). */
 #define GRAVITY 100
 
+/** The maximum number of acceleration samples read at each wake.
+ *
+ * When greater than 1, the accelerometer keeps sampling at a low rate between
+ * readings and get_movement_batch() drains all the buffered samples at once. */
+#ifdef MOVEMENT_CONF_BATCH_SIZE
+#define MOVEMENT_BATCH_SIZE MOVEMENT_CONF_BATCH_SIZE
+#else
+#define MOVEMENT_BATCH_SIZE 1
+#endif
+
+/** Acceleration values read by the last call to get_movement_batch(), 
+ * oldest first. */
+extern int movement_batch[MOVEMENT_BATCH_SIZE][3];
+
+/** The maximum number of attempts made to read the accelerometer, shared by 
+ * all the axes of a reading. */
+#ifdef MOVEMENT_CONF_READ_ATTEMPTS
+#define MOVEMENT_READ_ATTEMPTS MOVEMENT_CONF_READ_ATTEMPTS
+#else
+#define MOVEMENT_READ_ATTEMPTS 5
+#endif
+
+/** The number of failed attempts made by the last call to 
+ * get_movement_batch(). If it is MOVEMENT_READ_ATTEMPTS, the reading failed. */
+extern int movement_read_retries;
 
 /** Inits the movement sensor.
  * 
@@ -45,15 +70,29 @@ void init_movement_reading(void);
  *          accessed (in other words, get_movement() can be called). */
 int movement_ready(process_event_t ev, process_data_t data);
 
+/** Gets all the acceleration samples available from the accelerometer.
+ * @param mods  Array of at least MOVEMENT_BATCH_SIZE elements. On return,
+ *              contains the modulo squared of each acceleration vector read,
+ *              oldest first.
+ * @returns The number of samples read (at least 1), or -1 if an error
+ *          occurred.
+ * @note    This function also updates movement_batch with the samples read,
+ *          and last_acc with the most recent one. If get_movement_batch()
+ *          returns -1, the values in last_acc are undefined.
+ * @warning If MOVEMENT_BATCH_SIZE is 1, this function turns off the 
+ *          accelerator before returning. In any case, to read it again, you 
+ *          must call init_movement_reading() and wait for the readiness 
+ *          events with movement_ready() again. */
+int get_movement_batch(int *mods);
+
 /** Gets the movement reading as a single value.
- * @returns The modulo squared of the acceleration vector read from the 
- *          accelerometer, or -1 if an error occurred.
+ * @returns The modulo squared of the acceleration vector which deviates the
+ *          most from GRAVITY among those read by get_movement_batch(), or -1
+ *          if an error occurred.
  * @note    This function also updates last_acc with the acceleration values
  *          read from the sensor. If get_movement() returns -1, the values in
  *          last_acc are undefined.
- * @warning This function turns off the accelerator before returning. Thus,
- *          to read it again, you must call init_movement_reading() and
- *          wait for the readiness events with movement_ready() again. */
+ * @warning Same as get_movement_batch(). */
 int get_movement();
 
 
@@ -0,0 +1,310 @@
+/** @file
+ * @brief Minimal MQTT-SN Client implementation
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#include <string.h>
+#include "contiki.h"
+#include "net/ipv6/uiplib.h"
+#include "sys/log.h"
+#include "mqtt-sn.h"
+
+
+#define LOG_MODULE "MQTT-SN"
+#ifdef LOG_CONF_LEVEL_MQTT_SN
+#define LOG_LEVEL  LOG_CONF_LEVEL_MQTT_SN
+#else
+#define LOG_LEVEL  LOG_LEVEL_ERR
+#endif
+
+
+/* Message types */
+#define MSG_CONNECT     0x04
+#define MSG_CONNACK     0x05
+#define MSG_PUBLISH     0x0C
+#define MSG_PUBACK      0x0D
+#define MSG_DISCONNECT  0x18
+
+/* Flags */
+#define FLAG_DUP            0x80
+#define FLAG_QOS_0          0x00
+#define FLAG_QOS_1          0x20
+#define FLAG_QOS_M1         0x60
+#define FLAG_CLEAN_SESSION  0x04
+
+#define PROTOCOL_ID         0x01
+#define RC_ACCEPTED         0x00
+
+
+/** Posted to the application process after each callback. */
+static process_event_t mqtt_sn_update_event = PROCESS_EVENT_NONE;
+
+
+/** Sends the current message, and arms the timer for the next retry. */
+static void send_out_packet(struct mqtt_sn_connection *conn);
+
+
+/** Notifies an event to the application, then wakes up its process. */
+static void notify(struct mqtt_sn_connection *conn, mqtt_sn_event_t event)
+{
+  PROCESS_CONTEXT_BEGIN(conn->app_process);
+  conn->event_callback(conn, event);
+  PROCESS_CONTEXT_END(conn->app_process);
+  process_post(conn->app_process, mqtt_sn_update_event, NULL);
+}
+
+
+/** Forgets the current message. */
+static void clear_out_packet(struct mqtt_sn_connection *conn)
+{
+  ctimer_stop(&conn->timer);
+  conn->out_packet = NULL;
+  conn->out_ack = 0;
+}
+
+
+/** Drops the connection and notifies the application. */
+static void connection_lost(struct mqtt_sn_connection *conn)
+{
+  clear_out_packet(conn);
+  conn->state = MQTT_SN_STATE_NOT_CONNECTED;
+  notify(conn, MQTT_SN_EVENT_DISCONNECTED);
+}
+
+
+/** Called when the current message has not been acknowledged in time, or
+ * when a message which is not acknowledged has been sent. */
+static void out_timeout(void *ptr)
+{
+  struct mqtt_sn_connection *conn = ptr;
+
+  if (conn->out_ack == 0) {
+    clear_out_packet(conn);
+    notify(conn, MQTT_SN_EVENT_PUBLISHED);
+    return;
+  }
+
+  /* A lost DISCONNECT only delays the cleanup of the gateway */
+  if (conn->out_ack != MSG_DISCONNECT &&
+      conn->out_retries++ < MQTT_SN_MAX_RETRIES) {
+    LOG_INFO("no answer, retry %d\n", conn->out_retries);
+    if (conn->out_ack == MSG_PUBACK) {
+      /* Flags of a PUBLISH, after a 1 or 3 bytes long length */
+      conn->out_packet[conn->out_packet[0] == 0x01 ? 4 : 2] |= FLAG_DUP;
+    }
+    send_out_packet(conn);
+    return;
+  }
+
+  if (conn->out_ack != MSG_DISCONNECT)
+    LOG_WARN("no answer from the gateway\n");
+  connection_lost(conn);
+}
+
+
+static void send_out_packet(struct mqtt_sn_connection *conn)
+{
+  simple_udp_sendto_port(&conn->udp, conn->out_packet, conn->out_len,
+                         &conn->gateway, conn->gateway_port);
+  ctimer_set(&conn->timer, conn->out_ack ? MQTT_SN_RETRY_TIMEOUT :
+             MQTT_SN_SEND_DELAY, out_timeout, conn);
+}
+
+
+/** Starts sending a message.
+ * @param ack The type of the message expected in reply, or 0. */
+static void start_out_packet(struct mqtt_sn_connection *conn, uint8_t *packet,
+                             uint16_t len, uint8_t ack)
+{
+  conn->out_packet = packet;
+  conn->out_len = len;
+  conn->out_ack = ack;
+  conn->out_retries = 0;
+  send_out_packet(conn);
+}
+
+
+/** Handles a message received from the gateway. */
+static void receive(struct simple_udp_connection *c,
+                    const uip_ipaddr_t *sender_addr, uint16_t sender_port,
+                    const uip_ipaddr_t *receiver_addr, uint16_t receiver_port,
+                    const uint8_t *data, uint16_t datalen)
+{
+  struct mqtt_sn_connection *conn = (struct mqtt_sn_connection *)c;
+
+  /* The length is either 1 or 3 bytes long */
+  uint16_t len = datalen > 0 ? data[0] : 0;
+  if (len == 0x01 && datalen >= 3) {
+    len = (data[1] << 8) | data[2];
+    data += 2;
+    datalen -= 2;
+    len -= 2;
+  }
+  if (len < 2 || len > datalen) {
+    LOG_WARN("malformed message received\n");
+    return;
+  }
+
+  uint8_t type = data[1];
+  LOG_DBG("received message type 0x%02x\n", type);
+
+  switch (type) {
+    case MSG_CONNACK:
+      if (conn->out_ack != MSG_CONNACK || len < 3)
+        break;
+      clear_out_packet(conn);
+      if (data[2] != RC_ACCEPTED) {
+        LOG_WARN("connection refused (code %d)\n", data[2]);
+        connection_lost(conn);
+        break;
+      }
+      conn->state = MQTT_SN_STATE_CONNECTED;
+      notify(conn, MQTT_SN_EVENT_CONNECTED);
+      break;
+
+    case MSG_PUBACK:
+      if (conn->out_ack != MSG_PUBACK || len < 7 ||
+          ((data[4] << 8) | data[5]) != conn->msg_id)
+        break;
+      clear_out_packet(conn);
+      if (data[6] != RC_ACCEPTED) {
+        /* Typically the gateway does not know us, or the topic id */
+        LOG_WARN("message rejected (code %d)\n", data[6]);
+        connection_lost(conn);
+        break;
+      }
+      notify(conn, MQTT_SN_EVENT_PUBLISHED);
+      break;
+
+    case MSG_DISCONNECT:
+      if (conn->state == MQTT_SN_STATE_NOT_CONNECTED)
+        break;
+      if (conn->state != MQTT_SN_STATE_DISCONNECTING)
+        LOG_WARN("disconnected by the gateway\n");
+      connection_lost(conn);
+      break;
+
+    default:
+      LOG_DBG("unhandled message type 0x%02x\n", type);
+      break;
+  }
+}
+
+
+mqtt_sn_status_t mqtt_sn_register(struct mqtt_sn_connection *conn,
+                                  const char *host, uint16_t port,
+                                  const char *client_id,
+                                  mqtt_sn_event_callback_t cb)
+{
+  if (mqtt_sn_update_event == PROCESS_EVENT_NONE)
+    mqtt_sn_update_event = process_alloc_event();
+  memset(conn, 0, sizeof(struct mqtt_sn_connection));
+  if (strlen(client_id) > MQTT_SN_MAX_CLIENT_ID_LEN ||
+      !uiplib_ipaddrconv(host, &conn->gateway))
+    return MQTT_SN_STATUS_INVALID_ARGS_ERROR;
+
+  conn->gateway_port = port;
+  conn->client_id = client_id;
+  conn->app_process = PROCESS_CURRENT();
+  conn->event_callback = cb;
+  conn->state = MQTT_SN_STATE_NOT_CONNECTED;
+  simple_udp_register(&conn->udp, MQTT_SN_LOCAL_PORT, NULL, port, receive);
+  return MQTT_SN_STATUS_OK;
+}
+
+
+mqtt_sn_status_t mqtt_sn_connect(struct mqtt_sn_connection *conn,
+                                 uint16_t keep_alive, uint8_t clean_session)
+{
+  if (conn->state == MQTT_SN_STATE_CONNECTED)
+    return MQTT_SN_STATUS_OK;
+  if (conn->out_packet != NULL)
+    return MQTT_SN_STATUS_BUSY;
+
+  uint8_t *p = conn->ctrl_buffer;
+  size_t id_len = strlen(conn->client_id);
+  p[0] = 6 + id_len;
+  p[1] = MSG_CONNECT;
+  p[2] = clean_session ? FLAG_CLEAN_SESSION : 0;
+  p[3] = PROTOCOL_ID;
+  p[4] = keep_alive >> 8;
+  p[5] = keep_alive;
+  memcpy(p + 6, conn->client_id, id_len);
+
+  LOG_INFO("connecting\n");
+  conn->state = MQTT_SN_STATE_CONNECTING;
+  start_out_packet(conn, p, p[0], MSG_CONNACK);
+  return MQTT_SN_STATUS_OK;
+}
+
+
+void mqtt_sn_disconnect(struct mqtt_sn_connection *conn)
+{
+  if (conn->state == MQTT_SN_STATE_NOT_CONNECTED)
+    return;
+  if (conn->state != MQTT_SN_STATE_CONNECTED) {
+    /* There is no session to close yet, or it is being closed already */
+    LOG_INFO("connection abandoned\n");
+    connection_lost(conn);
+    return;
+  }
+
+  /* Abandon any message being sent */
+  clear_out_packet(conn);
+
+  uint8_t *p = conn->ctrl_buffer;
+  p[0] = 2;
+  p[1] = MSG_DISCONNECT;
+
+  LOG_INFO("disconnecting\n");
+  conn->state = MQTT_SN_STATE_DISCONNECTING;
+  start_out_packet(conn, p, 2, MSG_DISCONNECT);
+}
+
+
+mqtt_sn_status_t mqtt_sn_publish(struct mqtt_sn_connection *conn,
+                                 uint16_t topic_id, uint8_t topic_type,
+                                 uint8_t *buf, uint16_t len, int8_t qos)
+{
+  if (qos != MQTT_SN_QOS_LEVEL_M1 && !mqtt_sn_connected(conn))
+    return MQTT_SN_STATUS_NOT_CONNECTED_ERROR;
+  if (conn->out_packet != NULL)
+    return MQTT_SN_STATUS_BUSY;
+  if (topic_type == MQTT_SN_TOPIC_TYPE_NORMAL ||
+      len > 0xFFFF - MQTT_SN_PUBLISH_HEADROOM)
+    return MQTT_SN_STATUS_INVALID_ARGS_ERROR;
+
+  uint16_t msg_id = 0;
+  if (qos == MQTT_SN_QOS_LEVEL_1) {
+    if (++conn->msg_id == 0)
+      conn->msg_id = 1;
+    msg_id = conn->msg_id;
+  }
+
+  /* The header is placed right before the payload, so its start depends on
+   * the size of the length field */
+  uint16_t total = len + 7;
+  uint8_t *p;
+  if (total <= 0xFF) {
+    p = buf + MQTT_SN_PUBLISH_HEADROOM - 7;
+    p[0] = total;
+  } else {
+    total += 2;
+    p = buf;
+    p[0] = 0x01;
+    p[1] = total >> 8;
+    p[2] = total;
+  }
+  uint8_t *h = buf + MQTT_SN_PUBLISH_HEADROOM - 6;
+  h[0] = MSG_PUBLISH;
+  h[1] = topic_type | (qos == MQTT_SN_QOS_LEVEL_1 ? FLAG_QOS_1 :
+                       (qos == MQTT_SN_QOS_LEVEL_0 ? FLAG_QOS_0 : FLAG_QOS_M1));
+  h[2] = topic_id >> 8;
+  h[3] = topic_id;
+  h[4] = msg_id >> 8;
+  h[5] = msg_id;
+
+  start_out_packet(conn, p, total, qos == MQTT_SN_QOS_LEVEL_1 ? MSG_PUBACK : 0);
+  return MQTT_SN_STATUS_OK;
+}
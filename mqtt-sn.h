@@ -0,0 +1,194 @@
+/** @file
+ * @brief Minimal MQTT-SN Client
+ *
+ * Implements the subset of MQTT-SN v1.2 needed to publish messages over UDP
+ * to a gateway: CONNECT, DISCONNECT, and PUBLISH with QoS -1, 0 and 1 on
+ * predefined or short topic ids, which require no REGISTER exchange.
+ * Messages sent with QoS -1 do not require a connection.
+ *
+ * The API mimics the one of the Contiki-NG MQTT client: the application is
+ * notified of the completion of each operation through a callback, after
+ * which its process is always woken up with a generic event, and the
+ * payload of a message published must stay valid until the message has been
+ * acknowledged (QoS 1) or sent (QoS -1 and 0).
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#ifndef _MQTT_SN_H_
+#define _MQTT_SN_H_
+
+#include "contiki.h"
+#include "net/ipv6/simple-udp.h"
+
+
+/** The local UDP port. */
+#ifdef MQTT_SN_CONF_LOCAL_PORT
+#define MQTT_SN_LOCAL_PORT MQTT_SN_CONF_LOCAL_PORT
+#else
+#define MQTT_SN_LOCAL_PORT 1885
+#endif
+
+/** Time to wait for an acknowledgement before sending a message again. */
+#ifdef MQTT_SN_CONF_RETRY_TIMEOUT
+#define MQTT_SN_RETRY_TIMEOUT MQTT_SN_CONF_RETRY_TIMEOUT
+#else
+#define MQTT_SN_RETRY_TIMEOUT (2 * CLOCK_SECOND)
+#endif
+
+/** The number of times a message is sent again before giving up. */
+#ifdef MQTT_SN_CONF_MAX_RETRIES
+#define MQTT_SN_MAX_RETRIES MQTT_SN_CONF_MAX_RETRIES
+#else
+#define MQTT_SN_MAX_RETRIES 3
+#endif
+
+/** Time given to the MAC layer to transmit a message which is not
+ * acknowledged (QoS -1 and 0) before notifying the application. */
+#ifdef MQTT_SN_CONF_SEND_DELAY
+#define MQTT_SN_SEND_DELAY MQTT_SN_CONF_SEND_DELAY
+#else
+#define MQTT_SN_SEND_DELAY (CLOCK_SECOND / 8)
+#endif
+
+/** The maximum length of a client id. */
+#define MQTT_SN_MAX_CLIENT_ID_LEN 23
+
+/** The space to reserve before the payload of a message published. */
+#define MQTT_SN_PUBLISH_HEADROOM  9
+
+
+/** The QoS levels. */
+#define MQTT_SN_QOS_LEVEL_M1  (-1)
+#define MQTT_SN_QOS_LEVEL_0   0
+#define MQTT_SN_QOS_LEVEL_1   1
+
+/** The types of topic id. */
+typedef enum {
+  /** A topic id registered with REGISTER (not supported). */
+  MQTT_SN_TOPIC_TYPE_NORMAL = 0,
+  /** A topic id known in advance by the gateway. */
+  MQTT_SN_TOPIC_TYPE_PREDEFINED = 1,
+  /** A topic name two characters long. */
+  MQTT_SN_TOPIC_TYPE_SHORT = 2
+} mqtt_sn_topic_type_t;
+
+/** The states of a connection. */
+typedef enum {
+  MQTT_SN_STATE_NOT_CONNECTED,
+  MQTT_SN_STATE_CONNECTING,
+  MQTT_SN_STATE_CONNECTED,
+  MQTT_SN_STATE_DISCONNECTING
+} mqtt_sn_state_t;
+
+/** The events notified to the application. */
+typedef enum {
+  /** The gateway accepted the connection. */
+  MQTT_SN_EVENT_CONNECTED,
+  /** The connection has been closed, refused, or lost. */
+  MQTT_SN_EVENT_DISCONNECTED,
+  /** The last message published has been acknowledged (QoS 1) or sent. */
+  MQTT_SN_EVENT_PUBLISHED
+} mqtt_sn_event_t;
+
+/** The results of the operations. */
+typedef enum {
+  MQTT_SN_STATUS_OK,
+  /** Another operation is in progress. */
+  MQTT_SN_STATUS_BUSY,
+  MQTT_SN_STATUS_NOT_CONNECTED_ERROR,
+  MQTT_SN_STATUS_INVALID_ARGS_ERROR
+} mqtt_sn_status_t;
+
+struct mqtt_sn_connection;
+typedef void (*mqtt_sn_event_callback_t)(struct mqtt_sn_connection *m,
+                                         mqtt_sn_event_t event);
+
+/** A connection to an MQTT-SN gateway. */
+struct mqtt_sn_connection {
+  /** The UDP socket. */
+  struct simple_udp_connection udp;
+  /** The address of the gateway. */
+  uip_ipaddr_t gateway;
+  /** The UDP port of the gateway. */
+  uint16_t gateway_port;
+  /** The client id. */
+  const char *client_id;
+  /** The process using the connection. */
+  struct process *app_process;
+  /** The callback notified of the events. */
+  mqtt_sn_event_callback_t event_callback;
+  /** The state of the connection. */
+  mqtt_sn_state_t state;
+  /** The message id of the last message published. */
+  uint16_t msg_id;
+  /** The message being sent, or NULL. */
+  uint8_t *out_packet;
+  /** The length of the message being sent. */
+  uint16_t out_len;
+  /** The type of the message expected in reply, or 0 for none. */
+  uint8_t out_ack;
+  /** The number of times the message being sent has been sent again. */
+  uint8_t out_retries;
+  /** The retransmission timer. */
+  struct ctimer timer;
+  /** The buffer for CONNECT and DISCONNECT messages. */
+  uint8_t ctrl_buffer[6 + MQTT_SN_MAX_CLIENT_ID_LEN];
+};
+
+
+/** Initializes a connection.
+ * @param conn      The connection.
+ * @param host      The IPv6 address of the gateway, as a string.
+ * @param port      The UDP port of the gateway.
+ * @param client_id The client id (at most MQTT_SN_MAX_CLIENT_ID_LEN
+ *                  characters long).
+ * @param cb        The callback notified of the events.
+ * @returns         MQTT_SN_STATUS_OK on success.
+ * @note  Must be called from the process which will use the connection. */
+mqtt_sn_status_t mqtt_sn_register(struct mqtt_sn_connection *conn,
+                                  const char *host, uint16_t port,
+                                  const char *client_id,
+                                  mqtt_sn_event_callback_t cb);
+
+/** Connects to the gateway. MQTT_SN_EVENT_CONNECTED is notified on success,
+ * MQTT_SN_EVENT_DISCONNECTED on failure.
+ * @param conn          The connection.
+ * @param keep_alive    The keep alive interval in seconds.
+ * @param clean_session If zero, asks the gateway to keep the session.
+ * @returns             MQTT_SN_STATUS_OK if the connection is in progress. */
+mqtt_sn_status_t mqtt_sn_connect(struct mqtt_sn_connection *conn,
+                                 uint16_t keep_alive, uint8_t clean_session);
+
+/** Closes the connection. MQTT_SN_EVENT_DISCONNECTED is notified when the
+ * gateway acknowledges it, or when it does not answer. A connection not
+ * established yet is abandoned immediately.
+ * @param conn The connection. */
+void mqtt_sn_disconnect(struct mqtt_sn_connection *conn);
+
+/** Publishes a message. MQTT_SN_EVENT_PUBLISHED is notified when the
+ * message has been acknowledged (QoS 1) or sent (QoS -1 and 0), and
+ * MQTT_SN_EVENT_DISCONNECTED if it was not acknowledged or rejected.
+ * @param conn       The connection.
+ * @param topic_id   The topic id.
+ * @param topic_type The type of topic id (predefined or short).
+ * @param buf        A buffer with the payload starting at offset
+ *                   MQTT_SN_PUBLISH_HEADROOM. The whole buffer must stay
+ *                   valid until the message has been published.
+ * @param len        The length of the payload.
+ * @param qos        The QoS level (MQTT_SN_QOS_LEVEL_*).
+ * @returns          MQTT_SN_STATUS_OK if the message is being sent. */
+mqtt_sn_status_t mqtt_sn_publish(struct mqtt_sn_connection *conn,
+                                 uint16_t topic_id, uint8_t topic_type,
+                                 uint8_t *buf, uint16_t len, int8_t qos);
+
+/** Returns whether the connection is established. */
+#define mqtt_sn_connected(conn) \
+  ((conn)->state == MQTT_SN_STATE_CONNECTED)
+
+/** Returns whether the connection is established and idle. */
+#define mqtt_sn_ready(conn) \
+  (mqtt_sn_connected(conn) && (conn)->out_packet == NULL)
+
+
+#endif
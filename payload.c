@@ -0,0 +1,249 @@
+/** @file
+ * @brief MQTT Message Payload Encoder implementation
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#include <string.h>
+#include "contiki.h"
+#include "movement.h"
+#include "payload.h"
+
+
+#if PUBLISH_FORMAT == PUBLISH_FORMAT_BINARY
+
+/** Converts a time to hundredths of second, without overflowing. */
+static uint32_t centiseconds(clock_time_t t)
+{
+  return (uint32_t)(t / CLOCK_SECOND) * 100 +
+         (uint32_t)(t % CLOCK_SECOND) * 100 / CLOCK_SECOND;
+}
+
+
+/** Saturates a value to the range of int16_t, mapping READING_ERROR to
+ * INT16_MIN. */
+static int16_t clamp16(int v)
+{
+  return v < INT16_MIN + 1 ? INT16_MIN : (v > INT16_MAX ? INT16_MAX : v);
+}
+
+
+/** Saturates a value to the range of int8_t. */
+static int8_t clamp8(int v)
+{
+  return v < INT8_MIN ? INT8_MIN : (v > INT8_MAX ? INT8_MAX : v);
+}
+
+
+/** Writes a 16 bit value in little endian order. */
+static uint8_t *put16(uint8_t *p, uint16_t v)
+{
+  p[0] = v;
+  p[1] = v >> 8;
+  return p + 2;
+}
+
+
+/** Writes a 32 bit value in little endian order. */
+static uint8_t *put32(uint8_t *p, uint32_t v)
+{
+  p = put16(p, v);
+  return put16(p, v >> 16);
+}
+
+
+int payload_encode(uint8_t *buf, int size, const payload_t *p)
+{
+  int config_len = p->config_version != 0 ? PAYLOAD_BINARY_CONFIG_LEN : 0;
+  int period_len = p->period != 0 ? PAYLOAD_BINARY_PERIOD_LEN : 0;
+  int boot_len = p->boot != 0 ? PAYLOAD_BINARY_BOOT_LEN : 0;
+  if (size < PAYLOAD_BINARY_HEADER_LEN + period_len + boot_len + config_len +
+             (PAYLOAD_BINARY_RECORD_LEN + boot_len) * p->n_records)
+    return -1;
+
+  uint8_t *q = buf;
+  *q++ = (config_len ? PAYLOAD_BINARY_VERSION_CONFIG : PAYLOAD_BINARY_VERSION) +
+          (period_len ? PAYLOAD_BINARY_VERSION_PERIOD : 0) +
+          (boot_len ? PAYLOAD_BINARY_VERSION_BOOT : 0);
+  *q++ = p->n_records;
+  memcpy(q, p->client_id, sizeof(p->client_id));
+  q += sizeof(p->client_id);
+  q = put16(q, p->seq);
+  for (int i=0; i<3; i++)
+    q = put16(q, clamp16(p->acc[i]));
+  *q++ = clamp8(p->rssi);
+  *q++ = clamp8(p->tx_power);
+  q = put32(q, centiseconds(p->uptime));
+  if (period_len) {
+    q = put16(q, MIN(p->period / CLOCK_SECOND, UINT16_MAX));
+    q = put16(q, p->battery < 0 ? 0 : MIN(p->battery, UINT16_MAX));
+  }
+  if (boot_len)
+    q = put16(q, p->boot);
+  if (config_len) {
+    q = put16(q, p->config_version);
+    *q++ = p->config_status;
+  }
+
+  #if PUBLISH_BATCHING
+  for (int i=0; i<p->n_records; i++) {
+    const publish_record_t *r = publish_queue_get(i);
+    *q++ = r->type;
+    for (int j=0; j<3; j++)
+      q = put16(q, clamp16(r->acc[j]));
+    q = put32(q, centiseconds(r->time));
+    if (boot_len)
+      q = put16(q, r->boot);
+  }
+  #endif
+  return q - buf;
+}
+
+#else
+
+/** The beginning of the payload, up to the value of seq_nr_value, which
+ * depends only on the client id and is rendered once. */
+static char prefix[sizeof("{\"client_id\":\"012345012345\",\"seq_nr_value\":")];
+/** The client id prefix was rendered for. */
+static uint8_t prefix_id[6];
+static int prefix_len;
+
+
+/** Appends a constant string.
+ * @returns The end of the string written, or NULL if it does not fit. */
+static char *put_str(char *p, char *end, const char *s, int len)
+{
+  if (p == NULL || end - p < len)
+    return NULL;
+  memcpy(p, s, len);
+  return p + len;
+}
+
+#define put_lit(p, end, s) put_str((p), (end), (s), sizeof(s) - 1)
+
+
+/** Appends an unsigned value in decimal, zero padded to min_digits. */
+static char *put_uint(char *p, char *end, unsigned long v, int min_digits)
+{
+  char tmp[3 * sizeof(unsigned long)];
+  int n = 0;
+
+  do {
+    tmp[sizeof(tmp) - ++n] = '0' + v % 10;
+    v /= 10;
+  } while (v != 0 || n < min_digits);
+  return put_str(p, end, tmp + sizeof(tmp) - n, n);
+}
+
+
+/** Appends a signed value in decimal, like "%d". */
+static char *put_int(char *p, char *end, int v)
+{
+  if (v < 0) {
+    p = put_lit(p, end, "-");
+    return put_uint(p, end, -(unsigned long)v, 1);
+  }
+  return put_uint(p, end, v, 1);
+}
+
+
+/** Appends a time in seconds with two decimals, like "%lu.%02u". */
+static char *put_time(char *p, char *end, clock_time_t t)
+{
+  p = put_uint(p, end, t / CLOCK_SECOND, 1);
+  p = put_lit(p, end, ".");
+  return put_uint(p, end, (t % CLOCK_SECOND) * 100 / CLOCK_SECOND, 2);
+}
+
+
+/** Renders the constant prefix of the payload for a client id. */
+static void render_prefix(const uint8_t *client_id)
+{
+  static const char hex[] = "0123456789abcdef";
+  char *p = prefix;
+
+  p = put_lit(p, prefix + sizeof(prefix), "{\"client_id\":\"");
+  for (int i=0; i<6; i++) {
+    *p++ = hex[client_id[i] >> 4];
+    *p++ = hex[client_id[i] & 0xF];
+  }
+  p = put_lit(p, prefix + sizeof(prefix), "\",\"seq_nr_value\":");
+  prefix_len = p - prefix;
+  memcpy(prefix_id, client_id, sizeof(prefix_id));
+}
+
+
+int payload_encode(uint8_t *buf, int size, const payload_t *p)
+{
+  if (size <= 0)
+    return -1;
+  char *s = (char *)buf;
+  /* Leave room for the terminator */
+  char *end = s + size - 1;
+
+  if (prefix_len == 0 || memcmp(prefix_id, p->client_id, 6) != 0)
+    render_prefix(p->client_id);
+
+  s = put_str(s, end, prefix, prefix_len);
+  s = put_uint(s, end, p->seq, 1);
+  s = put_lit(s, end, ",\"last_accel\":[");
+  s = put_int(s, end, p->acc[LAST_ACC_X]);
+  s = put_lit(s, end, ", ");
+  s = put_int(s, end, p->acc[LAST_ACC_Y]);
+  s = put_lit(s, end, ", ");
+  s = put_int(s, end, p->acc[LAST_ACC_Z]);
+  s = put_lit(s, end, "],\"curr_radio_rssi\":");
+  s = put_int(s, end, p->rssi);
+  s = put_lit(s, end, ",\"curr_radio_power_dbm\":");
+  s = put_int(s, end, p->tx_power);
+  s = put_lit(s, end, ",\"uptime\":");
+  s = put_time(s, end, p->uptime);
+  if (p->period != 0) {
+    s = put_lit(s, end, ",\"period\":");
+    s = put_time(s, end, p->period);
+    s = put_lit(s, end, ",\"battery\":");
+    s = put_int(s, end, p->battery);
+  }
+  if (p->boot != 0) {
+    s = put_lit(s, end, ",\"boot\":");
+    s = put_uint(s, end, p->boot, 1);
+  }
+  if (p->config_version != 0) {
+    s = put_lit(s, end, ",\"config\":[");
+    s = put_uint(s, end, p->config_version, 1);
+    s = put_lit(s, end, ",");
+    s = put_uint(s, end, p->config_status, 1);
+    s = put_lit(s, end, "]");
+  }
+
+  #if PUBLISH_BATCHING
+  if (p->n_records > 0)
+    s = put_lit(s, end, ",\"records\":[");
+  for (int i=0; i<p->n_records; i++) {
+    const publish_record_t *r = publish_queue_get(i);
+    s = i > 0 ? put_lit(s, end, ",[") : put_lit(s, end, "[");
+    s = put_time(s, end, r->time);
+    s = put_lit(s, end, ",");
+    s = put_uint(s, end, r->type, 1);
+    for (int j=0; j<3; j++) {
+      s = put_lit(s, end, ",");
+      s = put_int(s, end, r->acc[j]);
+    }
+    if (p->boot != 0) {
+      s = put_lit(s, end, ",");
+      s = put_uint(s, end, r->boot, 1);
+    }
+    s = put_lit(s, end, "]");
+  }
+  if (p->n_records > 0)
+    s = put_lit(s, end, "]");
+  #endif
+  s = put_lit(s, end, "}");
+
+  if (s == NULL)
+    return -1;
+  *s = '\0';
+  return s - (char *)buf;
+}
+
+#endif
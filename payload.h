@@ -0,0 +1,161 @@
+/** @file
+ * @brief MQTT Message Payload Encoder
+ *
+ * Encodes the contents of the messages published by the client, either as
+ * JSON text or in a compact versioned binary layout, depending on
+ * PUBLISH_FORMAT.
+ *
+ * The binary layout (version 1) is little endian and consists of a fixed
+ * header followed by the queued records, if any:
+ *
+ *   offset  size  field
+ *   0       1     version (PAYLOAD_BINARY_VERSION)
+ *   1       1     number of records
+ *   2       6     client id (the bytes printed in the JSON client_id)
+ *   8       2     sequence number
+ *   10      6     last acceleration x, y, z (int16, INT16_MIN on error)
+ *   16      1     RSSI in dBm (int8, INT8_MIN if not available)
+ *   17      1     TX power in dBm (int8, INT8_MIN if not available)
+ *   18      4     uptime in hundredths of second
+ *
+ * Each record is 11 bytes long: type (1), acceleration x, y, z (2 each) and
+ * time in hundredths of second (4). tools/payload-decode.py converts binary
+ * payloads back to the JSON messages.
+ *
+ * A message which confirms a remote configuration command (see
+ * remote-config.h) has version 2 instead, and 3 more bytes in the header,
+ * before the records:
+ *
+ *   22      2     version of the configuration confirmed
+ *   24      1     outcome of the command (remote_config_status_t)
+ *
+ * In JSON, the confirmation is the "config" array [version, outcome].
+ *
+ * When the period is adaptive (see publish-period.h), the messages report it
+ * with the battery voltage, in 4 more bytes after the uptime (before the
+ * confirmation, if any), and the version is 3, or 4 with a confirmation:
+ *
+ *   22      2     sample period in seconds
+ *   24      2     battery voltage in mV (0 if unknown)
+ *
+ * In JSON, they are the "period" (in seconds) and "battery" (in mV, -1 if
+ * unknown) fields.
+ *
+ * When the records are kept across reboots (see publish-store.h), the
+ * messages report the number of the current boot in 2 more bytes after the
+ * period, if any, 4 is added to the version, and each record is 13 bytes
+ * long, ending with the number of the boot it was created in (2), as its
+ * time is the uptime of that boot:
+ *
+ *   22      2     number of the boot
+ *
+ * In JSON, it is the "boot" field, and each record has the number of its
+ * boot as a sixth element.
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#ifndef _PAYLOAD_H_
+#define _PAYLOAD_H_
+
+#include "contiki.h"
+#include "publish-queue.h"
+#include "publish-store.h"
+
+
+/** JSON text payload. */
+#define PUBLISH_FORMAT_JSON   0
+/** Compact binary payload. */
+#define PUBLISH_FORMAT_BINARY 1
+
+/** The payload format of the messages published. */
+#ifdef PUBLISH_CONF_FORMAT
+#define PUBLISH_FORMAT PUBLISH_CONF_FORMAT
+#else
+#define PUBLISH_FORMAT PUBLISH_FORMAT_JSON
+#endif
+
+/** The version of the binary layout. */
+#define PAYLOAD_BINARY_VERSION     1
+/** The version of the binary layout with a confirmation. */
+#define PAYLOAD_BINARY_VERSION_CONFIG 2
+/** Added to the version of the binary layout when the period is reported. */
+#define PAYLOAD_BINARY_VERSION_PERIOD 2
+/** Added to the version of the binary layout when the boot is reported. */
+#define PAYLOAD_BINARY_VERSION_BOOT 4
+/** The length of the header of a binary payload. */
+#define PAYLOAD_BINARY_HEADER_LEN  22
+/** The length of the confirmation in a binary payload. */
+#define PAYLOAD_BINARY_CONFIG_LEN  3
+/** The length of the period and battery voltage in a binary payload. */
+#define PAYLOAD_BINARY_PERIOD_LEN  4
+/** The length of a record in a binary payload. */
+#define PAYLOAD_BINARY_RECORD_LEN  11
+/** The length of the boot in a binary payload, and added to each record. */
+#define PAYLOAD_BINARY_BOOT_LEN    2
+
+/** The maximum number of records in a message, as records are only sent in
+ * batches. */
+#if PUBLISH_BATCHING
+#define PAYLOAD_MAX_RECORDS PUBLISH_BATCH_SIZE
+#else
+#define PAYLOAD_MAX_RECORDS 0
+#endif
+
+/** The maximum length of a payload. */
+#if PUBLISH_FORMAT == PUBLISH_FORMAT_BINARY && PUBLISH_STORE
+#define PAYLOAD_MAX_LENGTH \
+  (PAYLOAD_BINARY_HEADER_LEN + PAYLOAD_BINARY_PERIOD_LEN + \
+   PAYLOAD_BINARY_CONFIG_LEN + PAYLOAD_BINARY_BOOT_LEN + \
+   (PAYLOAD_BINARY_RECORD_LEN + PAYLOAD_BINARY_BOOT_LEN) * PAYLOAD_MAX_RECORDS)
+#elif PUBLISH_FORMAT == PUBLISH_FORMAT_BINARY
+#define PAYLOAD_MAX_LENGTH \
+  (PAYLOAD_BINARY_HEADER_LEN + PAYLOAD_BINARY_PERIOD_LEN + \
+   PAYLOAD_BINARY_CONFIG_LEN + PAYLOAD_BINARY_RECORD_LEN * PAYLOAD_MAX_RECORDS)
+#elif PUBLISH_STORE
+#define PAYLOAD_MAX_LENGTH (256 + 48 * PAYLOAD_MAX_RECORDS)
+#else
+#define PAYLOAD_MAX_LENGTH (256 + 40 * PAYLOAD_MAX_RECORDS)
+#endif
+
+
+/** The contents of a message. */
+typedef struct {
+  /** The link address bytes which identify the client. */
+  uint8_t client_id[6];
+  /** The sequence number of the message. */
+  uint16_t seq;
+  /** The last acceleration measured, scaled like last_acc. */
+  int acc[3];
+  /** The RSSI of the radio in dBm. */
+  int rssi;
+  /** The TX power of the radio in dBm. */
+  int tx_power;
+  /** The current time. */
+  clock_time_t uptime;
+  /** The sample period, or 0 if it is not reported. */
+  clock_time_t period;
+  /** The battery voltage in mV, or -1 if unknown. */
+  int battery;
+  /** The version of the remote configuration confirmed, or 0 if none. */
+  uint16_t config_version;
+  /** The outcome of the command confirmed. */
+  uint8_t config_status;
+  /** The number of the current boot, or 0 if the boot and the boot of each
+   * record are not reported. */
+  uint16_t boot;
+  /** The number of records included, taken from the head of the publish
+   * queue, at most PAYLOAD_MAX_RECORDS. */
+  uint8_t n_records;
+} payload_t;
+
+
+/** Encodes a message payload in the PUBLISH_FORMAT format.
+ * @param buf  The output buffer.
+ * @param size The size of the output buffer.
+ * @param p    The contents of the message.
+ * @returns    The length of the payload, or -1 if the buffer is too short. */
+int payload_encode(uint8_t *buf, int size, const payload_t *p);
+
+
+#endif
@@ -28,6 +28,28 @@
 #define MQTT_AUTH_TOKEN             "AUTHZ"
 #define MQTT_SUBSCRIBE_CMD_TYPE     "+"
 
+/* MQTT-SN configuration. When MQTT_CONF_TRANSPORT_SN is 1, messages are 
+ * published with MQTT-SN over UDP to the gateway, with the predefined topic
+ * id MQTT_SN_CONF_TOPIC_ID, which the gateway must map to the topic that 
+ * would be used with MQTT. MQTT_SN_CONF_QOS can be 1, 0, or -1 to publish
+ * without connecting to the gateway at all. */
+#define MQTT_CONF_TRANSPORT_SN      0
+#define MQTT_SN_GATEWAY_IP_ADDR     MQTT_BROKER_IP_ADDR
+#define MQTT_SN_GATEWAY_PORT        1884
+#define MQTT_SN_CONF_TOPIC_ID       1
+#define MQTT_SN_CONF_QOS            1
+
+/* Remote configuration of K, G, MOVEMENT_PERIOD, T_MOD, T_DMOD and
+ * CLIENT_RADIO_POWER_CONF. The client subscribes to
+ * REMOTE_CONFIG_CONF_TOPIC_PREFIX<client id>/MQTT_SUBSCRIBE_CMD_TYPE before
+ * publishing, once per MQTT session and at most once every
+ * REMOTE_CONFIG_CONF_INTERVAL, and applies and stores in flash the retained
+ * "config" command, such as "v=2,k=30000,m=800" (see remote-config.h). The
+ * version applied is confirmed in the next message published. MQTT only. */
+#define REMOTE_CONFIG_CONF_ENABLED        (!MQTT_CONF_TRANSPORT_SN)
+#define REMOTE_CONFIG_CONF_TOPIC_PREFIX   "iot/cmd/"
+#define REMOTE_CONFIG_CONF_INTERVAL       (3600UL * CLOCK_SECOND)
+
 /* Maximum TCP segment size for outgoing segments of our socket */
 #define MAX_TCP_SEGMENT_SIZE        16
 
@@ -47,14 +69,53 @@
 #define RPL_CONF_DAO_MAX_RETRANSMISSIONS    2
 #define RPL_CONF_DAO_RETRANSMISSION_TIMEOUT (2 * CLOCK_SECOND)
 
+/* Notify the client when a RPL parent is found or lost, instead of having it
+ * poll the state of the network (see client.c) */
+#define RPL_CALLBACK_PARENT_SWITCH          client_rpl_parent_switch
+
 /* Radio power setting in dBm
  * Default is 5 dBm */
 #define CLIENT_RADIO_POWER_CONF             (0)
 
+/* Use the lowest radio power which keeps the link to the RPL parent good
+ * enough, starting from its RSSI and correcting it with its ETX and the
+ * acknowledgements of the publishes (see tx-power.h). CLIENT_RADIO_POWER_CONF
+ * is used while no parent is known. */
+#define TX_POWER_CONF_ENABLED               1
+/* Minimum RSSI of our frames at the parent, in dBm */
+#define TX_POWER_CONF_RSSI_TARGET           (-85)
+/* Maximum ETX of the parent, in tenths, before raising the power */
+#define TX_POWER_CONF_ETX_MAX               15
+
 /* Period between each channel hop when establishing a TSCH. 
  * Tweak if connection is too slow, it could make a difference. */
 #define TSCH_CONF_CHANNEL_SCAN_DURATION     (CLOCK_SECOND / 4)
 
+/* Stop TSCH (scanning, slot operation and radio) while the device is moving,
+ * and start it again from a scan when it stops. Without it, turning the MAC
+ * off has no effect with TSCH, and the radio is kept on while scanning.
+ * Off until its energy saving has been verified in Cooja with energest. */
+#define TSCH_SLEEP_CONF_ENABLED             0
+
+/* When TSCH starts scanning again, listen on the channel of the last
+ * association only, for TSCH_HINT_CONF_BUDGET, before scanning all the
+ * channels in TSCH_HINT_CONF_CHANNELS (see tsch-hint.h). Off, together with
+ * the TSCH_CONF_JOIN_HOPPING_SEQUENCE it installs, until it has been run
+ * against the tsch.c of Contiki-NG. */
+#define TSCH_HINT_CONF_ENABLED              0
+#define TSCH_HINT_CONF_BUDGET               (4 * CLOCK_SECOND)
+#define TSCH_HINT_CONF_CHANNELS             15, 25, 26, 20
+#define TSCH_HINT_CONF_CHANNELS_LEN         4
+
+#if MAC_CONF_WITH_TSCH && TSCH_HINT_CONF_ENABLED
+#define TSCH_CONF_JOIN_HOPPING_SEQUENCE     tsch_hint_join_sequence
+#define TSCH_CALLBACK_JOINING_NETWORK       tsch_hint_joined
+#ifndef __ASSEMBLER__
+#include <stdint.h>
+extern uint8_t tsch_hint_join_sequence[TSCH_HINT_CONF_CHANNELS_LEN];
+#endif
+#endif
+
 /* Enable manual duty cycling in CSMA mode. When manual duty cycling is 
  * enabled, the radio is kept on only for the duration of time needed to
  * connect to the MQTT broker and send a single message, then it is turned
@@ -65,6 +126,35 @@
  * (usually around 10 to 15 seconds with default settings). */
 #define CSMA_CONF_MANUAL_DUTY_CYCLING       1
 
+/* Keep the RPL network state (DAG, preferred parent and address) when the
+ * radio is turned off at the end of a manual duty cycle, unless the device
+ * is moving. When the radio is turned on again, the parent is probed with a
+ * unicast DIS and a DAO, instead of waiting for the discovery of the network;
+ * if it does not answer within FAST_REJOIN_CONF_TIMEOUT, the discovery is
+ * started as usual. */
+#define CLIENT_CONF_FAST_REJOIN             0
+
+/* Keep the MQTT connection open when the radio is turned off at the end of a
+ * manual duty cycle, and connect without the clean session flag. When the 
+ * radio is turned on again and the connection is still open, messages are
+ * published right away, without the TCP and MQTT handshakes. If the broker
+ * resets the connection, or does not acknowledge the first message within
+ * MQTT_CONF_RESUME_TIMEOUT, a new connection is made. The keep alive
+ * interval then covers the longest time the radio stays off while not
+ * moving (the stretched sample period, plus the stretched maximum age of a
+ * batch), and the keep alive timer is stopped while the radio is off. The
+ * broker must not close idle connections before that interval expires. */
+#define MQTT_CONF_PERSISTENT_SESSION        0
+
+/* Abandon the search of the RPL network after CLIENT_CONF_NET_SEARCH_TIMEOUT
+ * when the radio is manually duty cycled, instead of keeping the radio on
+ * until a network is found or the device moves. After each failed search, the
+ * delay before the next one is doubled, from 2 K up to
+ * K << CLIENT_CONF_NET_SEARCH_MAX_BACKOFF; it is reset by movement. Set the
+ * timeout to 0 to search without limits. */
+#define CLIENT_CONF_NET_SEARCH_TIMEOUT      (30 * CLOCK_SECOND)
+#define CLIENT_CONF_NET_SEARCH_MAX_BACKOFF  5
+
 /* Publish a MQTT every time the accelerometer is polled instead of every K
  * seconds. Note: If CSMA_CONF_MANUAL_DUTY_CYCLING == 1, the accelerometer
  * events sent while the radio stack is being turned off will be ignored. */
@@ -83,6 +173,14 @@
 #define ENERGEST_CONF_TIME_T        clock_time_t
 #define ENERGEST_CONF_SECOND        CLOCK_SECOND
 #define ENERGEST_LOG_DELAY          (60 * CLOCK_SECOND)
+/* Maximum shift of the periodic energest log, to share a wakeup with another
+ * timer (see WAKE_SCHED_CONF_ENABLED) */
+#define ENERGEST_LOG_SLACK          (10 * CLOCK_SECOND)
+
+/* Attribute the energest times (CPU, LPM, radio listen and transmit) to the
+ * states of the client state machine, and log the per-state totals in ticks
+ * with the periodic energest log. When 0, nothing is compiled in. */
+#define ENERGEST_LOG_CONF_STATES    0
 
 
 /*
@@ -96,9 +194,24 @@
  * collecting sensor data. */
 #define DISABLE_MOVEMENT_SLEEP 0
 
-/* Acceleration thresholds */
+/* Number of acceleration samples over which the motion features used to
+ * detect movement are computed (see movement-features.h) */
+#define MOVEMENT_CONF_WINDOW  4
+
+/* Motion feature thresholds. The device is moving when the mean deviation of
+ * |a|^2 from GRAVITY^2 is at least T_MOD, when its standard deviation is at
+ * least T_DMOD, or when the signal magnitude area is at least T_SMA */
 #define T_MOD   1000
 #define T_DMOD  500
+#define T_SMA   20
+
+/* If set to 1, the change of the tilt of the device between two readings is
+ * a motion feature too: the device is also moving when its mean over the
+ * feature window is at least T_TILT hundredths of degree. This catches
+ * rotations which keep |a| close to GRAVITY, while a single rotation of less
+ * than MOVEMENT_CONF_WINDOW * T_TILT is ignored, like any other noise */
+#define MOVEMENT_TILT_TRIGGER 0
+#define T_TILT  1500
 
 /* Movement reading period */
 #ifdef CONTIKI_TARGET_NATIVE
@@ -107,12 +220,136 @@
 #define MOVEMENT_PERIOD (3 * CLOCK_SECOND)
 #endif
 
+/* Adaptive movement reading period. After MOVEMENT_BACKOFF_READINGS 
+ * consecutive readings without any change of the movement state, the reading
+ * period is doubled, up to MOVEMENT_PERIOD_MAX_MOVING while moving and
+ * MOVEMENT_PERIOD_MAX_STILL while not moving. It goes back to MOVEMENT_PERIOD
+ * as soon as the state changes. Set both maximums to MOVEMENT_PERIOD to 
+ * always read at a fixed period. A start is detected up to
+ * MOVEMENT_PERIOD_MAX_STILL after it happens instead of MOVEMENT_PERIOD, that
+ * is up to 9 s later on the SensorTag after 90 s still; movements shorter
+ * than the period may be missed. On the recorded traces the average start
+ * latency grows by 0.3 s (12.2 to 12.5 s), with 1/4 of the readings during
+ * long stays. */
+#define MOVEMENT_BACKOFF_READINGS   10
+#define MOVEMENT_PERIOD_MAX_MOVING  (2 * MOVEMENT_PERIOD)
+#define MOVEMENT_PERIOD_MAX_STILL   (4 * MOVEMENT_PERIOD)
+
+/* Start joining the network while the device is still considered moving, as
+ * soon as the CLIENT_CONF_SPECULATE_READINGS newest readings are still, so
+ * that the join overlaps the confirmation of the stop by the whole feature
+ * window. Nothing is published until the stop is confirmed; the join is
+ * abandoned if the readings show movement again, or after
+ * CLIENT_CONF_SPECULATE_TIMEOUT. */
+#define CLIENT_CONF_SPECULATE               0
+#define CLIENT_CONF_SPECULATE_READINGS      2
+#define CLIENT_CONF_SPECULATE_TIMEOUT       (8 * MOVEMENT_PERIOD)
+
+/* Number of accelerometer samples read at each wake. When greater than 1, the
+ * accelerometer is kept sampling at a low rate between wakes (into the
+ * MPU-9250 FIFO on the SensorTag) and all the samples are drained at once,
+ * instead of powering up the sensor for a single reading every time. The
+ * SensorTag samples at 0.24 * 2^MOVEMENT_CONF_FIFO_ODR Hz in low power mode;
+ * the batch should hold the samples of a MOVEMENT_PERIOD_MAX_MOVING, and the
+ * FIFO (85 samples) those of the longest time between wakes (G). */
+#define MOVEMENT_CONF_BATCH_SIZE  1
+#define MOVEMENT_CONF_FIFO_ODR    2
+
 /* Acceleration script file to use for plaforms without an accelerometer */
 #define MOVEMENT_FILE "acceleration.h"
 
+/* Probability, in percent, of a simulated accelerometer read failure on
+ * platforms without an accelerometer, to exercise the error handling */
+#define MOVEMENT_CONF_SIM_ERROR_RATE  0
+
+/* Maximum number of attempts to read the accelerometer, shared by all axes */
+#define MOVEMENT_CONF_READ_ATTEMPTS   5
+
+/* Uncomment to replay a recorded trace on the native target instead of
+ * MOVEMENT_FILE. The trace can be a log of the MQTT messages published by
+ * the client, or a binary trace made with tools/trace-convert.py. It can be 
+ * overridden at runtime with the MOVEMENT_TRACE environment variable. */
+//#define MOVEMENT_TRACE_FILE "data/mvmt-data-2018-10-02.txt"
+
+/* Speed of the trace replay relative to real time. If 0, each accelerometer
+ * reading returns the next records in the trace, as fast as possible */
+#define MOVEMENT_CONF_TRACE_SPEED  1
+
 /* Period of periodic MQTT messages sent when connected & not moving */
 #define K (CLOCK_SECOND * 10)
 
+/* Align the periodic timers (accelerometer readings, K, energest log) to
+ * each other, so that the MCU leaves deep LPM once for several of them: each
+ * timer can be moved earlier or later by up to its slack to expire together
+ * with another one (see wake-sched.h). The LED patterns are never moved, and
+ * neither is the K timer: its deadlines decide when the radio is turned on
+ * and when a batch is due, and moving them can cost a radio cycle more than
+ * the wakeups saved. The other timers are still aligned to it. */
+#define WAKE_SCHED_CONF_ENABLED     1
+#define K_SLACK                     0
+#define MOVEMENT_SLACK              (MOVEMENT_PERIOD / 4)
+
+/* Batched publishing, used only with CSMA_CONF_MANUAL_DUTY_CYCLING == 1.
+ * While not moving, an acceleration sample is queued every K, together with
+ * a record of each change of the movement state. The radio is turned on at
+ * each stop, or when PUBLISH_CONF_BATCH_SIZE records are queued, or when the
+ * oldest one is PUBLISH_CONF_BATCH_MAX_AGE old, and the queue is sent in a
+ * single message. When 0, a message is published every K. */
+#ifndef PUBLISH_CONF_BATCHING
+#define PUBLISH_CONF_BATCHING       0
+#endif
+#define PUBLISH_CONF_BATCH_SIZE     8
+#define PUBLISH_CONF_BATCH_MAX_AGE  (12 * K)
+
+/* Adaptive period of the samples taken while not moving (see
+ * publish-period.h). K is doubled after each PUBLISH_PERIOD_CONF_DWELL
+ * without moving, and stretched up to PUBLISH_PERIOD_CONF_BATTERY_STRETCH
+ * times as the battery voltage falls from PUBLISH_PERIOD_CONF_BATTERY_FULL to
+ * PUBLISH_PERIOD_CONF_BATTERY_LOW mV, between PUBLISH_PERIOD_CONF_MIN and
+ * PUBLISH_PERIOD_CONF_MAX. PUBLISH_CONF_BATCH_MAX_AGE is stretched likewise.
+ * A change of the movement state brings it back to K. The period and the
+ * battery voltage are reported in each message. */
+#define PUBLISH_PERIOD_CONF_ENABLED         1
+#define PUBLISH_PERIOD_CONF_MIN             (4 * CLOCK_SECOND)
+#define PUBLISH_PERIOD_CONF_MAX             (600UL * CLOCK_SECOND)
+#define PUBLISH_PERIOD_CONF_DWELL           (900UL * CLOCK_SECOND)
+#define PUBLISH_PERIOD_CONF_BATTERY_FULL    2900
+#define PUBLISH_PERIOD_CONF_BATTERY_LOW     2400
+#define PUBLISH_PERIOD_CONF_BATTERY_STRETCH 4
+
+/* Store-and-forward of the queued records, used only with batched publishing.
+ * When the queue in RAM overflows because no network can be reached, its
+ * oldest records are moved in blocks to segment files in flash (Coffee on the
+ * SensorTag, files on native) of PUBLISH_CONF_STORE_SIZE records, instead of
+ * being discarded, and they are published first at the next MQTT session.
+ * The segments are kept across reboots, and the records and messages then
+ * carry the number of the boot (see publish-store.h). */
+#define PUBLISH_CONF_STORE          0
+#define PUBLISH_CONF_STORE_SIZE     (128 * PUBLISH_CONF_BATCH_SIZE)
+
+/* Report-by-exception publishing. When enabled, a periodic sample (or a
+ * reading with PUBLISH_ON_MOVEMENT) is published or queued only if an axis
+ * of the acceleration changed by PUBLISH_FILTER_CONF_ACC_DELTA (in hundredths
+ * of g), the RSSI by PUBLISH_FILTER_CONF_RSSI_DELTA dBm, or the movement state
+ * changed, since the last sample published, or if no sample has been
+ * published for PUBLISH_FILTER_CONF_HEARTBEAT. At most PUBLISH_FILTER_CONF_BURST
+ * samples are published at once, then one every PUBLISH_FILTER_CONF_RATE.
+ * The decision is taken before turning the radio on. */
+#define PUBLISH_CONF_FILTER             0
+#define PUBLISH_FILTER_CONF_ACC_DELTA   10
+#define PUBLISH_FILTER_CONF_RSSI_DELTA  6
+#define PUBLISH_FILTER_CONF_HEARTBEAT   (30 * K)
+#define PUBLISH_FILTER_CONF_BURST       4
+#define PUBLISH_FILTER_CONF_RATE        (3 * K)
+
+/* Payload format of the MQTT messages: PUBLISH_FORMAT_JSON, or 
+ * PUBLISH_FORMAT_BINARY for a compact binary layout (22 bytes plus 11 bytes
+ * per record instead of about 180 bytes plus 30 per record, see payload.h)
+ * which can be decoded with tools/payload-decode.py */
+#ifndef PUBLISH_CONF_FORMAT
+#define PUBLISH_CONF_FORMAT         PUBLISH_FORMAT_JSON
+#endif
+
 /* Time to wait before resuming accelerometer polling after the device has
  * just stopped moving */
 #ifdef CONTIKI_TARGET_NATIVE
@@ -136,8 +373,32 @@
 #define LOG_CONF_LEVEL_LED_REPORT                  LOG_LEVEL_ERR
 /* Log level for the energest-log module. */
 #define LOG_CONF_LEVEL_ENERGEST_LOG                LOG_LEVEL_DBG
+/* Log level for the publish-queue module. */
+#define LOG_CONF_LEVEL_PUBLISH_QUEUE               LOG_LEVEL_ERR
+/* Log level for the publish-filter module. */
+#define LOG_CONF_LEVEL_PUBLISH_FILTER              LOG_LEVEL_ERR
+/* Log level for the publish-store module. */
+#define LOG_CONF_LEVEL_PUBLISH_STORE               LOG_LEVEL_ERR
+/* Log level for the fast-rejoin module. */
+#define LOG_CONF_LEVEL_FAST_REJOIN                 LOG_LEVEL_ERR
+/* Log level for the tsch-sleep module. */
+#define LOG_CONF_LEVEL_TSCH_SLEEP                  LOG_LEVEL_ERR
+/* Log level for the tsch-hint module. */
+#define LOG_CONF_LEVEL_TSCH_HINT                   LOG_LEVEL_ERR
+/* Log level for the wake-sched module. */
+#define LOG_CONF_LEVEL_WAKE_SCHED                  LOG_LEVEL_ERR
+/* Log level for the tx-power module. */
+#define LOG_CONF_LEVEL_TX_POWER                    LOG_LEVEL_ERR
+/* Log level for the remote-config module. */
+#define LOG_CONF_LEVEL_REMOTE_CONFIG               LOG_LEVEL_ERR
+/* Log level for the publish-period module. */
+#define LOG_CONF_LEVEL_PUBLISH_PERIOD              LOG_LEVEL_ERR
+/* Log level for the mqtt-sn module. */
+#define LOG_CONF_LEVEL_MQTT_SN                     LOG_LEVEL_ERR
 /* Log level for the movement module. */
 #define LOG_CONF_LEVEL_MOVEMENT                    LOG_LEVEL_ERR
+/* Log level for the movement-monitor module. */
+#define LOG_CONF_LEVEL_MOVEMENT_MONITOR            LOG_LEVEL_ERR
 
 /* Log level for useful Contiki modules */
 #define LOG_CONF_LEVEL_RPL                         LOG_LEVEL_ERR
@@ -0,0 +1,113 @@
+/** @file
+ * @brief Report-by-exception filter of the periodic samples implementation
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#include <stdlib.h>
+#include <string.h>
+#include "contiki.h"
+#include "sys/log.h"
+#include "publish-filter.h"
+
+
+#define LOG_MODULE "Pub Filter"
+#ifdef LOG_CONF_LEVEL_PUBLISH_FILTER
+#define LOG_LEVEL  LOG_CONF_LEVEL_PUBLISH_FILTER
+#else
+#define LOG_LEVEL  LOG_LEVEL_ERR
+#endif
+
+
+/** The state of the filter. */
+static struct {
+  /** 1 if the next sample must be let through regardless of its value. */
+  uint8_t pending;
+  /** The last sample let through, and when. */
+  int acc[3];
+  int rssi;
+  clock_time_t time;
+  /** The tokens in the bucket, and when the last one was gained. */
+  uint8_t tokens;
+  clock_time_t refill_time;
+  /** Statistics. */
+  uint32_t suppressed;
+  uint32_t limited;
+} filter;
+
+
+/** Adds the tokens gained since the last refill to the bucket. */
+static void refill(void)
+{
+  clock_time_t now = clock_time();
+  clock_time_t gained = (now - filter.refill_time) / PUBLISH_FILTER_RATE;
+
+  if (filter.tokens + gained >= PUBLISH_FILTER_BURST) {
+    filter.tokens = PUBLISH_FILTER_BURST;
+    filter.refill_time = now;
+  } else {
+    filter.tokens += gained;
+    filter.refill_time += gained * PUBLISH_FILTER_RATE;
+  }
+}
+
+
+void publish_filter_init(void)
+{
+  memset(&filter, 0, sizeof(filter));
+  filter.pending = 1;
+  filter.tokens = PUBLISH_FILTER_BURST;
+  filter.refill_time = clock_time();
+}
+
+
+void publish_filter_reset(void)
+{
+  filter.pending = 1;
+}
+
+
+int publish_filter_check(const int acc[3], int rssi)
+{
+  int i, changed = filter.pending;
+
+  for (i = 0; i < 3 && !changed; i++)
+    changed = abs(acc[i] - filter.acc[i]) >= PUBLISH_FILTER_ACC_DELTA;
+  if (!changed)
+    changed = abs(rssi - filter.rssi) >= PUBLISH_FILTER_RSSI_DELTA;
+  if (!changed)
+    changed = clock_time() - filter.time >= PUBLISH_FILTER_HEARTBEAT;
+  if (!changed) {
+    filter.suppressed++;
+    LOG_DBG("sample suppressed (%lu so far)\n",
+            (unsigned long)filter.suppressed);
+    return 0;
+  }
+
+  refill();
+  if (filter.tokens == 0) {
+    filter.limited++;
+    LOG_INFO("sample held back by the rate limit (%lu so far)\n",
+             (unsigned long)filter.limited);
+    return 0;
+  }
+  filter.tokens--;
+
+  memcpy(filter.acc, acc, sizeof(filter.acc));
+  filter.rssi = rssi;
+  filter.time = clock_time();
+  filter.pending = 0;
+  return 1;
+}
+
+
+uint32_t publish_filter_suppressed(void)
+{
+  return filter.suppressed;
+}
+
+
+uint32_t publish_filter_limited(void)
+{
+  return filter.limited;
+}
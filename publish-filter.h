@@ -0,0 +1,99 @@
+/** @file
+ * @brief Report-by-exception filter of the periodic samples
+ *
+ * While the device is not moving, a sample is taken every K (or at every
+ * reading of the accelerometer with PUBLISH_ON_MOVEMENT). Most of them carry
+ * no news: this filter lets a sample through only when the acceleration
+ * vector or the RSSI differ enough from the last sample let through, when
+ * the movement state has changed since then, or when nothing has been let
+ * through for PUBLISH_FILTER_HEARTBEAT, so that the broker still knows the
+ * device is there.
+ *
+ * The samples let through are also limited by a token bucket, which holds up
+ * to PUBLISH_FILTER_BURST tokens and gains one every PUBLISH_FILTER_RATE. A
+ * sample held back by the bucket is not lost: the change is still pending,
+ * and it is let through as soon as a token is available.
+ *
+ * The filter is checked before turning the radio on, so that suppressed
+ * samples cost no radio time when the radio is manually duty cycled. In that
+ * case the RSSI is the one measured at the last publish, as it cannot be
+ * measured with the radio off, and only the acceleration and the movement
+ * state are effectively compared.
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#ifndef _PUBLISH_FILTER_H_
+#define _PUBLISH_FILTER_H_
+
+#include "contiki.h"
+
+
+/** Enables the filter. When 0, every sample is published. */
+#ifdef PUBLISH_CONF_FILTER
+#define PUBLISH_FILTER PUBLISH_CONF_FILTER
+#else
+#define PUBLISH_FILTER 0
+#endif
+
+/** The minimum change of any axis of the acceleration, scaled like
+ * last_acc, for a sample to be published. */
+#ifdef PUBLISH_FILTER_CONF_ACC_DELTA
+#define PUBLISH_FILTER_ACC_DELTA PUBLISH_FILTER_CONF_ACC_DELTA
+#else
+#define PUBLISH_FILTER_ACC_DELTA 10
+#endif
+
+/** The minimum change of the RSSI, in dBm, for a sample to be published. */
+#ifdef PUBLISH_FILTER_CONF_RSSI_DELTA
+#define PUBLISH_FILTER_RSSI_DELTA PUBLISH_FILTER_CONF_RSSI_DELTA
+#else
+#define PUBLISH_FILTER_RSSI_DELTA 6
+#endif
+
+/** The maximum time between two samples published. */
+#ifdef PUBLISH_FILTER_CONF_HEARTBEAT
+#define PUBLISH_FILTER_HEARTBEAT PUBLISH_FILTER_CONF_HEARTBEAT
+#else
+#define PUBLISH_FILTER_HEARTBEAT (300 * CLOCK_SECOND)
+#endif
+
+/** The size of the token bucket. */
+#ifdef PUBLISH_FILTER_CONF_BURST
+#define PUBLISH_FILTER_BURST PUBLISH_FILTER_CONF_BURST
+#else
+#define PUBLISH_FILTER_BURST 4
+#endif
+
+/** The time needed to gain a token. */
+#ifdef PUBLISH_FILTER_CONF_RATE
+#define PUBLISH_FILTER_RATE PUBLISH_FILTER_CONF_RATE
+#else
+#define PUBLISH_FILTER_RATE (30 * CLOCK_SECOND)
+#endif
+
+
+/** Fills the token bucket, and forgets the last sample published. */
+void publish_filter_init(void);
+
+/** Notifies a change of the movement state: the next sample is let through
+ * regardless of its value, if the token bucket allows it. */
+void publish_filter_reset(void);
+
+/** Decides whether a sample must be published. If so, the sample becomes the
+ * reference for the next ones, and a token is consumed.
+ * @param acc  The acceleration vector, scaled like last_acc.
+ * @param rssi The RSSI, in dBm.
+ * @returns 1 if the sample must be published, 0 if it must be dropped. */
+int publish_filter_check(const int acc[3], int rssi);
+
+/** Returns the number of samples suppressed because nothing changed.
+ * @returns The number of samples suppressed since startup. */
+uint32_t publish_filter_suppressed(void);
+
+/** Returns the number of samples held back by the token bucket.
+ * @returns The number of samples held back since startup. */
+uint32_t publish_filter_limited(void);
+
+
+#endif
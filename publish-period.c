@@ -0,0 +1,113 @@
+/** @file
+ * @brief Adaptive period of the samples taken while not moving
+ *        implementation
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#include "contiki.h"
+#include "sys/log.h"
+#include "publish-period.h"
+
+#if PUBLISH_PERIOD_ENABLED
+
+#if defined(PUBLISH_PERIOD_CONF_BATTERY_READ)
+int PUBLISH_PERIOD_CONF_BATTERY_READ(void);
+#define battery_init()
+#define battery_read() PUBLISH_PERIOD_CONF_BATTERY_READ()
+#elif BOARD_SENSORTAG
+#include "lib/sensors.h"
+#include "batmon-sensor.h"
+#define battery_init() SENSORS_ACTIVATE(batmon_sensor)
+#define battery_read() batmon_sensor.value(BATMON_SENSOR_TYPE_VOLT)
+#else
+#define battery_init()
+#define battery_read() (-1)
+#endif
+
+
+#define LOG_MODULE "Pub Period"
+#ifdef LOG_CONF_LEVEL_PUBLISH_PERIOD
+#define LOG_LEVEL  LOG_CONF_LEVEL_PUBLISH_PERIOD
+#else
+#define LOG_LEVEL  LOG_LEVEL_ERR
+#endif
+
+
+/** The fixed point unit of the stretch of the battery. */
+#define STRETCH_ONE 16
+/** The maximum number of doublings of the period, which is anyway capped by
+ * PUBLISH_PERIOD_MAX. */
+#define MAX_DOUBLINGS 16
+
+
+/** The time of the last change of the movement state. */
+static clock_time_t still_since;
+/** The last battery voltage read, in mV, or -1. */
+static int battery = -1;
+/** The last period computed, to log its changes. */
+static clock_time_t last_period;
+
+
+/** Computes the stretch due to the battery.
+ * @param mv The battery voltage in mV, or -1 if unknown.
+ * @returns The stretch, in units of STRETCH_ONE. */
+static uint32_t battery_stretch(int mv)
+{
+  if (mv < 0 || mv >= PUBLISH_PERIOD_BATTERY_FULL)
+    return STRETCH_ONE;
+  if (mv <= PUBLISH_PERIOD_BATTERY_LOW)
+    return PUBLISH_PERIOD_BATTERY_STRETCH * STRETCH_ONE;
+  return STRETCH_ONE + (uint32_t)(PUBLISH_PERIOD_BATTERY_FULL - mv) *
+         (PUBLISH_PERIOD_BATTERY_STRETCH - 1) * STRETCH_ONE /
+         (PUBLISH_PERIOD_BATTERY_FULL - PUBLISH_PERIOD_BATTERY_LOW);
+}
+
+
+void publish_period_init(void)
+{
+  battery_init();
+  still_since = clock_time();
+}
+
+
+void publish_period_reset(void)
+{
+  still_since = clock_time();
+}
+
+
+clock_time_t publish_period_get(clock_time_t base)
+{
+  clock_time_t dwell = clock_time() - still_since;
+  int doublings = MIN(dwell / PUBLISH_PERIOD_DWELL, MAX_DOUBLINGS);
+  uint64_t period;
+
+  battery = battery_read();
+  period = ((uint64_t)base << doublings) * battery_stretch(battery) /
+           STRETCH_ONE;
+  /* A K set below the minimum is never lengthened to it */
+  period = MAX(MIN(PUBLISH_PERIOD_MIN, base), MIN(PUBLISH_PERIOD_MAX, period));
+
+  if (period != last_period) {
+    LOG_INFO("period %lu ticks (%d doublings, battery %d mV)\n",
+             (unsigned long)period, doublings, battery);
+    last_period = period;
+  }
+  return period;
+}
+
+
+clock_time_t publish_period_scale(clock_time_t t, clock_time_t base)
+{
+  return (uint64_t)t * publish_period_get(base) / base;
+}
+
+
+int publish_period_battery(void)
+{
+  return battery;
+}
+
+
+#endif
@@ -0,0 +1,125 @@
+/** @file
+ * @brief Adaptive period of the samples taken while not moving
+ *
+ * While the device is not moving, a sample is taken every K, and published
+ * right away or queued for the next batch. A device left on a desk keeps
+ * sending the same sample, and spends its battery on heartbeats which carry
+ * no news. With this module, the period is stretched:
+ *
+ *  - by the time spent without moving: after PUBLISH_PERIOD_DWELL, the period
+ *    is doubled, and it is doubled again after each further
+ *    PUBLISH_PERIOD_DWELL;
+ *  - by the voltage of the battery: from PUBLISH_PERIOD_BATTERY_FULL down to
+ *    PUBLISH_PERIOD_BATTERY_LOW mV, the period is stretched linearly, up to
+ *    PUBLISH_PERIOD_BATTERY_STRETCH times.
+ *
+ * The period is then kept between PUBLISH_PERIOD_MIN and PUBLISH_PERIOD_MAX,
+ * but it is never longer than K because of PUBLISH_PERIOD_MIN alone: a K set
+ * below the minimum, locally or remotely, is used as it is.
+ * The maximum age of the records queued for a batch is stretched likewise.
+ * Any change of the movement state brings the period back to K at once
+ * (apart from the stretch of the battery), so that the latency of the
+ * movement events is not affected by a long stay.
+ *
+ * The battery voltage is read from the battery monitor of the CC26xx on the
+ * SensorTag. On the other platforms it is unknown, and only the time without
+ * moving counts, unless PUBLISH_PERIOD_CONF_BATTERY_READ names a function
+ * returning the voltage in mV (or -1 if unknown).
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#ifndef _PUBLISH_PERIOD_H_
+#define _PUBLISH_PERIOD_H_
+
+#include "contiki.h"
+
+
+/** Enables the adaptive period. When 0, the period is always K. */
+#ifdef PUBLISH_PERIOD_CONF_ENABLED
+#define PUBLISH_PERIOD_ENABLED PUBLISH_PERIOD_CONF_ENABLED
+#else
+#define PUBLISH_PERIOD_ENABLED 0
+#endif
+
+/** The minimum period. */
+#ifdef PUBLISH_PERIOD_CONF_MIN
+#define PUBLISH_PERIOD_MIN PUBLISH_PERIOD_CONF_MIN
+#else
+#define PUBLISH_PERIOD_MIN (10 * CLOCK_SECOND)
+#endif
+
+/** The maximum period. */
+#ifdef PUBLISH_PERIOD_CONF_MAX
+#define PUBLISH_PERIOD_MAX PUBLISH_PERIOD_CONF_MAX
+#else
+#define PUBLISH_PERIOD_MAX (600UL * CLOCK_SECOND)
+#endif
+
+/** The time without moving after which the period is doubled. */
+#ifdef PUBLISH_PERIOD_CONF_DWELL
+#define PUBLISH_PERIOD_DWELL PUBLISH_PERIOD_CONF_DWELL
+#else
+#define PUBLISH_PERIOD_DWELL (900UL * CLOCK_SECOND)
+#endif
+
+/** The battery voltage, in mV, above which the period is not stretched. */
+#ifdef PUBLISH_PERIOD_CONF_BATTERY_FULL
+#define PUBLISH_PERIOD_BATTERY_FULL PUBLISH_PERIOD_CONF_BATTERY_FULL
+#else
+#define PUBLISH_PERIOD_BATTERY_FULL 2900
+#endif
+
+/** The battery voltage, in mV, below which the period is stretched the
+ * most. */
+#ifdef PUBLISH_PERIOD_CONF_BATTERY_LOW
+#define PUBLISH_PERIOD_BATTERY_LOW PUBLISH_PERIOD_CONF_BATTERY_LOW
+#else
+#define PUBLISH_PERIOD_BATTERY_LOW 2400
+#endif
+
+/** The stretch of the period at PUBLISH_PERIOD_BATTERY_LOW. */
+#ifdef PUBLISH_PERIOD_CONF_BATTERY_STRETCH
+#define PUBLISH_PERIOD_BATTERY_STRETCH PUBLISH_PERIOD_CONF_BATTERY_STRETCH
+#else
+#define PUBLISH_PERIOD_BATTERY_STRETCH 4
+#endif
+
+
+#if PUBLISH_PERIOD_ENABLED
+
+/** Starts the battery monitor, and starts counting the time without
+ * moving. */
+void publish_period_init(void);
+
+/** Notifies a change of the movement state: the time without moving starts
+ * again from zero. */
+void publish_period_reset(void);
+
+/** Computes the current period, and reads the battery.
+ * @param base The period before being stretched (K).
+ * @returns The period. */
+clock_time_t publish_period_get(clock_time_t base);
+
+/** Stretches a time like the period.
+ * @param t    The time.
+ * @param base The period before being stretched (K).
+ * @returns t multiplied by publish_period_get(base) / base. */
+clock_time_t publish_period_scale(clock_time_t t, clock_time_t base);
+
+/** Returns the last battery voltage read.
+ * @returns The voltage in mV, or -1 if unknown. */
+int publish_period_battery(void);
+
+#else
+
+#define publish_period_init()
+#define publish_period_reset()
+#define publish_period_get(base)       (base)
+#define publish_period_scale(t, base)  (t)
+#define publish_period_battery()       (-1)
+
+#endif
+
+
+#endif
@@ -0,0 +1,181 @@
+/** @file
+ * @brief Queue of records waiting to be published implementation
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#include <string.h>
+#include "contiki.h"
+#include "sys/log.h"
+#include "publish-queue.h"
+#include "publish-store.h"
+
+#if PUBLISH_BATCHING
+
+
+#define LOG_MODULE "Pub Queue"
+#ifdef LOG_CONF_LEVEL_PUBLISH_QUEUE
+#define LOG_LEVEL  LOG_CONF_LEVEL_PUBLISH_QUEUE
+#else
+#define LOG_LEVEL  LOG_LEVEL_ERR
+#endif
+
+
+/** The state of the queue. */
+static struct {
+  /** Ring buffer of the records. */
+  publish_record_t records[PUBLISH_QUEUE_SIZE];
+  /** The index of the oldest record in the ring buffer. */
+  uint16_t head;
+  /** The number of records in the ring buffer. */
+  uint16_t count;
+  /** The sequence number of the oldest record. */
+  uint32_t first_seq;
+  /** The number of records discarded because the queue was full. */
+  uint32_t dropped;
+} queue;
+
+
+#if PUBLISH_STORE
+/** The records in the store precede those in the ring buffer. */
+#define stored() publish_store_count()
+#else
+#define stored() 0
+#endif
+
+
+void publish_queue_init(void)
+{
+  memset(&queue, 0, sizeof(queue));
+  #if PUBLISH_STORE
+  if (publish_store_init() < 0)
+    LOG_ERR("store unavailable, records will be discarded on overflow\n");
+  #endif
+}
+
+
+#if PUBLISH_STORE
+/** Moves the oldest block of records from the ring buffer to the store. */
+static void spill(void)
+{
+  publish_record_t block[PUBLISH_BATCH_SIZE];
+  int n = MIN(PUBLISH_BATCH_SIZE, queue.count);
+  int i;
+
+  for (i = 0; i < n; i++)
+    block[i] = queue.records[(queue.head + i) % PUBLISH_QUEUE_SIZE];
+  queue.head = (queue.head + n) % PUBLISH_QUEUE_SIZE;
+  queue.count -= n;
+  queue.first_seq += n;
+  queue.dropped += publish_store_append(block, n);
+  LOG_DBG("moved %d records to the store, %d stored\n", n, stored());
+}
+#endif
+
+
+void publish_queue_push(uint8_t type, const int acc[3])
+{
+  if (queue.count == PUBLISH_QUEUE_SIZE) {
+    #if PUBLISH_STORE
+    spill();
+    #else
+    LOG_WARN("queue full, discarding record %lu\n",
+             (unsigned long)queue.first_seq);
+    queue.head = (queue.head + 1) % PUBLISH_QUEUE_SIZE;
+    queue.count--;
+    queue.first_seq++;
+    queue.dropped++;
+    #endif
+  }
+
+  publish_record_t *r = &queue.records[(queue.head + queue.count) %
+                                       PUBLISH_QUEUE_SIZE];
+  r->time = clock_time();
+  memcpy(r->acc, acc, sizeof(r->acc));
+  r->type = type;
+  #if PUBLISH_STORE
+  r->boot = publish_store_boot();
+  #else
+  r->boot = 0;
+  #endif
+  queue.count++;
+  LOG_DBG("queued record type %d, %d records queued\n", type, queue.count);
+}
+
+
+int publish_queue_count(void)
+{
+  return stored() + queue.count;
+}
+
+
+int publish_queue_load(int n)
+{
+  #if PUBLISH_STORE
+  /* The first block read covers the n oldest records */
+  if (stored() > 0 && publish_store_get(0) == NULL) {
+    int lost = stored();
+    LOG_ERR("cannot read the store, discarding %d records\n", lost);
+    publish_store_release(lost);
+    queue.dropped += lost;
+  }
+  #endif
+  return MIN(n, publish_queue_count());
+}
+
+
+const publish_record_t *publish_queue_get(int i)
+{
+  #if PUBLISH_STORE
+  if (i >= 0 && i < stored())
+    return publish_store_get(i);
+  i -= stored();
+  #endif
+  if (i < 0 || i >= queue.count)
+    return NULL;
+  return &queue.records[(queue.head + i) % PUBLISH_QUEUE_SIZE];
+}
+
+
+uint32_t publish_queue_first_seq(void)
+{
+  return queue.first_seq - stored();
+}
+
+
+void publish_queue_release(uint32_t end_seq)
+{
+  #if PUBLISH_STORE
+  int32_t n = end_seq - publish_queue_first_seq();
+  if (n > 0)
+    publish_store_release(MIN(n, stored()));
+  #endif
+  /* Records already discarded because of an overflow are skipped */
+  while (queue.count > 0 && (int32_t)(end_seq - queue.first_seq) > 0) {
+    queue.head = (queue.head + 1) % PUBLISH_QUEUE_SIZE;
+    queue.count--;
+    queue.first_seq++;
+  }
+}
+
+
+int publish_queue_due(clock_time_t max_age)
+{
+  if (stored() > 0)
+    return 1;
+  if (queue.count == 0)
+    return 0;
+  if (queue.count >= PUBLISH_BATCH_SIZE)
+    return 1;
+  clock_time_t age = clock_time() - queue.records[queue.head].time;
+  return age >= max_age;
+}
+
+
+uint32_t publish_queue_dropped(void)
+{
+  return queue.dropped;
+}
+
+
+#endif
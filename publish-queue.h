@@ -0,0 +1,140 @@
+/** @file
+ * @brief Queue of records waiting to be published
+ *
+ * When the radio is manually duty cycled and PUBLISH_CONF_BATCHING is 1, the
+ * acceleration readings and the changes of the movement state are
+ * accumulated in this queue while the radio is off, and they are sent
+ * together in a single MQTT message, to amortize the cost of joining the
+ * network over many records. A stop flushes the queue at once.
+ *
+ * Each record is identified by a sequence number, which is preserved when
+ * older records are discarded; this allows to release exactly the records
+ * that have been acknowledged even if the queue overflowed in the meantime.
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#ifndef _PUBLISH_QUEUE_H_
+#define _PUBLISH_QUEUE_H_
+
+#include "contiki.h"
+
+
+/** Enables the queue. Records are queued and published in batches only when
+ * the radio is manually duty cycled, as there is no join cost to amortize
+ * otherwise. */
+#if !MAC_CONF_WITH_TSCH && PUBLISH_ON_MOVEMENT == 0 && \
+    (!defined(CSMA_CONF_MANUAL_DUTY_CYCLING) || \
+     CSMA_CONF_MANUAL_DUTY_CYCLING == 1) && defined(PUBLISH_CONF_BATCHING)
+#define PUBLISH_BATCHING PUBLISH_CONF_BATCHING
+#else
+#define PUBLISH_BATCHING 0
+#endif
+
+/** The maximum number of records sent in a single message. When at least
+ * this number of records is queued, the queue must be flushed. */
+#ifdef PUBLISH_CONF_BATCH_SIZE
+#define PUBLISH_BATCH_SIZE PUBLISH_CONF_BATCH_SIZE
+#else
+#define PUBLISH_BATCH_SIZE 1
+#endif
+
+/** The maximum time a record can wait in the queue before the queue must be
+ * flushed. */
+#ifdef PUBLISH_CONF_BATCH_MAX_AGE
+#define PUBLISH_BATCH_MAX_AGE PUBLISH_CONF_BATCH_MAX_AGE
+#else
+#define PUBLISH_BATCH_MAX_AGE (CLOCK_SECOND * 120)
+#endif
+
+/** The minimum capacity of the queue in RAM, whatever the batch size, so
+ * that the records queued while no network can be reached are not lost at
+ * once even with small batches. */
+#define PUBLISH_QUEUE_MIN_SIZE 16
+
+/** The capacity of the queue in RAM. When the queue is full, the oldest record
+ * is discarded to make room for the new one, or the oldest block of records is
+ * moved to the store if PUBLISH_STORE is enabled (see publish-store.h). */
+#ifdef PUBLISH_CONF_QUEUE_SIZE
+#define PUBLISH_QUEUE_SIZE PUBLISH_CONF_QUEUE_SIZE
+#else
+#define PUBLISH_QUEUE_SIZE MAX(2 * PUBLISH_BATCH_SIZE, PUBLISH_QUEUE_MIN_SIZE)
+#endif
+
+
+/** The types of record. */
+enum {
+  /** A periodic acceleration reading taken while not moving. */
+  PUBLISH_RECORD_SAMPLE = 0,
+  /** The device stopped moving. */
+  PUBLISH_RECORD_STOPPED = 1,
+  /** The device started moving. */
+  PUBLISH_RECORD_MOVING = 2
+};
+
+
+/** A record waiting to be published. */
+typedef struct {
+  /** The time the record was created. */
+  clock_time_t time;
+  /** The last acceleration measured, scaled like last_acc. */
+  int acc[3];
+  /** The type of record (PUBLISH_RECORD_*). */
+  uint8_t type;
+  /** The number of the boot the record was created in, or 0 without
+   * PUBLISH_STORE (see publish_store_boot()). */
+  uint16_t boot;
+} publish_record_t;
+
+
+/** Empties the queue. The functions of the module exist only if
+ * PUBLISH_BATCHING is enabled.
+ *
+ * Must be called before any of the other functions in the module. */
+void publish_queue_init(void);
+
+/** Appends a record to the queue, with the current time.
+ * @param type The type of record.
+ * @param acc  The acceleration vector. */
+void publish_queue_push(uint8_t type, const int acc[3]);
+
+/** Returns the number of records in the queue.
+ * @returns The number of records. */
+int publish_queue_count(void);
+
+/** Makes sure that the oldest records in the queue can be read, discarding the
+ * stored records which cannot be read back. Must be called before reading the
+ * records to publish with publish_queue_get().
+ * @param n The number of records to read, at most PUBLISH_BATCH_SIZE.
+ * @returns The number of records which can be read, at most n. */
+int publish_queue_load(int n);
+
+/** Returns a record in the queue.
+ * @param i The index of the record, where 0 is the oldest one.
+ * @returns The record, or NULL if i is out of range. A stored record is valid
+ *          until the next call. */
+const publish_record_t *publish_queue_get(int i);
+
+/** Returns the sequence number of the oldest record in the queue, or of the
+ * next record pushed if the queue is empty.
+ * @returns The sequence number. */
+uint32_t publish_queue_first_seq(void);
+
+/** Removes the records whose sequence number precedes a given one.
+ * @param end_seq The sequence number of the first record to keep. */
+void publish_queue_release(uint32_t end_seq);
+
+/** Returns whether the queue must be flushed, because it contains at least
+ * PUBLISH_BATCH_SIZE records or its oldest record is at least max_age old.
+ * @param max_age The maximum age of the oldest record, normally
+ *                PUBLISH_BATCH_MAX_AGE.
+ * @returns 1 if the queue must be flushed, 0 otherwise. */
+int publish_queue_due(clock_time_t max_age);
+
+/** Returns the number of records discarded because the queue (and the store,
+ * if enabled) was full.
+ * @returns The number of records discarded since startup. */
+uint32_t publish_queue_dropped(void);
+
+
+#endif
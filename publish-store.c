@@ -0,0 +1,352 @@
+/** @file
+ * @brief Store-and-forward log of the records waiting to be published
+ *        implementation
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#include <stdio.h>
+#include <string.h>
+#include "contiki.h"
+#include "cfs/cfs.h"
+#ifndef CONTIKI_TARGET_NATIVE
+#include "cfs/cfs-coffee.h"
+#endif
+#include "sys/log.h"
+#include "publish-store.h"
+
+#if PUBLISH_BATCHING && PUBLISH_STORE
+
+
+#define LOG_MODULE "Pub Store"
+#ifdef LOG_CONF_LEVEL_PUBLISH_STORE
+#define LOG_LEVEL  LOG_CONF_LEVEL_PUBLISH_STORE
+#else
+#define LOG_LEVEL  LOG_LEVEL_ERR
+#endif
+
+
+/** The number of records in a segment file. */
+#define BLOCK_SIZE PUBLISH_BATCH_SIZE
+/** The number of segment files. */
+#define SEGMENTS   (PUBLISH_STORE_SIZE / BLOCK_SIZE)
+/** The maximum length of the name of a segment file, including the
+ * terminator. */
+#define SEGMENT_NAME_LEN (sizeof(PUBLISH_STORE_FILE) + 6)
+/** Marks a segment file which was completely written. */
+#define SEGMENT_MAGIC    0x5053
+
+#if PUBLISH_STORE_SIZE % PUBLISH_BATCH_SIZE != 0
+#error PUBLISH_STORE_SIZE must be a multiple of PUBLISH_BATCH_SIZE
+#endif
+
+
+/** The contents of a segment file. The file always has this size, and the
+ * trailer is written last: a segment cut short by a reset has no valid
+ * trailer. The trailer also keeps the end of the file away from the zeroes
+ * of a short block, which Coffee would otherwise take as unwritten. */
+typedef struct {
+  /** The records, oldest first. */
+  publish_record_t records[BLOCK_SIZE];
+  /** The number of records, and its complement. */
+  uint8_t count;
+  uint8_t check;
+  /** SEGMENT_MAGIC. */
+  uint16_t magic;
+} segment_t;
+
+
+/** The state of the log. The segments are kept as a ring of files, whose
+ * position is found again at startup from the stamps of their records. */
+static struct {
+  /** 1 if the log is usable. */
+  uint8_t ok;
+  /** The oldest segment, and the number of segments. */
+  uint16_t head;
+  uint16_t segments;
+  /** The number of records of the oldest segment already released. */
+  uint8_t released;
+  /** The number of records in each segment, 0 for a segment found corrupt
+   * at startup. */
+  uint8_t lengths[SEGMENTS];
+  /** The number of records in the log. */
+  uint16_t count;
+  /** The last segment read, and its index. */
+  segment_t cache;
+  uint16_t cache_segment;
+  /** The number of the current boot. */
+  uint16_t boot;
+} store;
+
+
+/** Returns the name of the file of a segment.
+ * @param name    The buffer for the name, of SEGMENT_NAME_LEN bytes.
+ * @param segment The index of the segment. */
+static void segment_name(char *name, uint16_t segment)
+{
+  snprintf(name, SEGMENT_NAME_LEN, "%s.%u", PUBLISH_STORE_FILE,
+           (unsigned)segment);
+}
+
+
+/** Writes a new segment file.
+ * @param segment The index of the segment.
+ * @param r       The records.
+ * @param n       The number of records.
+ * @returns 0 on success, -1 on error. */
+static int segment_write(uint16_t segment, const publish_record_t *r, int n)
+{
+  char name[SEGMENT_NAME_LEN];
+
+  /* The cache is the buffer, and it holds the segment once written */
+  memset(&store.cache, 0, sizeof(store.cache));
+  memcpy(store.cache.records, r, n * sizeof(publish_record_t));
+  store.cache.count = n;
+  store.cache.check = ~n;
+  store.cache.magic = SEGMENT_MAGIC;
+  store.cache_segment = SEGMENTS;
+
+  segment_name(name, segment);
+  cfs_remove(name);
+  #ifndef CONTIKI_TARGET_NATIVE
+  /* Allocated at its final size, the file is written in place, without
+   * the micro log, and it is never moved by Coffee while growing */
+  if (cfs_coffee_reserve(name, sizeof(segment_t)) < 0)
+    return -1;
+  #endif
+  int fd = cfs_open(name, CFS_WRITE);
+  if (fd < 0)
+    return -1;
+  int written = cfs_write(fd, &store.cache, sizeof(segment_t));
+  cfs_close(fd);
+  if (written != sizeof(segment_t)) {
+    cfs_remove(name);
+    return -1;
+  }
+  store.cache_segment = segment;
+  return 0;
+}
+
+
+/** Returns whether a record was created before another one.
+ * @param a The first record.
+ * @param b The second record.
+ * @returns Nonzero if a is older than b. */
+static int stamp_before(const publish_record_t *a, const publish_record_t *b)
+{
+  if (a->boot != b->boot)
+    return (int16_t)(a->boot - b->boot) < 0;
+  return (int32_t)(a->time - b->time) < 0;
+}
+
+
+/** Reads a whole segment file into the cache, and checks it.
+ * @param segment The index of the segment.
+ * @returns The number of records, or -1 if the segment is missing or
+ *          corrupt. */
+static int segment_read(uint16_t segment)
+{
+  char name[SEGMENT_NAME_LEN];
+
+  store.cache.count = 0;
+  segment_name(name, segment);
+  int fd = cfs_open(name, CFS_READ);
+  if (fd < 0)
+    return -1;
+  int read = cfs_read(fd, &store.cache, sizeof(segment_t));
+  cfs_close(fd);
+
+  int n = store.cache.count;
+  if (read != sizeof(segment_t) || store.cache.magic != SEGMENT_MAGIC ||
+      store.cache.check != (uint8_t)~n || n == 0 || n > BLOCK_SIZE) {
+    store.cache.count = 0;
+    return -1;
+  }
+  for (int i = 1; i < n; i++) {
+    if (stamp_before(&store.cache.records[i], &store.cache.records[i - 1])) {
+      store.cache.count = 0;
+      return -1;
+    }
+  }
+  store.cache_segment = segment;
+  return n;
+}
+
+
+/** Removes the file of a segment.
+ * @param segment The index of the segment. */
+static void segment_remove(uint16_t segment)
+{
+  char name[SEGMENT_NAME_LEN];
+
+  if (store.cache_segment == segment)
+    store.cache.count = 0;
+  segment_name(name, segment);
+  cfs_remove(name);
+}
+
+
+/** Reads, increments and saves the boot counter.
+ * @returns The number of the current boot, never 0, or 0 on error. */
+static uint16_t boot_count(void)
+{
+  uint16_t boot = 0;
+
+  int fd = cfs_open(PUBLISH_STORE_BOOT_FILE, CFS_READ | CFS_WRITE);
+  if (fd < 0)
+    return 0;
+  if (cfs_read(fd, &boot, sizeof(boot)) != sizeof(boot))
+    boot = 0;
+  if (++boot == 0)
+    boot = 1;
+  /* A small in place modification, which goes through the micro log */
+  if (cfs_seek(fd, 0, CFS_SEEK_SET) != 0 ||
+      cfs_write(fd, &boot, sizeof(boot)) != sizeof(boot))
+    boot = 0;
+  cfs_close(fd);
+  return boot;
+}
+
+
+/** Removes the segments found corrupt at the head of the log. */
+static void skip_corrupt(void)
+{
+  while (store.segments > 0 && store.lengths[store.head] == 0) {
+    store.head = (store.head + 1) % SEGMENTS;
+    store.segments--;
+  }
+}
+
+
+int publish_store_init(void)
+{
+  publish_record_t first, last;
+  uint16_t tail = 0;
+  int found = 0;
+
+  memset(&store, 0, sizeof(store));
+  store.boot = boot_count();
+  if (store.boot == 0) {
+    LOG_ERR("cannot update the boot counter\n");
+    return -1;
+  }
+
+  /* The segments written form a run of the ring, whose ends are the
+   * segments with the oldest and the newest records. Segments which cannot
+   * be read are removed, but keep their place in the run. */
+  for (uint16_t i = 0; i < SEGMENTS; i++) {
+    int n = segment_read(i);
+    if (n < 0) {
+      segment_remove(i);
+      continue;
+    }
+    store.lengths[i] = n;
+    if (!found || stamp_before(&store.cache.records[0], &first)) {
+      first = store.cache.records[0];
+      store.head = i;
+    }
+    if (!found || stamp_before(&last, &store.cache.records[n - 1])) {
+      last = store.cache.records[n - 1];
+      tail = i;
+    }
+    found = 1;
+  }
+  if (found)
+    store.segments = (tail + SEGMENTS - store.head) % SEGMENTS + 1;
+  for (uint16_t i = 0; i < store.segments; i++)
+    store.count += store.lengths[(store.head + i) % SEGMENTS];
+  skip_corrupt();
+
+  store.ok = 1;
+  LOG_INFO("boot %u, %u records in %u segments, room for %u records\n",
+           (unsigned)store.boot, (unsigned)store.count,
+           (unsigned)store.segments, (unsigned)PUBLISH_STORE_SIZE);
+  return 0;
+}
+
+
+uint16_t publish_store_boot(void)
+{
+  return store.boot;
+}
+
+
+int publish_store_append(const publish_record_t *r, int n)
+{
+  int dropped = 0;
+
+  if (!store.ok)
+    return n;
+  if (n <= 0)
+    return 0;
+  /* Whole segments are discarded, as they cannot be modified */
+  while (store.segments == SEGMENTS || store.count + n > PUBLISH_STORE_SIZE) {
+    int k = store.lengths[store.head] - store.released;
+    publish_store_release(k);
+    dropped += k;
+  }
+  if (dropped > 0)
+    LOG_WARN("log full, discarding %d records\n", dropped);
+
+  uint16_t segment = (store.head + store.segments) % SEGMENTS;
+  if (segment_write(segment, r, n) < 0) {
+    LOG_ERR("cannot write %d records\n", n);
+    return dropped + n;
+  }
+  store.lengths[segment] = n;
+  store.segments++;
+  store.count += n;
+  LOG_DBG("stored %d records, %u in the log\n", n, store.count);
+  return dropped;
+}
+
+
+int publish_store_count(void)
+{
+  return store.count;
+}
+
+
+const publish_record_t *publish_store_get(int i)
+{
+  if (i < 0 || i >= store.count)
+    return NULL;
+
+  uint16_t segment = store.head;
+  i += store.released;
+  while (i >= store.lengths[segment]) {
+    i -= store.lengths[segment];
+    segment = (segment + 1) % SEGMENTS;
+  }
+  if (store.cache.count == 0 || store.cache_segment != segment) {
+    /* Records are read one segment at a time, as they are published */
+    if (segment_read(segment) != store.lengths[segment]) {
+      LOG_ERR("cannot read segment %u\n", (unsigned)segment);
+      store.cache.count = 0;
+      return NULL;
+    }
+  }
+  return &store.cache.records[i];
+}
+
+
+void publish_store_release(int n)
+{
+  n = MIN(n, store.count);
+  store.count -= n;
+  while (n > 0) {
+    int k = MIN(n, store.lengths[store.head] - store.released);
+    store.released += k;
+    n -= k;
+    if (store.released == store.lengths[store.head]) {
+      segment_remove(store.head);
+      store.head = (store.head + 1) % SEGMENTS;
+      store.segments--;
+      store.released = 0;
+      skip_corrupt();
+    }
+  }
+}
+
+
+#endif
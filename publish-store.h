@@ -0,0 +1,99 @@
+/** @file
+ * @brief Store-and-forward log of the records waiting to be published
+ *
+ * When the network cannot be reached for a long time, the publish queue
+ * overflows. Instead of discarding its oldest records, the queue moves them
+ * to this log of PUBLISH_STORE_SIZE records in flash (Coffee on the external
+ * flash of the SensorTag, plain files on the native target). The log holds
+ * the records that precede those in the RAM queue, and they are published
+ * first when a MQTT session is available again.
+ *
+ * Records are written in blocks of PUBLISH_BATCH_SIZE records, each in its
+ * own segment file, and a segment file is removed as soon as all its
+ * records have been published or discarded. Coffee cannot overwrite data in
+ * place: rewriting a file goes through its micro log, and a full micro log
+ * forces the whole file to be copied. Segment files are therefore only
+ * written once, from the start of a file reserved at its final size, and
+ * never modified: the flash is only erased when the garbage collector of
+ * Coffee reclaims the sectors of removed segments, roughly once every time
+ * the whole file system has been written.
+ *
+ * The log survives a reboot. Each segment file ends with a trailer written
+ * last, so that a segment cut short by a reset is recognized and removed,
+ * and the position of the log is found again at startup from the records
+ * themselves: each is stamped with the number of the boot it was created in
+ * (a counter kept in PUBLISH_STORE_BOOT_FILE) besides its uptime, which
+ * orders the records across reboots and is reported in the messages. The
+ * records of the oldest segment already published before a reboot are
+ * published again, and those still in the RAM queue are lost. Only one
+ * segment of records is cached in RAM while reading.
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#ifndef _PUBLISH_STORE_H_
+#define _PUBLISH_STORE_H_
+
+#include "contiki.h"
+#include "publish-queue.h"
+
+
+/** Enables the log. Used only when records are queued: the functions of
+ * the module exist only if PUBLISH_BATCHING is enabled too. */
+#ifdef PUBLISH_CONF_STORE
+#define PUBLISH_STORE PUBLISH_CONF_STORE
+#else
+#define PUBLISH_STORE 0
+#endif
+
+/** The capacity of the log, in records, a multiple of PUBLISH_BATCH_SIZE.
+ * When the log is full, its oldest segment is discarded. */
+#ifdef PUBLISH_CONF_STORE_SIZE
+#define PUBLISH_STORE_SIZE PUBLISH_CONF_STORE_SIZE
+#else
+#define PUBLISH_STORE_SIZE (128 * PUBLISH_BATCH_SIZE)
+#endif
+
+/** The prefix of the names of the segment files of the log, followed by
+ * the index of the segment. */
+#define PUBLISH_STORE_FILE "pd-records"
+/** The name of the file of the boot counter. */
+#define PUBLISH_STORE_BOOT_FILE "pd-boot"
+
+
+/** Increments the boot counter, and opens the log left by the previous
+ * boots, removing its segment files which are corrupt.
+ * @returns 0 on success, -1 if the boot counter cannot be updated. Segments
+ *          which cannot be written are reported by publish_store_append(). */
+int publish_store_init(void);
+
+/** Returns the number of the current boot, which the records are stamped
+ * with.
+ * @returns The number of the boot, starting from 1, or 0 if the log is not
+ *          usable. */
+uint16_t publish_store_boot(void);
+
+/** Appends records to the log as a new segment, discarding the oldest
+ * segments if there is not enough room.
+ * @param r The records, oldest first.
+ * @param n The number of records, at most PUBLISH_BATCH_SIZE.
+ * @returns The number of records discarded, including those in r if they
+ *          could not be written. */
+int publish_store_append(const publish_record_t *r, int n);
+
+/** Returns the number of records in the log.
+ * @returns The number of records. */
+int publish_store_count(void);
+
+/** Returns a record in the log.
+ * @param i The index of the record, where 0 is the oldest one.
+ * @returns The record, or NULL if i is out of range or it could not be
+ *          read. The record is valid until the next call. */
+const publish_record_t *publish_store_get(int i);
+
+/** Removes the oldest records from the log.
+ * @param n The number of records to remove. */
+void publish_store_release(int n);
+
+
+#endif
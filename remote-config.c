@@ -0,0 +1,266 @@
+/** @file
+ * @brief Remote configuration of the runtime parameters implementation
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "sys/log.h"
+#include "remote-config.h"
+
+#if REMOTE_CONFIG_ENABLED
+
+
+#define LOG_MODULE "Remote Config"
+#ifdef LOG_CONF_LEVEL_REMOTE_CONFIG
+#define LOG_LEVEL  LOG_CONF_LEVEL_REMOTE_CONFIG
+#else
+#define LOG_LEVEL  LOG_LEVEL_ERR
+#endif
+
+
+#ifndef MQTT_SUBSCRIBE_CMD_TYPE
+#define MQTT_SUBSCRIBE_CMD_TYPE "+"
+#endif
+
+/** The maximum length of a command. */
+#define MAX_COMMAND_LENGTH 64
+/** Identifies the file of the configuration and its layout. */
+#define FILE_MAGIC 0xC0F1
+
+
+remote_config_t remote_config;
+
+/** The configuration as stored in the file. */
+typedef struct {
+  uint16_t magic;
+  remote_config_t config;
+} stored_config_t;
+
+/** The confirmation of the last command. */
+static struct {
+  /** 1 if the confirmation has not been acknowledged yet. */
+  uint8_t pending;
+  uint8_t status;
+  uint16_t version;
+} confirmation;
+
+/** The time of the next subscription. */
+static struct timer next_check;
+/** 1 after the first subscription. */
+static uint8_t checked;
+
+
+/** Sets the parameters of project-conf.h. */
+static void load_defaults(remote_config_t *c)
+{
+  memset(c, 0, sizeof(*c));
+  c->k = K;
+  c->g = G;
+  c->movement_period = MOVEMENT_PERIOD;
+  c->t_mod = T_MOD;
+  c->t_dmod = T_DMOD;
+  #ifdef CLIENT_RADIO_POWER_CONF
+  c->tx_power = CLIENT_RADIO_POWER_CONF;
+  #endif
+}
+
+
+/** Writes the current configuration to the file.
+ * @returns 0 on success, -1 on error. */
+static int store(void)
+{
+  stored_config_t s = { FILE_MAGIC, remote_config };
+
+  cfs_remove(REMOTE_CONFIG_FILE);
+  int fd = cfs_open(REMOTE_CONFIG_FILE, CFS_WRITE);
+  if (fd < 0)
+    return -1;
+  int len = cfs_write(fd, &s, sizeof(s));
+  cfs_close(fd);
+  return len == sizeof(s) ? 0 : -1;
+}
+
+
+/** Converts a time in milliseconds to clock ticks, without overflowing.
+ * @param ms  The time in milliseconds.
+ * @param min The minimum time allowed, in clock ticks.
+ * @param max The maximum time allowed, in clock ticks.
+ * @param t   The time in clock ticks.
+ * @returns 0 if the time is in range, -1 otherwise. */
+static int to_ticks(long ms, clock_time_t min, clock_time_t max,
+                    clock_time_t *t)
+{
+  if (ms < 0 || (unsigned long)ms / 1000 > max / CLOCK_SECOND)
+    return -1;
+  *t = (clock_time_t)((unsigned long)ms / 1000 * CLOCK_SECOND +
+                      (unsigned long)ms % 1000 * CLOCK_SECOND / 1000);
+  return *t >= min && *t <= max ? 0 : -1;
+}
+
+
+/** Parses and validates a command.
+ * @param cmd The command, null terminated.
+ * @param c   The configuration to update.
+ * @returns REMOTE_CONFIG_OK, or the error found. */
+static remote_config_status_t parse(char *cmd, remote_config_t *c)
+{
+  int has_version = 0;
+  char *s = cmd, *end;
+
+  while (*s != '\0') {
+    char key = *s++;
+    if (*s++ != '=' || (!has_version && key != 'v'))
+      return REMOTE_CONFIG_ERR_SYNTAX;
+    long v = strtol(s, &end, 10);
+    if (end == s || (*end != ',' && *end != '\0'))
+      return REMOTE_CONFIG_ERR_SYNTAX;
+    s = *end == ',' ? end + 1 : end;
+
+    int err = 0;
+    switch (key) {
+      case 'v':
+        err = v < 1 || v > UINT16_MAX;
+        c->version = v;
+        has_version = 1;
+        break;
+      case 'k':
+        err = to_ticks(v, REMOTE_CONFIG_K_MIN, REMOTE_CONFIG_K_MAX, &c->k);
+        break;
+      case 'g':
+        err = to_ticks(v, 0, REMOTE_CONFIG_G_MAX, &c->g);
+        break;
+      case 'p':
+        err = to_ticks(v, MOVEMENT_PERIOD / 2, MOVEMENT_PERIOD_MAX_MOVING,
+                       &c->movement_period);
+        break;
+      case 'm':
+        err = v < 1 || v > REMOTE_CONFIG_T_MAX;
+        c->t_mod = v;
+        break;
+      case 'd':
+        err = v < 1 || v > REMOTE_CONFIG_T_MAX;
+        c->t_dmod = v;
+        break;
+      case 't':
+        err = v < REMOTE_CONFIG_TX_POWER_MIN || v > REMOTE_CONFIG_TX_POWER_MAX;
+        c->tx_power = v;
+        break;
+      default:
+        return REMOTE_CONFIG_ERR_SYNTAX;
+    }
+    if (err)
+      return REMOTE_CONFIG_ERR_RANGE;
+  }
+  return has_version ? REMOTE_CONFIG_OK : REMOTE_CONFIG_ERR_SYNTAX;
+}
+
+
+void remote_config_init(void)
+{
+  stored_config_t s;
+  int len = -1;
+
+  load_defaults(&remote_config);
+  int fd = cfs_open(REMOTE_CONFIG_FILE, CFS_READ);
+  if (fd >= 0) {
+    len = cfs_read(fd, &s, sizeof(s));
+    cfs_close(fd);
+  }
+  if (len == sizeof(s) && s.magic == FILE_MAGIC) {
+    remote_config = s.config;
+    LOG_INFO("loaded version %u\n", remote_config.version);
+  }
+}
+
+
+char *remote_config_topic(const char *client_id)
+{
+  static char topic[sizeof(REMOTE_CONFIG_TOPIC_PREFIX) + 2*6 + 1 +
+                    sizeof(MQTT_SUBSCRIBE_CMD_TYPE)];
+
+  snprintf(topic, sizeof(topic), "%s%s/%s", REMOTE_CONFIG_TOPIC_PREFIX,
+           client_id, MQTT_SUBSCRIBE_CMD_TYPE);
+  return topic;
+}
+
+
+int remote_config_due(void)
+{
+  return !checked || timer_expired(&next_check);
+}
+
+
+void remote_config_subscribed(void)
+{
+  checked = 1;
+  timer_set(&next_check, REMOTE_CONFIG_INTERVAL);
+  LOG_DBG("subscribed\n");
+}
+
+
+int remote_config_receive(const char *topic, const uint8_t *payload, int len)
+{
+  static const char type[] = "/" REMOTE_CONFIG_COMMAND;
+  char cmd[MAX_COMMAND_LENGTH + 1];
+  int topic_len = strlen(topic);
+  remote_config_t c = remote_config;
+  remote_config_status_t status;
+
+  if (topic_len < sizeof(type) - 1 ||
+      strcmp(topic + topic_len - (sizeof(type) - 1), type) != 0) {
+    LOG_WARN("unknown command \"%s\"\n", topic);
+    return 0;
+  }
+
+  if (len > MAX_COMMAND_LENGTH) {
+    status = REMOTE_CONFIG_ERR_SYNTAX;
+  } else {
+    memcpy(cmd, payload, len);
+    cmd[len] = '\0';
+    status = parse(cmd, &c);
+    /* A retained command is received again at each subscription */
+    if (status == REMOTE_CONFIG_OK && c.version == remote_config.version)
+      return 0;
+  }
+
+  if (status == REMOTE_CONFIG_OK) {
+    remote_config = c;
+    if (store() < 0)
+      status = REMOTE_CONFIG_ERR_STORE;
+  } else if (c.version == confirmation.version) {
+    /* Do not confirm a rejected command again */
+    return 0;
+  }
+
+  confirmation.pending = 1;
+  confirmation.status = status;
+  confirmation.version = c.version;
+  if (status == REMOTE_CONFIG_OK || status == REMOTE_CONFIG_ERR_STORE)
+    LOG_INFO("applied version %u (status %d)\n", c.version, status);
+  else
+    LOG_WARN("rejected version %u (status %d)\n", c.version, status);
+  return status == REMOTE_CONFIG_OK || status == REMOTE_CONFIG_ERR_STORE;
+}
+
+
+int remote_config_confirmation(uint16_t *version, uint8_t *status)
+{
+  *version = confirmation.version;
+  *status = confirmation.status;
+  return confirmation.pending;
+}
+
+
+void remote_config_confirmed(uint16_t version)
+{
+  if (confirmation.pending && confirmation.version == version)
+    confirmation.pending = 0;
+}
+
+
+#endif
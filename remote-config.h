@@ -0,0 +1,184 @@
+/** @file
+ * @brief Remote configuration of the runtime parameters
+ *
+ * K, G, MOVEMENT_PERIOD, T_MOD, T_DMOD and the default TX power
+ * (CLIENT_RADIO_POWER_CONF) can be changed without reflashing, by a command
+ * published to the topic
+ *
+ *   REMOTE_CONFIG_TOPIC_PREFIX <client id> "/" REMOTE_CONFIG_COMMAND
+ *
+ * The client subscribes to REMOTE_CONFIG_TOPIC_PREFIX <client id> "/"
+ * MQTT_SUBSCRIBE_CMD_TYPE only while it is connected to publish anyway: once
+ * per MQTT session, and at most once every REMOTE_CONFIG_INTERVAL. The first
+ * message is published once the subscription is acknowledged, so that the
+ * commands retained by the broker, or queued in a persistent session, arrive
+ * while waiting for its acknowledgement. Commands must therefore be
+ * published retained (or with QoS 1 to a persistent session).
+ *
+ * A command is a compact list of key=value pairs separated by commas, e.g.
+ * "v=3,k=30000,p=2000". The key v, the version of the configuration (1 to
+ * 65535), is mandatory and comes first; the other keys are optional, and the
+ * parameters not listed keep their current value:
+ *
+ *   key  parameter          unit  range
+ *   k    K                  ms    REMOTE_CONFIG_K_MIN to REMOTE_CONFIG_K_MAX
+ *   g    G                  ms    0 to REMOTE_CONFIG_G_MAX
+ *   p    MOVEMENT_PERIOD    ms    MOVEMENT_PERIOD / 2 to
+ *                                 MOVEMENT_PERIOD_MAX_MOVING
+ *   m    T_MOD                    1 to REMOTE_CONFIG_T_MAX
+ *   d    T_DMOD                   1 to REMOTE_CONFIG_T_MAX
+ *   t    TX power           dBm   REMOTE_CONFIG_TX_POWER_MIN to
+ *                                 REMOTE_CONFIG_TX_POWER_MAX
+ *
+ * A command with the version already applied is ignored, so that a retained
+ * command is applied once. Otherwise the whole command is either applied
+ * or rejected, and the version is confirmed with its outcome (a
+ * remote_config_status_t) by the next message published, until it is
+ * acknowledged. The configuration applied is stored in a file (Coffee on
+ * the external flash of the SensorTag, a plain file on the native target)
+ * and loaded at startup.
+ *
+ * The values derived from the parameters at build time (such as K_SLACK,
+ * PUBLISH_CONF_BATCH_MAX_AGE or the maximum reading periods) do not change.
+ * Only MQTT is supported, not MQTT-SN.
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#ifndef _REMOTE_CONFIG_H_
+#define _REMOTE_CONFIG_H_
+
+#include "contiki.h"
+
+
+/** Enables the remote configuration. When 0, the parameters are the
+ * constants of project-conf.h. */
+#ifdef REMOTE_CONFIG_CONF_ENABLED
+#define REMOTE_CONFIG_ENABLED REMOTE_CONFIG_CONF_ENABLED
+#else
+#define REMOTE_CONFIG_ENABLED 0
+#endif
+
+/** The prefix of the command topics, followed by the client id. */
+#ifdef REMOTE_CONFIG_CONF_TOPIC_PREFIX
+#define REMOTE_CONFIG_TOPIC_PREFIX REMOTE_CONFIG_CONF_TOPIC_PREFIX
+#else
+#define REMOTE_CONFIG_TOPIC_PREFIX "iot/cmd/"
+#endif
+
+/** The command type of the configuration commands (the last level of the
+ * topic). */
+#define REMOTE_CONFIG_COMMAND "config"
+
+/** The minimum time between two subscriptions, when the broker does not
+ * keep the session. */
+#ifdef REMOTE_CONFIG_CONF_INTERVAL
+#define REMOTE_CONFIG_INTERVAL REMOTE_CONFIG_CONF_INTERVAL
+#else
+#define REMOTE_CONFIG_INTERVAL (3600UL * CLOCK_SECOND)
+#endif
+
+/** The range of K. The minimum keeps K_SLACK within half the period, and
+ * is at least a second. */
+#define REMOTE_CONFIG_K_MIN MAX(2 * K_SLACK, CLOCK_SECOND)
+#define REMOTE_CONFIG_K_MAX (8 * K)
+/** The maximum of G. */
+#define REMOTE_CONFIG_G_MAX (600UL * CLOCK_SECOND)
+/** The maximum of T_MOD and T_DMOD. */
+#define REMOTE_CONFIG_T_MAX 100000L
+/** The range of the TX power, in dBm. */
+#define REMOTE_CONFIG_TX_POWER_MIN (-30)
+#define REMOTE_CONFIG_TX_POWER_MAX 20
+
+/** The name of the file of the configuration. */
+#define REMOTE_CONFIG_FILE "pd-config"
+
+
+/** The outcome of a command, as confirmed in the messages published. */
+typedef enum {
+  /** Applied and stored. */
+  REMOTE_CONFIG_OK = 0,
+  /** Not a list of key=value pairs, unknown key, or no version. */
+  REMOTE_CONFIG_ERR_SYNTAX,
+  /** A value out of range. */
+  REMOTE_CONFIG_ERR_RANGE,
+  /** Applied, but it could not be stored. */
+  REMOTE_CONFIG_ERR_STORE
+} remote_config_status_t;
+
+/** The runtime parameters. */
+typedef struct {
+  /** The version of the configuration, 0 for the defaults. */
+  uint16_t version;
+  clock_time_t k;
+  clock_time_t g;
+  clock_time_t movement_period;
+  int32_t t_mod;
+  int32_t t_dmod;
+  int8_t tx_power;
+} remote_config_t;
+
+
+#if REMOTE_CONFIG_ENABLED
+
+/** The parameters in use. */
+extern remote_config_t remote_config;
+
+#define REMOTE_CONFIG_K               (remote_config.k)
+#define REMOTE_CONFIG_G               (remote_config.g)
+#define REMOTE_CONFIG_MOVEMENT_PERIOD (remote_config.movement_period)
+#define REMOTE_CONFIG_T_MOD           (remote_config.t_mod)
+#define REMOTE_CONFIG_T_DMOD          (remote_config.t_dmod)
+#define REMOTE_CONFIG_TX_POWER        (remote_config.tx_power)
+
+/** Loads the stored configuration, or the defaults if there is none. */
+void remote_config_init(void);
+
+/** Builds the topic filter to subscribe to.
+ * @param client_id The client id.
+ * @returns The topic filter. The string is a shared buffer. */
+char *remote_config_topic(const char *client_id);
+
+/** Returns whether the commands should be checked, that is if
+ * REMOTE_CONFIG_INTERVAL has elapsed since the last subscription. */
+int remote_config_due(void);
+
+/** Notifies that the subscription has been acknowledged. */
+void remote_config_subscribed(void);
+
+/** Handles a message received on the command topics.
+ * @param topic   The topic of the message.
+ * @param payload The payload.
+ * @param len     The length of the payload.
+ * @returns 1 if a new configuration has been applied, 0 otherwise. */
+int remote_config_receive(const char *topic, const uint8_t *payload, int len);
+
+/** Returns the confirmation to publish, if any.
+ * @param version The version of the last command.
+ * @param status  Its outcome.
+ * @returns 1 if the command must be confirmed, 0 otherwise. */
+int remote_config_confirmation(uint16_t *version, uint8_t *status);
+
+/** Notifies that a message with a confirmation has been acknowledged.
+ * @param version The version confirmed. */
+void remote_config_confirmed(uint16_t version);
+
+#else
+
+#define REMOTE_CONFIG_K               K
+#define REMOTE_CONFIG_G               G
+#define REMOTE_CONFIG_MOVEMENT_PERIOD MOVEMENT_PERIOD
+#define REMOTE_CONFIG_T_MOD           T_MOD
+#define REMOTE_CONFIG_T_DMOD          T_DMOD
+#ifdef CLIENT_RADIO_POWER_CONF
+#define REMOTE_CONFIG_TX_POWER        CLIENT_RADIO_POWER_CONF
+#else
+#define REMOTE_CONFIG_TX_POWER        0
+#endif
+
+#define remote_config_init()
+
+#endif
+
+
+#endif
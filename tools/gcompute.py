@@ -43,7 +43,7 @@ for msg in content:
     data = json.loads(msg)
     accel = json.loads('[' + data['last_accel'] + ']')
   
-    gravity = 99
+    gravity = 100
     modulo = abs(accel[0]**2 + accel[1]**2 + accel[2]**2 - gravity**2)
     alfa = atan2(accel[1], accel[0])
     gamma = atan2(-accel[0], sqrt(accel[1]**2 + accel[2]**2))
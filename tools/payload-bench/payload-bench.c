@@ -0,0 +1,353 @@
+/** @file
+ * @brief Microbenchmark of the MQTT message payload encoder.
+ *
+ * Encodes random messages, with and without queued records, the period and
+ * battery voltage, the boot and the confirmation of a remote configuration
+ * command, both with payload_encode() and with the snprintf-based JSON encoder it
+ * replaced, checks that the two produce the same bytes and the same result
+ * for every buffer size, and reports the average time taken by each to
+ * encode a message. The publish queue is replaced by a static array of
+ * records.
+ *
+ * When built for the binary format (make FORMAT=PUBLISH_FORMAT_BINARY),
+ * each binary payload is decoded back, like tools/payload-decode.py does,
+ * and the JSON rendering of the decoded message is compared with the one of
+ * the original message instead.
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#include <stdlib.h>
+#include <time.h>
+#include "movement.h"
+#include "payload.h"
+
+
+/* Value of the acceleration after a read error */
+#define READING_ERROR ((int)0x80000000)
+/* Number of different messages encoded */
+#define N_MESSAGES    256
+
+
+static publish_record_t records[PUBLISH_BATCH_SIZE];
+static payload_t messages[N_MESSAGES][PUBLISH_BATCH_SIZE + 1];
+/** The records returned by publish_queue_get(). */
+static const publish_record_t *queue = records;
+
+
+const publish_record_t *publish_queue_get(int i)
+{
+  return &queue[i];
+}
+
+
+/** The JSON encoder based on snprintf, as found before payload_encode(). */
+static int reference_encode(uint8_t *buf, int size, const payload_t *p)
+{
+  char *s = (char *)buf;
+  int len;
+
+  len = snprintf(s, size,
+    "{"
+      "\"client_id\":\"%02x%02x%02x%02x%02x%02x\","
+      "\"seq_nr_value\":%d,"
+      "\"last_accel\":[%d, %d, %d],"
+      "\"curr_radio_rssi\":%d,"
+      "\"curr_radio_power_dbm\":%d,"
+      "\"uptime\":%lu.%02u",
+    p->client_id[0], p->client_id[1], p->client_id[2],
+    p->client_id[3], p->client_id[4], p->client_id[5],
+    p->seq,
+    p->acc[LAST_ACC_X], p->acc[LAST_ACC_Y], p->acc[LAST_ACC_Z],
+    p->rssi,
+    p->tx_power,
+    (unsigned long)(p->uptime / CLOCK_SECOND),
+    (unsigned)((p->uptime % CLOCK_SECOND) * 100 / CLOCK_SECOND));
+
+  if (p->period != 0 && len < size) {
+    len += snprintf(s + len, size - len, ",\"period\":%lu.%02u,\"battery\":%d",
+      (unsigned long)(p->period / CLOCK_SECOND),
+      (unsigned)((p->period % CLOCK_SECOND) * 100 / CLOCK_SECOND),
+      p->battery);
+  }
+  if (p->boot != 0 && len < size) {
+    len += snprintf(s + len, size - len, ",\"boot\":%u", p->boot);
+  }
+  if (p->config_version != 0 && len < size) {
+    len += snprintf(s + len, size - len, ",\"config\":[%u,%u]",
+      p->config_version, p->config_status);
+  }
+  if (p->n_records > 0 && len < size) {
+    len += snprintf(s + len, size - len, ",\"records\":[");
+  }
+  for (int i=0; i<p->n_records && len<size; i++) {
+    const publish_record_t *r = publish_queue_get(i);
+    len += snprintf(s + len, size - len,
+      "%s[%lu.%02u,%d,%d,%d,%d", i > 0 ? "," : "",
+      (unsigned long)(r->time / CLOCK_SECOND),
+      (unsigned)((r->time % CLOCK_SECOND) * 100 / CLOCK_SECOND),
+      r->type, r->acc[LAST_ACC_X], r->acc[LAST_ACC_Y], r->acc[LAST_ACC_Z]);
+    if (p->boot != 0 && len < size) {
+      len += snprintf(s + len, size - len, ",%u", r->boot);
+    }
+    if (len < size) {
+      len += snprintf(s + len, size - len, "]");
+    }
+  }
+  if (p->n_records > 0 && len < size) {
+    len += snprintf(s + len, size - len, "]");
+  }
+  if (len < size) {
+    len += snprintf(s + len, size - len, "}");
+  }
+  return len < size ? len : -1;
+}
+
+
+/** Returns a random acceleration, sometimes a read error. */
+static int random_acc(void)
+{
+  switch (rand() % 16) {
+    case 0:
+      return READING_ERROR;
+    case 1:
+      return rand() % 4096 - 2048;
+    default:
+      return rand() % 400 - 200;
+  }
+}
+
+
+/** Fills the records and the messages with random values. */
+static void generate(void)
+{
+  uint8_t client_id[6] = { 0x00, 0x12, 0x4b, 0x5e, 0x26, 0x06 };
+
+  for (int i=0; i<PUBLISH_BATCH_SIZE; i++) {
+    records[i].time = (clock_time_t)rand() * 37 % (30 * 24 * 3600UL * 1000);
+    records[i].type = rand() % 3;
+    records[i].boot = rand() % 65535 + 1;
+    for (int j=0; j<3; j++)
+      records[i].acc[j] = random_acc();
+  }
+
+  for (int i=0; i<N_MESSAGES; i++) {
+    for (int n=0; n<=PUBLISH_BATCH_SIZE; n++) {
+      payload_t *p = &messages[i][n];
+      memcpy(p->client_id, client_id, sizeof(client_id));
+      p->seq = rand() % 65536;
+      for (int j=0; j<3; j++)
+        p->acc[j] = random_acc();
+      p->rssi = rand() % 8 ? -(rand() % 100) : -1000;
+      p->tx_power = rand() % 8 ? rand() % 12 - 6 : -1000;
+      p->uptime = (clock_time_t)rand() * 37 % (30 * 24 * 3600UL * 1000);
+      /* Whole seconds, as in the binary layout */
+      p->period = rand() % 2 ? (rand() % 3600 + 1) * CLOCK_SECOND : 0;
+      p->battery = rand() % 8 ? rand() % 1400 + 2000 : -1;
+      p->config_version = rand() % 2 ? rand() % 65535 + 1 : 0;
+      p->config_status = rand() % 4;
+      p->boot = rand() % 2 ? rand() % 65535 + 1 : 0;
+      p->n_records = n;
+    }
+  }
+}
+
+
+#if PUBLISH_FORMAT == PUBLISH_FORMAT_BINARY
+
+/** Reads a 16 bit value in little endian order. */
+static uint16_t get16(const uint8_t *p)
+{
+  return p[0] | p[1] << 8;
+}
+
+
+/** Reads a 32 bit value in little endian order. */
+static uint32_t get32(const uint8_t *p)
+{
+  return get16(p) | (uint32_t)get16(p + 2) << 16;
+}
+
+
+/** Converts a time from hundredths of second. */
+static clock_time_t from_centiseconds(uint32_t cs)
+{
+  return (clock_time_t)(cs / 100) * CLOCK_SECOND +
+         (clock_time_t)(cs % 100) * CLOCK_SECOND / 100;
+}
+
+
+/** Decodes a 16 bit acceleration, mapping INT16_MIN to READING_ERROR. */
+static int acc16(const uint8_t *p)
+{
+  int16_t v = get16(p);
+  return v == INT16_MIN ? READING_ERROR : v;
+}
+
+
+/** Decodes a binary payload, like tools/payload-decode.py.
+ * @param buf The payload.
+ * @param len The length of the payload.
+ * @param p   The decoded message.
+ * @param r   The decoded records.
+ * @returns 0, or -1 if the length does not match the contents. */
+static int decode(const uint8_t *buf, int len, payload_t *p,
+                  publish_record_t *r)
+{
+  const uint8_t *q = buf;
+  int version = *q++;
+  int boot = version > PAYLOAD_BINARY_VERSION_CONFIG +
+                       PAYLOAD_BINARY_VERSION_PERIOD;
+
+  memset(p, 0, sizeof(*p));
+  p->n_records = *q++;
+  memcpy(p->client_id, q, sizeof(p->client_id));
+  q += sizeof(p->client_id);
+  p->seq = get16(q);
+  q += 2;
+  for (int i=0; i<3; i++, q += 2)
+    p->acc[i] = acc16(q);
+  p->rssi = (int8_t)*q++;
+  p->tx_power = (int8_t)*q++;
+  if (p->rssi == INT8_MIN)
+    p->rssi = -1000;
+  if (p->tx_power == INT8_MIN)
+    p->tx_power = -1000;
+  p->uptime = from_centiseconds(get32(q));
+  q += 4;
+  if (boot)
+    version -= PAYLOAD_BINARY_VERSION_BOOT;
+  if (version > PAYLOAD_BINARY_VERSION_CONFIG) {
+    p->period = get16(q) * CLOCK_SECOND;
+    p->battery = get16(q + 2) ? get16(q + 2) : -1;
+    q += PAYLOAD_BINARY_PERIOD_LEN;
+    version -= PAYLOAD_BINARY_VERSION_PERIOD;
+  }
+  if (boot) {
+    p->boot = get16(q);
+    q += PAYLOAD_BINARY_BOOT_LEN;
+  }
+  if (version == PAYLOAD_BINARY_VERSION_CONFIG) {
+    p->config_version = get16(q);
+    p->config_status = q[2];
+    q += PAYLOAD_BINARY_CONFIG_LEN;
+  }
+  for (int i=0; i<p->n_records; i++) {
+    r[i].type = *q++;
+    for (int j=0; j<3; j++, q += 2)
+      r[i].acc[j] = acc16(q);
+    r[i].time = from_centiseconds(get32(q));
+    q += 4;
+    if (boot) {
+      r[i].boot = get16(q);
+      q += PAYLOAD_BINARY_BOOT_LEN;
+    }
+  }
+  return q - buf == len ? 0 : -1;
+}
+
+
+/** Checks that every binary payload decodes to the message encoded, by
+ * comparing the JSON renderings of the two, and that payload_encode() fails
+ * exactly when the buffer is too short.
+ * @returns The number of mismatches. */
+static int check(void)
+{
+  static uint8_t bin[PAYLOAD_MAX_LENGTH * 2];
+  static char a[PAYLOAD_MAX_LENGTH * 8], b[PAYLOAD_MAX_LENGTH * 8];
+  publish_record_t decoded_records[PUBLISH_BATCH_SIZE];
+  payload_t decoded;
+  int errors = 0;
+
+  for (int i=0; i<N_MESSAGES; i++) {
+    for (int n=0; n<=PUBLISH_BATCH_SIZE; n++) {
+      const payload_t *p = &messages[i][n];
+      int len = payload_encode(bin, sizeof(bin), p);
+      int ok = len > 0 && payload_encode(bin, len - 1, p) < 0 &&
+               payload_encode(bin, len, p) == len &&
+               decode(bin, len, &decoded, decoded_records) == 0;
+      reference_encode((uint8_t *)a, sizeof(a), p);
+      queue = decoded_records;
+      reference_encode((uint8_t *)b, sizeof(b), &decoded);
+      queue = records;
+      if (!ok || strcmp(a, b) != 0) {
+        if (errors++ == 0)
+          fprintf(stderr, "mismatch of %d bytes:\n  %s\n  %s\n", len, a, b);
+      }
+    }
+  }
+  return errors;
+}
+
+#else
+
+/** Checks that payload_encode() and reference_encode() agree on every
+ * message and every buffer size.
+ * @returns The number of mismatches. */
+static int check(void)
+{
+  static uint8_t a[PAYLOAD_MAX_LENGTH * 2], b[PAYLOAD_MAX_LENGTH * 2];
+  int errors = 0;
+
+  for (int i=0; i<N_MESSAGES; i++) {
+    for (int n=0; n<=PUBLISH_BATCH_SIZE; n++) {
+      const payload_t *p = &messages[i][n];
+      int len = reference_encode(b, sizeof(b), p);
+      for (int size = len + 1; size >= (i == 0 ? 0 : len); size--) {
+        int la = payload_encode(a, size, p);
+        int lb = reference_encode(b, size, p);
+        if (la != lb || (la >= 0 && memcmp(a, b, la + 1) != 0)) {
+          if (errors++ == 0)
+            fprintf(stderr, "mismatch at size %d:\n  %.*s\n  %.*s\n", size,
+                    MAX(la, 0), (char *)a, MAX(lb, 0), (char *)b);
+        }
+      }
+    }
+  }
+  return errors;
+}
+
+#endif
+
+
+/** @returns The average time in ns taken by an encoder per message. */
+static double measure(int (*encode)(uint8_t *, int, const payload_t *),
+                      int n_records, long iterations, int *total)
+{
+  static uint8_t buf[PAYLOAD_MAX_LENGTH];
+  struct timespec t0, t1;
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (long k=0; k<iterations; k++)
+    *total += encode(buf, sizeof(buf), &messages[k % N_MESSAGES][n_records]);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  return ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) /
+         iterations;
+}
+
+
+int main(int argc, char *argv[])
+{
+  long iterations = argc > 1 ? atol(argv[1]) : 100000;
+  if (iterations <= 0) {
+    fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+    return 1;
+  }
+
+  generate();
+  int errors = check();
+  printf("%-32s %d\n", "mismatches", errors);
+
+  /* The binary payloads are compared with the JSON ones only for speed */
+  int total = 0;
+  int n_sizes[] = { 0, PUBLISH_BATCH_SIZE };
+  for (int i=0; i<2; i++) {
+    int n = n_sizes[i];
+    double t = measure(payload_encode, n, iterations, &total);
+    double t_ref = measure(reference_encode, n, iterations, &total);
+    printf("%d records: %-21s %.1f ns (snprintf %.1f ns, %.1fx)\n", n,
+           "payload_encode", t, t_ref, t_ref / t);
+  }
+  /* Keeps the encoders from being optimized away */
+  return errors > 0 || total == 0;
+}
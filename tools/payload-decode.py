@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+
+'''
+This tool decodes the binary MQTT payloads published by the client when it
+is built with PUBLISH_CONF_FORMAT set to PUBLISH_FORMAT_BINARY (see
+payload.h), and prints them as the equivalent JSON messages, so that they
+can be processed by the other tools.
+
+The input must contain one message per line, as an hex string optionally
+prefixed by the topic, as printed by:
+
+  mosquitto_sub -t '#' -F '%t %x'
+
+The topic is kept in the output, as printed by `mosquitto_sub -v`.
+'''
+
+import sys
+import struct
+import traceback
+
+VERSION = 1
+# Version of the messages which confirm a remote configuration command
+VERSION_CONFIG = 2
+# Added to the version when the period and battery voltage are reported
+VERSION_PERIOD = 2
+# Added to the version when the boot is reported, in the header and records
+VERSION_BOOT = 4
+HEADER = struct.Struct('<BB6sHhhhbbI')
+PERIOD = struct.Struct('<HH')
+CONFIG = struct.Struct('<HB')
+BOOT = struct.Struct('<H')
+RECORD = struct.Struct('<BhhhI')
+RECORD_BOOT = struct.Struct('<BhhhIH')
+
+# Value of RSSI and TX power when not available
+NOT_AVAILABLE = -1000
+# Value of the acceleration after a read error
+READING_ERROR = -0x80000000
+
+
+def accel(v):
+  return READING_ERROR if v == -0x8000 else v
+
+
+def uptime(cs):
+  return '%d.%02d' % (cs // 100, cs % 100)
+
+
+def decode(payload):
+  (version, n_records, client_id, seq, x, y, z, rssi, tx_power,
+   cs) = HEADER.unpack_from(payload)
+  if (version < VERSION or
+      version > VERSION_CONFIG + VERSION_PERIOD + VERSION_BOOT):
+    raise ValueError('unsupported payload version %d' % version)
+
+  if rssi == -128:
+    rssi = NOT_AVAILABLE
+  if tx_power == -128:
+    tx_power = NOT_AVAILABLE
+
+  msg = ('{"client_id":"%s","seq_nr_value":%d,"last_accel":[%d, %d, %d],'
+         '"curr_radio_rssi":%d,"curr_radio_power_dbm":%d,"uptime":%s' %
+         (client_id.hex(), seq, accel(x), accel(y), accel(z), rssi, tx_power,
+          uptime(cs)))
+
+  offset = HEADER.size
+  boot = version > VERSION_CONFIG + VERSION_PERIOD
+  if boot:
+    version -= VERSION_BOOT
+  if version > VERSION_CONFIG:
+    period, battery = PERIOD.unpack_from(payload, offset)
+    msg += ',"period":%d.00,"battery":%d' % (period, battery or -1)
+    offset += PERIOD.size
+    version -= VERSION_PERIOD
+  if boot:
+    msg += ',"boot":%d' % BOOT.unpack_from(payload, offset)
+    offset += BOOT.size
+  if version == VERSION_CONFIG:
+    config_version, config_status = CONFIG.unpack_from(payload, offset)
+    msg += ',"config":[%d,%d]' % (config_version, config_status)
+    offset += CONFIG.size
+
+  if n_records > 0:
+    records = []
+    for i in range(n_records):
+      if boot:
+        rtype, rx, ry, rz, rcs, rboot = RECORD_BOOT.unpack_from(
+            payload, offset + i*RECORD_BOOT.size)
+        records.append('[%s,%d,%d,%d,%d,%d]' % (uptime(rcs), rtype, accel(rx),
+                                                accel(ry), accel(rz), rboot))
+      else:
+        rtype, rx, ry, rz, rcs = RECORD.unpack_from(payload,
+                                                    offset + i*RECORD.size)
+        records.append('[%s,%d,%d,%d,%d]' % (uptime(rcs), rtype, accel(rx),
+                                             accel(ry), accel(rz)))
+    msg += ',"records":[' + ','.join(records) + ']'
+
+  return msg + '}'
+
+
+if len(sys.argv) > 2:
+  print("usage:", sys.argv[0], "[hex payload log file]")
+  exit(0)
+
+src = open(sys.argv[1]) if len(sys.argv) == 2 else sys.stdin
+for line in src:
+  try:
+    fields = line.split()
+    if len(fields) == 0:
+      continue
+    msg = decode(bytes.fromhex(fields[-1]))
+    if len(fields) > 1:
+      print(fields[0], msg)
+    else:
+      print(msg)
+  except:
+    traceback.print_exc()
@@ -0,0 +1,31 @@
+/** @file
+ * @brief Minimal Contiki File System API used by the virtual clock simulator.
+ *
+ * Files are kept in memory by the simulator, which counts the bytes written.
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#ifndef _SIM_CFS_CFS_H_
+#define _SIM_CFS_CFS_H_
+
+#include "contiki.h"
+
+typedef int cfs_offset_t;
+
+#define CFS_READ      1
+#define CFS_WRITE     2
+#define CFS_APPEND    4
+
+#define CFS_SEEK_SET  0
+#define CFS_SEEK_CUR  1
+#define CFS_SEEK_END  2
+
+int cfs_open(const char *name, int flags);
+void cfs_close(int fd);
+int cfs_read(int fd, void *buf, unsigned int len);
+int cfs_write(int fd, const void *buf, unsigned int len);
+cfs_offset_t cfs_seek(int fd, cfs_offset_t offset, int whence);
+int cfs_remove(const char *name);
+
+#endif
@@ -0,0 +1,222 @@
+/** @file
+ * @brief Minimal Contiki-NG API used by the virtual clock simulator.
+ *
+ * Only the subset of the Contiki-NG API used by the person detection client
+ * is provided. Processes are real protothreads, but timers run on a virtual
+ * clock which is advanced by the simulator directly to the next deadline.
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#ifndef _SIM_CONTIKI_H_
+#define _SIM_CONTIKI_H_
+
+#include "project-conf.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+
+/*
+ * CLOCK
+ */
+
+typedef unsigned long clock_time_t;
+#define CLOCK_SECOND 1000
+
+clock_time_t clock_time(void);
+unsigned long clock_seconds(void);
+
+
+/*
+ * PROTOTHREADS AND PROCESSES
+ */
+
+struct pt {
+  unsigned short lc;
+};
+
+#define PT_WAITING 0
+#define PT_YIELDED 1
+#define PT_EXITED  2
+#define PT_ENDED   3
+
+typedef unsigned char process_event_t;
+typedef void *process_data_t;
+
+struct process {
+  struct process *next;
+  const char *name;
+  char (*thread)(struct pt *, process_event_t, process_data_t);
+  struct pt pt;
+  unsigned char state, needspoll;
+};
+
+#define PROCESS_EVENT_NONE      0x80
+#define PROCESS_EVENT_INIT      0x81
+#define PROCESS_EVENT_POLL      0x82
+#define PROCESS_EVENT_EXIT      0x83
+#define PROCESS_EVENT_CONTINUE  0x85
+#define PROCESS_EVENT_MSG       0x86
+#define PROCESS_EVENT_TIMER     0x88
+#define PROCESS_EVENT_MAX       0x8a
+
+#define PROCESS_BROADCAST NULL
+#define PROCESS_NONE      NULL
+
+#define PROCESS_NAME(name) extern struct process name
+#define PROCESS(name, strname) \
+  static char process_thread_##name(struct pt *process_pt, \
+                                    process_event_t ev, process_data_t data); \
+  struct process name = { NULL, strname, process_thread_##name }
+#define PROCESS_THREAD(name, ev, data) \
+  static char process_thread_##name(struct pt *process_pt, \
+                                    process_event_t ev, process_data_t data)
+
+#define PROCESS_BEGIN() \
+  { char PT_YIELD_FLAG = 1; (void)PT_YIELD_FLAG; \
+    switch(process_pt->lc) { case 0:
+#define PROCESS_END() \
+    } PT_YIELD_FLAG = 0; process_pt->lc = 0; return PT_ENDED; }
+#define PROCESS_YIELD() do { \
+    PT_YIELD_FLAG = 0; process_pt->lc = __LINE__; case __LINE__: \
+    if(PT_YIELD_FLAG == 0) return PT_YIELDED; \
+  } while(0)
+#define PROCESS_WAIT_EVENT() PROCESS_YIELD()
+#define PROCESS_YIELD_UNTIL(c) do { \
+    PT_YIELD_FLAG = 0; process_pt->lc = __LINE__; case __LINE__: \
+    if(PT_YIELD_FLAG == 0 || !(c)) return PT_YIELDED; \
+  } while(0)
+#define PROCESS_WAIT_EVENT_UNTIL(c) PROCESS_YIELD_UNTIL(c)
+#define PROCESS_WAIT_UNTIL(c) do { \
+    process_pt->lc = __LINE__; case __LINE__: \
+    if(!(c)) return PT_WAITING; \
+  } while(0)
+#define PROCESS_EXIT() do { process_pt->lc = 0; return PT_EXITED; } while(0)
+#define PROCESS_PAUSE() do { \
+    process_post(PROCESS_CURRENT(), PROCESS_EVENT_CONTINUE, NULL); \
+    PROCESS_WAIT_EVENT_UNTIL(ev == PROCESS_EVENT_CONTINUE); \
+  } while(0)
+
+#define PROCESS_CURRENT() process_current
+#define PROCESS_CONTEXT_BEGIN(p) { \
+    struct process *tmp_current = PROCESS_CURRENT(); process_current = p
+#define PROCESS_CONTEXT_END(p) process_current = tmp_current; }
+
+#define AUTOSTART_PROCESSES(...) \
+  struct process *const autostart_processes[] = { __VA_ARGS__, NULL }
+
+extern struct process *process_current;
+
+process_event_t process_alloc_event(void);
+int process_post(struct process *p, process_event_t ev, process_data_t data);
+void process_post_synch(struct process *p, process_event_t ev, 
+                        process_data_t data);
+void process_start(struct process *p, process_data_t data);
+void process_exit(struct process *p);
+void process_poll(struct process *p);
+int process_is_running(struct process *p);
+
+
+/*
+ * TIMERS
+ */
+
+struct timer {
+  clock_time_t start;
+  clock_time_t interval;
+};
+
+struct etimer {
+  struct timer timer;
+  struct etimer *next;
+  struct process *p;
+};
+
+struct ctimer {
+  struct etimer etimer;
+  void (*f)(void *);
+  void *ptr;
+};
+
+void timer_set(struct timer *t, clock_time_t interval);
+void timer_reset(struct timer *t);
+void timer_restart(struct timer *t);
+int timer_expired(struct timer *t);
+clock_time_t timer_remaining(struct timer *t);
+
+void etimer_set(struct etimer *et, clock_time_t interval);
+void etimer_reset(struct etimer *et);
+void etimer_reset_with_new_interval(struct etimer *et, clock_time_t interval);
+void etimer_restart(struct etimer *et);
+void etimer_stop(struct etimer *et);
+int etimer_expired(struct etimer *et);
+clock_time_t etimer_expiration_time(struct etimer *et);
+clock_time_t etimer_start_time(struct etimer *et);
+
+void ctimer_set(struct ctimer *c, clock_time_t t, void (*f)(void *), void *ptr);
+void ctimer_reset(struct ctimer *c);
+void ctimer_restart(struct ctimer *c);
+void ctimer_stop(struct ctimer *c);
+int ctimer_expired(struct ctimer *c);
+
+
+/*
+ * MISCELLANEOUS
+ */
+
+#define MAX(n, m)   (((n) < (m)) ? (m) : (n))
+#define MIN(n, m)   (((n) < (m)) ? (n) : (m))
+#define ABS(n)      (((n) < 0) ? -(n) : (n))
+
+typedef union {
+  uint8_t u8[8];
+} linkaddr_t;
+
+extern linkaddr_t linkaddr_node_addr;
+
+
+/*
+ * NETWORK STACK
+ */
+
+typedef int radio_value_t;
+typedef enum {
+  RADIO_RESULT_OK,
+  RADIO_RESULT_NOT_SUPPORTED,
+  RADIO_RESULT_INVALID_VALUE,
+  RADIO_RESULT_ERROR
+} radio_result_t;
+
+enum {
+  RADIO_PARAM_POWER_MODE,
+  RADIO_PARAM_CHANNEL,
+  RADIO_PARAM_TXPOWER,
+  RADIO_PARAM_RSSI,
+  RADIO_PARAM_LAST_RSSI,
+  RADIO_PARAM_LAST_LINK_QUALITY,
+  RADIO_CONST_TXPOWER_MIN,
+  RADIO_CONST_TXPOWER_MAX
+};
+
+struct radio_driver {
+  int (*on)(void);
+  int (*off)(void);
+  radio_result_t (*get_value)(int param, radio_value_t *value);
+  radio_result_t (*set_value)(int param, radio_value_t value);
+};
+
+struct mac_driver {
+  int (*on)(void);
+  int (*off)(void);
+};
+
+extern const struct radio_driver sim_radio_driver;
+extern const struct mac_driver sim_mac_driver;
+#define NETSTACK_RADIO sim_radio_driver
+#define NETSTACK_MAC   sim_mac_driver
+
+
+#endif
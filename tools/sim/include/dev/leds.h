@@ -0,0 +1,13 @@
+#ifndef _SIM_DEV_LEDS_H_
+#define _SIM_DEV_LEDS_H_
+
+#include "contiki.h"
+
+#define LEDS_GREEN  1
+#define LEDS_RED    2
+#define LEDS_YELLOW 4
+
+static inline void leds_init(void) { }
+static inline void leds_set(unsigned char leds) { }
+
+#endif
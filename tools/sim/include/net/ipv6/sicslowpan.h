@@ -0,0 +1,6 @@
+#ifndef _SIM_NET_IPV6_SICSLOWPAN_H_
+#define _SIM_NET_IPV6_SICSLOWPAN_H_
+
+#include "contiki.h"
+
+#endif
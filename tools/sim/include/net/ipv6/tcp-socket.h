@@ -0,0 +1,6 @@
+#ifndef _SIM_NET_IPV6_TCP_SOCKET_H_
+#define _SIM_NET_IPV6_TCP_SOCKET_H_
+
+#include "contiki.h"
+
+#endif
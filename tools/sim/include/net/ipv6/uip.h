@@ -0,0 +1,23 @@
+#ifndef _SIM_NET_IPV6_UIP_H_
+#define _SIM_NET_IPV6_UIP_H_
+
+#include "contiki.h"
+
+typedef union {
+  uint8_t u8[16];
+  uint16_t u16[8];
+} uip_ipaddr_t;
+
+typedef struct {
+  uip_ipaddr_t ipaddr;
+} uip_ds6_addr_t;
+
+#define ADDR_PREFERRED 1
+
+#define uip_ipaddr_copy(dest, src) (*(dest) = *(src))
+#define uip_ipaddr_cmp(addr1, addr2) \
+  (memcmp(addr1, addr2, sizeof(uip_ipaddr_t)) == 0)
+
+uip_ds6_addr_t *uip_ds6_get_global(int8_t state);
+
+#endif
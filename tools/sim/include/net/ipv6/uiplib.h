@@ -0,0 +1,9 @@
+#ifndef _SIM_NET_IPV6_UIPLIB_H_
+#define _SIM_NET_IPV6_UIPLIB_H_
+
+#include "contiki.h"
+#include "net/ipv6/uip.h"
+
+int uiplib_ipaddrconv(const char *addrstr, uip_ipaddr_t *addr);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef _SIM_NET_LINK_STATS_H_
+#define _SIM_NET_LINK_STATS_H_
+
+#include "contiki.h"
+
+#define LINK_STATS_ETX_DIVISOR    128
+
+struct link_stats {
+  clock_time_t last_tx_time;
+  uint16_t etx;
+  int16_t rssi;
+  uint8_t freshness;
+};
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef _SIM_NET_LINKADDR_H_
+#define _SIM_NET_LINKADDR_H_
+
+#include <string.h>
+#include "contiki.h"
+
+static inline int linkaddr_cmp(const linkaddr_t *a, const linkaddr_t *b)
+{
+  return memcmp(a, b, sizeof(linkaddr_t)) == 0;
+}
+
+static inline void linkaddr_copy(linkaddr_t *dest, const linkaddr_t *from)
+{
+  memcpy(dest, from, sizeof(linkaddr_t));
+}
+
+#endif
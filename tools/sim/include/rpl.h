@@ -0,0 +1,46 @@
+#ifndef _SIM_RPL_H_
+#define _SIM_RPL_H_
+
+#include "contiki.h"
+#include "net/ipv6/uip.h"
+#include "net/link-stats.h"
+
+typedef struct rpl_nbr {
+  uip_ipaddr_t ipaddr;
+  linkaddr_t lladdr;
+} rpl_nbr_t;
+
+enum rpl_dag_state {
+  DAG_INITIALIZED,
+  DAG_JOINED,
+  DAG_REACHABLE,
+  DAG_POISONING
+};
+
+typedef struct {
+  uip_ipaddr_t dag_id;
+  rpl_nbr_t *preferred_parent;
+  enum rpl_dag_state state;
+} rpl_dag_t;
+
+typedef struct {
+  rpl_dag_t dag;
+  uint8_t used;
+} rpl_instance_t;
+
+extern rpl_instance_t curr_instance;
+
+#define RPL_WITH_PROBING 1
+
+int rpl_is_reachable(void);
+void rpl_dag_leave(void);
+uip_ipaddr_t *rpl_neighbor_get_ipaddr(rpl_nbr_t *nbr);
+const linkaddr_t *rpl_neighbor_get_lladdr(rpl_nbr_t *nbr);
+const struct link_stats *rpl_neighbor_get_link_stats(rpl_nbr_t *nbr);
+void rpl_icmp6_dis_output(uip_ipaddr_t *addr);
+void rpl_timers_dio_reset(const char *str);
+void rpl_timers_schedule_dao(void);
+void rpl_timers_stop_dag_timers(void);
+void rpl_schedule_probing(void);
+
+#endif
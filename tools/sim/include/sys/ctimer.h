@@ -0,0 +1,6 @@
+#ifndef _SIM_SYS_CTIMER_H_
+#define _SIM_SYS_CTIMER_H_
+
+#include "contiki.h"
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef _SIM_SYS_ENERGEST_H_
+#define _SIM_SYS_ENERGEST_H_
+
+#include "contiki.h"
+
+typedef enum {
+  ENERGEST_TYPE_CPU,
+  ENERGEST_TYPE_LPM,
+  ENERGEST_TYPE_DEEP_LPM,
+  ENERGEST_TYPE_TRANSMIT,
+  ENERGEST_TYPE_LISTEN,
+  ENERGEST_TYPE_MAX
+} energest_type_t;
+
+/* The simulator only accounts for radio listen time; every other time is
+ * attributed to deep LPM. */
+#define ENERGEST_SECOND           CLOCK_SECOND
+#define ENERGEST_GET_TOTAL_TIME() ((uint64_t)clock_time())
+
+void energest_flush(void);
+uint64_t energest_type_time(energest_type_t type);
+
+#endif
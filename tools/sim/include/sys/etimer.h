@@ -0,0 +1,6 @@
+#ifndef _SIM_SYS_ETIMER_H_
+#define _SIM_SYS_ETIMER_H_
+
+#include "contiki.h"
+
+#endif
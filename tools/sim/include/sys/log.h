@@ -0,0 +1,42 @@
+#ifndef _SIM_SYS_LOG_H_
+#define _SIM_SYS_LOG_H_
+
+#include "contiki.h"
+
+#define LOG_LEVEL_NONE  0
+#define LOG_LEVEL_ERR   1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_INFO  3
+#define LOG_LEVEL_DBG   4
+
+/** Maximum log level printed by the simulator, regardless of the level of
+ * each module. */
+extern int sim_log_level;
+
+#define LOG(level, levelstr, ...) do { \
+    if ((level) <= LOG_LEVEL && (level) <= sim_log_level) { \
+      printf("%8lu [%-4s: %-10s] ", (unsigned long)clock_time(), \
+             levelstr, LOG_MODULE); \
+      printf(__VA_ARGS__); \
+    } \
+  } while (0)
+
+/* Continues a log message, without the prefix */
+#define LOG_(level, ...) do { \
+    if ((level) <= LOG_LEVEL && (level) <= sim_log_level) \
+      printf(__VA_ARGS__); \
+  } while (0)
+
+#define LOG_ERR(...)   LOG(LOG_LEVEL_ERR, "ERR", __VA_ARGS__)
+#define LOG_WARN(...)  LOG(LOG_LEVEL_WARN, "WARN", __VA_ARGS__)
+#define LOG_INFO(...)  LOG(LOG_LEVEL_INFO, "INFO", __VA_ARGS__)
+#define LOG_DBG(...)   LOG(LOG_LEVEL_DBG, "DBG", __VA_ARGS__)
+
+#define LOG_ERR_(...)  LOG_(LOG_LEVEL_ERR, __VA_ARGS__)
+#define LOG_WARN_(...) LOG_(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_INFO_(...) LOG_(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_DBG_(...)  LOG_(LOG_LEVEL_DBG, __VA_ARGS__)
+
+static inline void log_set_level(const char *module, int level) { }
+
+#endif
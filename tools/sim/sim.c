@@ -0,0 +1,1531 @@
+/** @file
+ * @brief Virtual clock simulator of the person detection client.
+ *
+ * Runs client_process and movement_monitor_process, as found in client.c,
+ * against a minimal implementation of the Contiki-NG kernel whose clock
+ * jumps directly to the next timer deadline, and against a stand-in for the
+ * RPL network and the MQTT broker (or MQTT-SN gateway) with fixed latencies. Hours of operation
+ * are simulated in a few seconds, deterministically.
+ *
+ * At the end of the simulation, the movement state transitions, the radio
+ * usage, the samples published, the time from the detection of a stop to the
+ * first publish, the time from the detection of a movement to the radio
+ * being turned off, the records lost, and the wakeups of client_process by
+ * cause are reported. An outage of the network can be simulated, during which
+ * no parent is found.
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "contiki.h"
+#include "sys/log.h"
+#include "sys/energest.h"
+#include "mqtt.h"
+#include "net/ipv6/simple-udp.h"
+#include "net/ipv6/uiplib.h"
+#include "rpl.h"
+#include "cfs/cfs.h"
+#include "publish-store.h"
+
+/* The client is included as a whole to observe its internal state */
+#include "client.c"
+
+
+/* Time needed to join the RPL network and get a global address after the
+ * radio has been turned on */
+#ifndef SIM_JOIN_TIME
+#define SIM_JOIN_TIME         (10 * CLOCK_SECOND)
+#endif
+
+/* Time needed to get a DAO acknowledged by the parent kept from the previous
+ * cycle, after the radio has been turned on */
+#ifndef SIM_REJOIN_TIME
+#define SIM_REJOIN_TIME       (CLOCK_SECOND / 4)
+#endif
+
+/* Percentage of fast rejoins in which the parent kept does not answer, even
+ * if the device did not move */
+#ifndef SIM_REJOIN_FAILURES
+#define SIM_REJOIN_FAILURES   10
+#endif
+
+/* RSSI of the frames of the preferred parent, which transmits at 0 dBm. The
+ * path loss is the same in both directions. */
+#ifndef SIM_PARENT_RSSI
+#define SIM_PARENT_RSSI       (-75)
+#endif
+
+/* RSSI below which the parent starts losing our frames */
+#ifndef SIM_SENSITIVITY
+#define SIM_SENSITIVITY       (-88)
+#endif
+
+/* Round trip time to the MQTT broker */
+#ifndef SIM_MQTT_RTT
+#define SIM_MQTT_RTT          (CLOCK_SECOND / 5)
+#endif
+
+/* Size of each file of the in-memory file system, and number of files */
+#define SIM_CFS_SIZE          (64 * 1024)
+#define SIM_CFS_FILES         160
+
+/* Maximum number of events in the event queue */
+#define SIM_MAX_EVENTS        32
+
+
+int sim_log_level = LOG_LEVEL_NONE;
+linkaddr_t linkaddr_node_addr = { { 0x00, 0x12, 0x4b, 0x00, 0x0d, 0x5e, 0x26, 0x06 } };
+rpl_instance_t curr_instance = { { { { 0xaa, 0xaa } } } };
+
+
+/*
+ * STATISTICS
+ */
+
+/** A set of durations. */
+typedef struct {
+  unsigned long count;
+  clock_time_t sum;
+  clock_time_t max;
+} sim_duration_t;
+
+static struct {
+  unsigned long starts;
+  unsigned long stops;
+  unsigned long radio_cycles;
+  clock_time_t radio_time;
+  unsigned long connects;
+  unsigned long publishes;
+  /** Connections kept open while the radio was off and used again. */
+  unsigned long resumes;
+  /** Resumed connections which the broker did not know anymore. */
+  unsigned long resumes_reset;
+  /** PINGREQs sent by the client, and those sent with the radio off. */
+  unsigned long pings;
+  unsigned long pings_lost;
+  /** Connections closed by the broker after the keep alive interval. */
+  unsigned long keep_alive_expired;
+  unsigned long pubacks;
+  /** Samples carried by the messages acknowledged. */
+  unsigned long samples;
+  /** Total length of the payloads published. */
+  unsigned long payload_bytes;
+  /** Stops after which the user started moving before any publish. */
+  unsigned long stops_unpublished;
+  sim_duration_t to_first_publish;
+  sim_duration_t to_radio_off;
+  /** Fast rejoins of the RPL network kept from the previous cycle. */
+  unsigned long rejoins;
+  /** Fast rejoins which fell back to the discovery of the network. */
+  unsigned long rejoins_failed;
+  sim_duration_t to_join;
+  /** Distinct times at which timers expired, each a wakeup of the MCU. */
+  unsigned long mcu_wakeups;
+  /** Bytes written to the file system, and those which overwrote data
+   * already written (through the micro log of a Coffee file). */
+  unsigned long cfs_bytes_written;
+  unsigned long cfs_bytes_rewritten;
+  /** Sum of the transmission power of the publishes, in dBm. */
+  long tx_power_sum;
+  /** Publishes whose frames were received by the parent with retries. */
+  unsigned long weak_publishes;
+  /** Subscriptions to the command topics. */
+  unsigned long subscribes;
+  /** Commands delivered to the client. */
+  unsigned long commands;
+  /** Publishes which confirm a command. */
+  unsigned long confirmations;
+} stats;
+
+static int last_is_moving = 1;
+static clock_time_t t_stop, t_start;
+static int waiting_publish, waiting_radio_off;
+
+
+static void duration_add(sim_duration_t *d, clock_time_t t)
+{
+  d->count++;
+  d->sum += t;
+  d->max = MAX(d->max, t);
+}
+
+
+static void duration_print(const char *name, sim_duration_t *d)
+{
+  if (d->count == 0) {
+    printf("%-32s n/a\n", name);
+    return;
+  }
+  printf("%-32s avg %.2f s, max %.2f s (%lu samples)\n", name,
+         (double)d->sum / d->count / CLOCK_SECOND,
+         (double)d->max / CLOCK_SECOND, d->count);
+}
+
+
+#define SIM_NEVER ((clock_time_t)-1)
+
+
+/*
+ * CLOCK
+ */
+
+static clock_time_t sim_now = 0;
+
+
+clock_time_t clock_time(void)
+{
+  return sim_now;
+}
+
+
+unsigned long clock_seconds(void)
+{
+  return sim_now / CLOCK_SECOND;
+}
+
+
+/*
+ * PROCESSES
+ */
+
+struct process *process_current = NULL;
+static struct process *process_list = NULL;
+static process_event_t lastevent = PROCESS_EVENT_MAX;
+
+static struct {
+  struct process *p;
+  process_event_t ev;
+  process_data_t data;
+} events[SIM_MAX_EVENTS];
+static int ev_first = 0, ev_count = 0;
+
+#define PROCESS_STATE_NONE    0
+#define PROCESS_STATE_RUNNING 1
+
+
+process_event_t process_alloc_event(void)
+{
+  return lastevent++;
+}
+
+
+int process_is_running(struct process *p)
+{
+  return p->state != PROCESS_STATE_NONE;
+}
+
+
+void process_exit(struct process *p)
+{
+  struct process **q;
+  p->state = PROCESS_STATE_NONE;
+  for (q = &process_list; *q != NULL; q = &(*q)->next) {
+    if (*q == p) {
+      *q = p->next;
+      break;
+    }
+  }
+}
+
+
+static void call_process(struct process *p, process_event_t ev,
+                         process_data_t data)
+{
+  if (p->state != PROCESS_STATE_RUNNING)
+    return;
+
+  struct process *caller = process_current;
+  process_current = p;
+  int ret = p->thread(&p->pt, ev, data);
+  if (ret == PT_EXITED || ret == PT_ENDED)
+    process_exit(p);
+  process_current = caller;
+}
+
+
+void process_start(struct process *p, process_data_t data)
+{
+  if (process_is_running(p))
+    return;
+  p->next = process_list;
+  process_list = p;
+  p->state = PROCESS_STATE_RUNNING;
+  p->pt.lc = 0;
+  call_process(p, PROCESS_EVENT_INIT, data);
+}
+
+
+static void sim_on_client_event(process_event_t ev);
+
+int process_post(struct process *p, process_event_t ev, process_data_t data)
+{
+  if (ev_count == SIM_MAX_EVENTS) {
+    fprintf(stderr, "event queue full\n");
+    return 1;
+  }
+  int i = (ev_first + ev_count) % SIM_MAX_EVENTS;
+  events[i].p = p;
+  events[i].ev = ev;
+  events[i].data = data;
+  ev_count++;
+
+  if (p == &client_process)
+    sim_on_client_event(ev);
+  return 0;
+}
+
+
+void process_post_synch(struct process *p, process_event_t ev,
+                        process_data_t data)
+{
+  call_process(p, ev, data);
+}
+
+
+void process_poll(struct process *p)
+{
+  p->needspoll = 1;
+}
+
+
+/** Delivers all pending polls and events.
+ * @returns The number of events delivered. */
+static int process_run_all(void)
+{
+  int n = 0;
+  int again;
+
+  do {
+    again = 0;
+    for (struct process *p = process_list; p != NULL; p = p->next) {
+      if (p->needspoll) {
+        p->needspoll = 0;
+        call_process(p, PROCESS_EVENT_POLL, NULL);
+        again = 1;
+      }
+    }
+
+    if (ev_count > 0) {
+      struct process *p = events[ev_first].p;
+      process_event_t ev = events[ev_first].ev;
+      process_data_t data = events[ev_first].data;
+      ev_first = (ev_first + 1) % SIM_MAX_EVENTS;
+      ev_count--;
+
+      if (p == PROCESS_BROADCAST) {
+        for (struct process *q = process_list; q != NULL; q = q->next)
+          call_process(q, ev, data);
+      } else {
+        call_process(p, ev, data);
+      }
+      n++;
+      again = 1;
+    }
+  } while (again);
+
+  return n;
+}
+
+
+/*
+ * TIMERS
+ */
+
+/** Owner of the event timers backing a ctimer. */
+static struct process sim_ctimer_owner = { NULL, "ctimer" };
+static struct etimer *timerlist = NULL;
+
+
+void timer_set(struct timer *t, clock_time_t interval)
+{
+  t->interval = interval;
+  t->start = clock_time();
+}
+
+
+void timer_reset(struct timer *t)
+{
+  t->start += t->interval;
+}
+
+
+void timer_restart(struct timer *t)
+{
+  t->start = clock_time();
+}
+
+
+int timer_expired(struct timer *t)
+{
+  return (clock_time_t)(clock_time() - t->start) >= t->interval;
+}
+
+
+clock_time_t timer_remaining(struct timer *t)
+{
+  return t->start + t->interval - clock_time();
+}
+
+
+static void etimer_add(struct etimer *et, struct process *p)
+{
+  struct etimer *t;
+  for (t = timerlist; t != NULL && t != et; t = t->next);
+  if (t == NULL) {
+    et->next = timerlist;
+    timerlist = et;
+  }
+  et->p = p;
+}
+
+
+void etimer_stop(struct etimer *et)
+{
+  struct etimer **t;
+  for (t = &timerlist; *t != NULL; t = &(*t)->next) {
+    if (*t == et) {
+      *t = et->next;
+      break;
+    }
+  }
+  et->next = NULL;
+  et->p = PROCESS_NONE;
+}
+
+
+void etimer_set(struct etimer *et, clock_time_t interval)
+{
+  timer_set(&et->timer, interval);
+  etimer_add(et, PROCESS_CURRENT());
+}
+
+
+void etimer_reset(struct etimer *et)
+{
+  timer_reset(&et->timer);
+  etimer_add(et, PROCESS_CURRENT());
+}
+
+
+void etimer_reset_with_new_interval(struct etimer *et, clock_time_t interval)
+{
+  timer_reset(&et->timer);
+  et->timer.interval = interval;
+  etimer_add(et, PROCESS_CURRENT());
+}
+
+
+void etimer_restart(struct etimer *et)
+{
+  timer_restart(&et->timer);
+  etimer_add(et, PROCESS_CURRENT());
+}
+
+
+int etimer_expired(struct etimer *et)
+{
+  return et->p == PROCESS_NONE;
+}
+
+
+clock_time_t etimer_expiration_time(struct etimer *et)
+{
+  return et->timer.start + et->timer.interval;
+}
+
+
+clock_time_t etimer_start_time(struct etimer *et)
+{
+  return et->timer.start;
+}
+
+
+void ctimer_set(struct ctimer *c, clock_time_t t, void (*f)(void *), void *ptr)
+{
+  c->f = f;
+  c->ptr = ptr;
+  timer_set(&c->etimer.timer, t);
+  etimer_add(&c->etimer, &sim_ctimer_owner);
+}
+
+
+void ctimer_reset(struct ctimer *c)
+{
+  timer_reset(&c->etimer.timer);
+  etimer_add(&c->etimer, &sim_ctimer_owner);
+}
+
+
+void ctimer_restart(struct ctimer *c)
+{
+  timer_restart(&c->etimer.timer);
+  etimer_add(&c->etimer, &sim_ctimer_owner);
+}
+
+
+void ctimer_stop(struct ctimer *c)
+{
+  etimer_stop(&c->etimer);
+}
+
+
+int ctimer_expired(struct ctimer *c)
+{
+  return etimer_expired(&c->etimer);
+}
+
+
+/** Finds the first timer to expire.
+ * @returns The timer, or NULL if no timer is running. */
+static struct etimer *etimer_next(void)
+{
+  struct etimer *next = NULL;
+  for (struct etimer *t = timerlist; t != NULL; t = t->next) {
+    if (next == NULL ||
+        etimer_expiration_time(t) < etimer_expiration_time(next))
+      next = t;
+  }
+  return next;
+}
+
+
+/** Fires a timer which has expired. */
+static void etimer_fire(struct etimer *et)
+{
+  struct process *p = et->p;
+  etimer_stop(et);
+
+  if (p == &sim_ctimer_owner) {
+    struct ctimer *c = (struct ctimer *)et;
+    c->f(c->ptr);
+  } else {
+    process_post(p, PROCESS_EVENT_TIMER, et);
+  }
+}
+
+
+/*
+ * RADIO AND RPL NETWORK
+ */
+
+static int radio_is_on = 0;
+static clock_time_t t_radio_on;
+static radio_value_t radio_txpower = 5;
+static uip_ds6_addr_t global_addr;
+/** The preferred parent. */
+static rpl_nbr_t sim_parent = {
+  { { 0xfe, 0x80 } }, { { 0x00, 0x12, 0x4b, 0x00, 0x0d, 0x5e, 0x00, 0x01 } }
+};
+/** The time the network becomes reachable, or SIM_NEVER. */
+static clock_time_t t_joined;
+/** 1 if the preferred parent is not in range anymore. */
+static int parent_lost;
+/** The network outage, during which no parent answers. */
+static clock_time_t outage_start = SIM_NEVER, outage_end = SIM_NEVER;
+/** Finds the preferred parent during the discovery of the network. */
+static struct ctimer discovery;
+
+static void mqtt_radio_off(void);
+
+
+/** Sets the preferred parent, and notifies the switch like RPL does. */
+static void sim_set_parent(rpl_nbr_t *nbr)
+{
+  if (curr_instance.dag.preferred_parent == nbr)
+    return;
+  rpl_nbr_t *old = curr_instance.dag.preferred_parent;
+  curr_instance.dag.preferred_parent = nbr;
+  RPL_CALLBACK_PARENT_SWITCH(old, nbr);
+}
+
+
+/** Called when a DIO is received during the discovery of the network. The
+ * DAO sent to the parent is acknowledged SIM_REJOIN_TIME later. */
+static void sim_parent_found(void *ptr)
+{
+  curr_instance.used = 1;
+  curr_instance.dag.state = DAG_JOINED;
+  sim_set_parent(&sim_parent);
+}
+
+
+/** @returns 1 if the network is unreachable at a given time. */
+static int sim_outage(clock_time_t t)
+{
+  return t >= outage_start && t < outage_end;
+}
+
+
+/** Starts the discovery of the network. */
+static void sim_discovery_start(void)
+{
+  clock_time_t t = clock_time() + SIM_JOIN_TIME - SIM_REJOIN_TIME;
+  /* The discovery goes on until the end of the outage */
+  if (sim_outage(t))
+    t = outage_end + SIM_JOIN_TIME - SIM_REJOIN_TIME;
+  t_joined = t + SIM_REJOIN_TIME;
+  ctimer_set(&discovery, t - clock_time(), sim_parent_found, NULL);
+}
+
+
+static int sim_radio_on(void)
+{
+  if (!radio_is_on) {
+    radio_is_on = 1;
+    t_radio_on = clock_time();
+    /* A DAG kept from the previous cycle must be refreshed explicitly */
+    if (curr_instance.used)
+      t_joined = SIM_NEVER;
+    else
+      sim_discovery_start();
+    stats.radio_cycles++;
+  }
+  return 1;
+}
+
+
+static int sim_radio_off(void)
+{
+  if (radio_is_on) {
+    radio_is_on = 0;
+    ctimer_stop(&discovery);
+    stats.radio_time += clock_time() - t_radio_on;
+    mqtt_radio_off();
+
+    if (waiting_radio_off) {
+      duration_add(&stats.to_radio_off, clock_time() - t_start);
+      waiting_radio_off = 0;
+    }
+  }
+  return 1;
+}
+
+
+static radio_result_t sim_radio_get_value(int param, radio_value_t *value)
+{
+  switch (param) {
+    case RADIO_PARAM_RSSI:
+      *value = -70;
+      return RADIO_RESULT_OK;
+    case RADIO_PARAM_TXPOWER:
+      *value = radio_txpower;
+      return RADIO_RESULT_OK;
+    case RADIO_CONST_TXPOWER_MIN:
+      *value = -21;
+      return RADIO_RESULT_OK;
+    case RADIO_CONST_TXPOWER_MAX:
+      *value = 5;
+      return RADIO_RESULT_OK;
+  }
+  return RADIO_RESULT_NOT_SUPPORTED;
+}
+
+
+static radio_result_t sim_radio_set_value(int param, radio_value_t value)
+{
+  if (param == RADIO_PARAM_TXPOWER) {
+    radio_txpower = value;
+    return RADIO_RESULT_OK;
+  }
+  return RADIO_RESULT_NOT_SUPPORTED;
+}
+
+
+static int sim_mac_on(void)
+{
+  return 1;
+}
+
+
+static int sim_mac_off(void)
+{
+  return 1;
+}
+
+
+const struct radio_driver sim_radio_driver = {
+  sim_radio_on, sim_radio_off, sim_radio_get_value, sim_radio_set_value
+};
+
+const struct mac_driver sim_mac_driver = {
+  sim_mac_on, sim_mac_off
+};
+
+
+/** @returns 1 if the node has joined the network. */
+static int sim_joined(void)
+{
+  if (!radio_is_on || clock_time() < t_joined)
+    return 0;
+  if (curr_instance.dag.state != DAG_REACHABLE) {
+    /* The DAO-ACK has been received */
+    curr_instance.used = 1;
+    curr_instance.dag.state = DAG_REACHABLE;
+    sim_set_parent(&sim_parent);
+    duration_add(&stats.to_join, t_joined - t_radio_on);
+  }
+  return 1;
+}
+
+
+uip_ds6_addr_t *uip_ds6_get_global(int8_t state)
+{
+  /* rpl_is_reachable() is not checked by the client on the native target */
+  return sim_joined() ? &global_addr : NULL;
+}
+
+
+int rpl_is_reachable(void)
+{
+  return sim_joined();
+}
+
+
+void rpl_dag_leave(void)
+{
+  curr_instance.used = 0;
+  curr_instance.dag.state = DAG_INITIALIZED;
+  sim_set_parent(NULL);
+  /* The discovery finds a new parent */
+  parent_lost = 0;
+  ctimer_stop(&discovery);
+  if (radio_is_on)
+    sim_discovery_start();
+}
+
+
+uip_ipaddr_t *rpl_neighbor_get_ipaddr(rpl_nbr_t *nbr)
+{
+  return &nbr->ipaddr;
+}
+
+
+const linkaddr_t *rpl_neighbor_get_lladdr(rpl_nbr_t *nbr)
+{
+  return &nbr->lladdr;
+}
+
+
+/** Returns the expected number of transmissions of our frames to the parent,
+ * which lose 15% more of them for each dB below SIM_SENSITIVITY + 6 dBm.
+ * @returns The ETX, multiplied by LINK_STATS_ETX_DIVISOR. */
+static uint16_t sim_etx(void)
+{
+  int margin = radio_txpower + SIM_PARENT_RSSI - SIM_SENSITIVITY;
+  int loss = MIN(90, MAX(0, (6 - margin) * 15));
+  return 100 * LINK_STATS_ETX_DIVISOR / (100 - loss);
+}
+
+
+const struct link_stats *rpl_neighbor_get_link_stats(rpl_nbr_t *nbr)
+{
+  static struct link_stats link;
+  link.rssi = SIM_PARENT_RSSI;
+  link.etx = sim_etx();
+  link.freshness = 1;
+  return &link;
+}
+
+
+void rpl_icmp6_dis_output(uip_ipaddr_t *addr)
+{
+  /* A multicast DIS is only sent when a fast rejoin fails */
+  if (addr == NULL)
+    stats.rejoins_failed++;
+}
+
+
+void rpl_timers_schedule_dao(void)
+{
+  if (!radio_is_on || !curr_instance.used)
+    return;
+  stats.rejoins++;
+  if (!parent_lost && !sim_outage(clock_time()) &&
+      rand() % 100 >= SIM_REJOIN_FAILURES)
+    t_joined = clock_time() + SIM_REJOIN_TIME;
+}
+
+
+void rpl_timers_dio_reset(const char *str)
+{
+}
+
+
+void rpl_timers_stop_dag_timers(void)
+{
+}
+
+
+void rpl_schedule_probing(void)
+{
+}
+
+
+/*
+ * ENERGEST
+ */
+
+void energest_flush(void)
+{
+}
+
+
+uint64_t energest_type_time(energest_type_t type)
+{
+  clock_time_t listen = stats.radio_time;
+  if (radio_is_on)
+    listen += clock_time() - t_radio_on;
+
+  switch (type) {
+    case ENERGEST_TYPE_LISTEN:
+      return listen;
+    case ENERGEST_TYPE_DEEP_LPM:
+      return clock_time();
+    default:
+      return 0;
+  }
+}
+
+
+/*
+ * FILE SYSTEM
+ */
+
+/** A file, kept in memory. */
+typedef struct {
+  char name[32];
+  int exists;
+  int open;
+  cfs_offset_t size;
+  cfs_offset_t pos;
+  uint8_t data[SIM_CFS_SIZE];
+} sim_file_t;
+
+static sim_file_t sim_files[SIM_CFS_FILES];
+
+
+/** Returns the open file with a descriptor, or NULL. */
+static sim_file_t *sim_file(int fd)
+{
+  if (fd < 0 || fd >= SIM_CFS_FILES || !sim_files[fd].open)
+    return NULL;
+  return &sim_files[fd];
+}
+
+
+int cfs_open(const char *name, int flags)
+{
+  int fd, free_fd = -1;
+  for (fd = 0; fd < SIM_CFS_FILES; fd++) {
+    if (sim_files[fd].exists && strcmp(name, sim_files[fd].name) == 0)
+      break;
+    if (!sim_files[fd].exists && free_fd < 0)
+      free_fd = fd;
+  }
+  if (fd == SIM_CFS_FILES) {
+    if (!(flags & CFS_WRITE) || free_fd < 0)
+      return -1;
+    fd = free_fd;
+    snprintf(sim_files[fd].name, sizeof(sim_files[fd].name), "%s", name);
+    sim_files[fd].exists = 1;
+    sim_files[fd].size = 0;
+  }
+  sim_files[fd].open = 1;
+  sim_files[fd].pos = flags & CFS_APPEND ? sim_files[fd].size : 0;
+  return fd;
+}
+
+
+void cfs_close(int fd)
+{
+  if (sim_file(fd) != NULL)
+    sim_files[fd].open = 0;
+}
+
+
+int cfs_read(int fd, void *buf, unsigned int len)
+{
+  sim_file_t *f = sim_file(fd);
+  if (f == NULL)
+    return -1;
+  len = MIN(len, f->size - f->pos);
+  memcpy(buf, f->data + f->pos, len);
+  f->pos += len;
+  return len;
+}
+
+
+int cfs_write(int fd, const void *buf, unsigned int len)
+{
+  sim_file_t *f = sim_file(fd);
+  if (f == NULL)
+    return -1;
+  len = MIN(len, SIM_CFS_SIZE - f->pos);
+  if (f->pos < f->size)
+    stats.cfs_bytes_rewritten += MIN(len, f->size - f->pos);
+  memcpy(f->data + f->pos, buf, len);
+  f->pos += len;
+  f->size = MAX(f->size, f->pos);
+  stats.cfs_bytes_written += len;
+  return len;
+}
+
+
+cfs_offset_t cfs_seek(int fd, cfs_offset_t offset, int whence)
+{
+  sim_file_t *f = sim_file(fd);
+  if (f == NULL)
+    return -1;
+  if (whence == CFS_SEEK_CUR)
+    offset += f->pos;
+  else if (whence == CFS_SEEK_END)
+    offset += f->size;
+  if (offset < 0 || offset > SIM_CFS_SIZE)
+    return -1;
+  /* Seeking past the end extends the file, like on Coffee */
+  f->pos = offset;
+  f->size = MAX(f->size, offset);
+  return offset;
+}
+
+
+int cfs_remove(const char *name)
+{
+  for (int fd = 0; fd < SIM_CFS_FILES; fd++) {
+    if (sim_files[fd].exists && strcmp(name, sim_files[fd].name) == 0) {
+      sim_files[fd].exists = 0;
+      sim_files[fd].open = 0;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+
+/*
+ * MQTT BROKER
+ */
+
+static mqtt_event_t disconnect_reason = MQTT_EVENT_DISCONNECTED;
+static process_event_t mqtt_update_event = PROCESS_EVENT_NONE;
+
+/** The state of the broker. The broker forgets the connection and the
+ * session of the client when the client starts moving, as it is assumed to
+ * reach a different border router (and broker) when it stops again. */
+static struct {
+  /** 1 if the broker has an open connection with the client. */
+  int conn;
+  /** 1 if the broker has a persistent session for the client. */
+  int session;
+  /** 1 if the client connection was kept open while the radio was off, and
+   * has not been used since. */
+  int kept;
+  /** The keep alive interval of the connection, in clock ticks. */
+  clock_time_t keep_alive;
+  /** When the broker last heard from the client. */
+  clock_time_t last_heard;
+  /** The samples carried by the last message received. */
+  unsigned long samples;
+  /** The topic filter of the last subscription. */
+  char filter[64];
+} broker;
+
+/** The command retained by the broker on the command topics (-c), if any. */
+static char *retained_command;
+
+/** The battery voltage in mV (-b), or -1 if unknown. */
+static int battery_mv = 3000;
+
+
+/** Reads the battery voltage for publish-period.c. */
+int sim_battery_read(void)
+{
+  return battery_mv;
+}
+
+
+mqtt_status_t mqtt_register(struct mqtt_connection *conn,
+                            struct process *app_process, char *client_id,
+                            mqtt_event_callback_t event_callback,
+                            uint16_t max_segment_size)
+{
+  if (mqtt_update_event == PROCESS_EVENT_NONE)
+    mqtt_update_event = process_alloc_event();
+  memset(conn, 0, sizeof(struct mqtt_connection));
+  conn->state = MQTT_CONN_STATE_NOT_CONNECTED;
+  conn->app_process = app_process;
+  conn->event_callback = event_callback;
+  conn->out_buffer_sent = 1;
+  conn->auto_reconnect = 1;
+  return MQTT_STATUS_OK;
+}
+
+
+void mqtt_set_username_password(struct mqtt_connection *conn,
+                                char *username, char *password)
+{
+}
+
+
+static void mqtt_callback(struct mqtt_connection *conn, mqtt_event_t event,
+                          void *data)
+{
+  PROCESS_CONTEXT_BEGIN(conn->app_process);
+  conn->event_callback(conn, event, data);
+  PROCESS_CONTEXT_END(conn->app_process);
+  /* Like the Contiki-NG MQTT stack, always wake the application afterwards */
+  process_post(conn->app_process, mqtt_update_event, NULL);
+}
+
+
+/** Sends a PINGREQ when the connection has not been used for the keep alive
+ * interval. With the radio off, TCP retransmits it until it gives up on the
+ * connection. */
+static void mqtt_keep_alive_expired(void *ptr)
+{
+  struct mqtt_connection *conn = ptr;
+  stats.pings++;
+  if (!radio_is_on) {
+    stats.pings_lost++;
+    conn->state = MQTT_CONN_STATE_NOT_CONNECTED;
+    broker.conn = 0;
+    mqtt_callback(conn, MQTT_EVENT_DISCONNECTED, &disconnect_reason);
+    return;
+  }
+  broker.last_heard = clock_time();
+  ctimer_reset(&conn->keep_alive_timer);
+}
+
+
+/** Closes the client connection if the broker has not heard from the client
+ * for one and a half times the keep alive interval, then takes note that it
+ * has heard from it now. */
+static void broker_heard(void)
+{
+  if (broker.conn && broker.keep_alive > 0 &&
+      clock_time() - broker.last_heard > broker.keep_alive * 3 / 2) {
+    stats.keep_alive_expired++;
+    broker.conn = 0;
+  }
+  broker.last_heard = clock_time();
+}
+
+
+static void mqtt_connack(void *ptr)
+{
+  struct mqtt_connection *conn = ptr;
+  conn->state = MQTT_CONN_STATE_CONNECTED_TO_BROKER;
+  stats.connects++;
+  int clean = conn->connect_vhdr_flags & MQTT_VHDR_CLEAN_SESSION_FLAG;
+  conn->in_packet.payload[0] = broker.session && !clean;
+  conn->in_packet.payload[1] = 0;
+  broker.conn = 1;
+  broker.session = !clean;
+  broker.keep_alive = (clock_time_t)conn->keep_alive * CLOCK_SECOND;
+  broker.last_heard = clock_time();
+  if (conn->keep_alive > 0)
+    ctimer_set(&conn->keep_alive_timer, broker.keep_alive,
+               mqtt_keep_alive_expired, conn);
+  mqtt_callback(conn, MQTT_EVENT_CONNECTED, NULL);
+}
+
+
+static void mqtt_puback(void *ptr)
+{
+  struct mqtt_connection *conn = ptr;
+  stats.pubacks++;
+  stats.samples += broker.samples;
+  mqtt_callback(conn, MQTT_EVENT_PUBACK, NULL);
+}
+
+
+static void mqtt_disconnected(void *ptr)
+{
+  struct mqtt_connection *conn = ptr;
+  conn->state = MQTT_CONN_STATE_NOT_CONNECTED;
+  ctimer_stop(&conn->keep_alive_timer);
+  mqtt_callback(conn, MQTT_EVENT_DISCONNECTED, &disconnect_reason);
+}
+
+
+mqtt_status_t mqtt_connect(struct mqtt_connection *conn, char *host,
+                           uint16_t port, uint16_t keep_alive)
+{
+  if (!sim_joined())
+    return MQTT_STATUS_ERROR;
+
+  /* TCP handshake, then MQTT CONNECT/CONNACK */
+  conn->state = MQTT_CONN_STATE_TCP_CONNECTING;
+  conn->connect_vhdr_flags |= MQTT_VHDR_CLEAN_SESSION_FLAG;
+  conn->keep_alive = keep_alive;
+  ctimer_set(&conn->sim_timer, 2 * SIM_MQTT_RTT, mqtt_connack, conn);
+  return MQTT_STATUS_OK;
+}
+
+
+void mqtt_disconnect(struct mqtt_connection *conn)
+{
+  conn->state = MQTT_CONN_STATE_DISCONNECTING;
+  broker.conn = 0;
+  ctimer_stop(&conn->keep_alive_timer);
+  ctimer_set(&conn->sim_timer, SIM_MQTT_RTT, mqtt_disconnected, conn);
+}
+
+
+/** Accounts for a message received by the broker.
+ * @returns 1 if the broker knows the connection of the client. */
+static int broker_receive(const uint8_t *payload, uint32_t payload_size)
+{
+  stats.publishes++;
+  stats.payload_bytes += payload_size;
+  stats.tx_power_sum += radio_txpower;
+  if (sim_etx() > LINK_STATS_ETX_DIVISOR)
+    stats.weak_publishes++;
+  /* A message carries last_accel, plus one sample for each record */
+  #if PUBLISH_FORMAT == PUBLISH_FORMAT_BINARY
+  broker.samples = MAX(1, payload[1]);
+  if (payload[0] == PAYLOAD_BINARY_VERSION_CONFIG ||
+      payload[0] == PAYLOAD_BINARY_VERSION_CONFIG +
+                    PAYLOAD_BINARY_VERSION_PERIOD)
+    stats.confirmations++;
+  #else
+  if (memmem(payload, payload_size, "\"config\":[", 10) != NULL)
+    stats.confirmations++;
+  broker.samples = 1;
+  char *rec = memmem(payload, payload_size, "\"records\":[", 11);
+  for (char *p = rec; p != NULL && p < (char *)payload + payload_size; p++) {
+    if (*p == ']' && p[-1] != ']')
+      broker.samples++;
+  }
+  if (rec != NULL)
+    broker.samples--;
+  #endif
+  if (waiting_publish) {
+    duration_add(&stats.to_first_publish, clock_time() - t_stop);
+    waiting_publish = 0;
+  }
+
+  broker_heard();
+  if (broker.kept) {
+    broker.kept = 0;
+    stats.resumes++;
+  }
+  if (!broker.conn)
+    stats.resumes_reset++;
+  return broker.conn;
+}
+
+
+/** Acknowledges a subscription, then delivers the retained command to the
+ * client. */
+static void mqtt_suback(void *ptr)
+{
+  struct mqtt_connection *conn = ptr;
+  mqtt_callback(conn, MQTT_EVENT_SUBACK, NULL);
+  if (retained_command == NULL)
+    return;
+
+  struct mqtt_message msg;
+  memset(&msg, 0, sizeof(msg));
+  /* The command type replaces the last level of the filter */
+  char *level = strrchr(broker.filter, '/');
+  int len = level ? level - broker.filter : 0;
+  snprintf(msg.topic, sizeof(msg.topic), "%.*s/config", len, broker.filter);
+  msg.payload_chunk = (uint8_t *)retained_command;
+  msg.payload_length = msg.payload_chunk_length = strlen(retained_command);
+  msg.first_chunk = 1;
+  stats.commands++;
+  mqtt_callback(conn, MQTT_EVENT_PUBLISH, &msg);
+}
+
+
+mqtt_status_t mqtt_subscribe(struct mqtt_connection *conn, uint16_t *mid,
+                             char *topic, mqtt_qos_level_t qos_level)
+{
+  if (!mqtt_connected(conn))
+    return MQTT_STATUS_NOT_CONNECTED_ERROR;
+
+  stats.subscribes++;
+  broker_heard();
+  snprintf(broker.filter, sizeof(broker.filter), "%s", topic);
+  ctimer_set(&conn->sim_timer, SIM_MQTT_RTT, mqtt_suback, conn);
+  return MQTT_STATUS_OK;
+}
+
+
+mqtt_status_t mqtt_publish(struct mqtt_connection *conn, uint16_t *mid,
+                           char *topic, uint8_t *payload, uint32_t payload_size,
+                           mqtt_qos_level_t qos_level, mqtt_retain_t retain)
+{
+  if (!mqtt_connected(conn))
+    return MQTT_STATUS_NOT_CONNECTED_ERROR;
+
+  if (!broker_receive(payload, payload_size)) {
+    /* The broker resets the connection it does not know */
+    conn->state = MQTT_CONN_STATE_DISCONNECTING;
+    ctimer_set(&conn->sim_timer, SIM_MQTT_RTT, mqtt_disconnected, conn);
+    return MQTT_STATUS_OK;
+  }
+
+  if (qos_level > MQTT_QOS_LEVEL_0)
+    ctimer_set(&conn->sim_timer, SIM_MQTT_RTT, mqtt_puback, conn);
+  return MQTT_STATUS_OK;
+}
+
+
+/*
+ * MQTT-SN GATEWAY
+ */
+
+/** The reply of the gateway in flight. */
+static struct {
+  struct simple_udp_connection *conn;
+  struct ctimer timer;
+  uint8_t data[8];
+  uint16_t len;
+} gateway_reply;
+
+/** Malformed or unexpected MQTT-SN messages received by the gateway. */
+static unsigned long gateway_errors;
+
+
+int uiplib_ipaddrconv(const char *addrstr, uip_ipaddr_t *addr)
+{
+  memset(addr, 0, sizeof(uip_ipaddr_t));
+  return 1;
+}
+
+
+int simple_udp_register(struct simple_udp_connection *c, uint16_t local_port,
+                        uip_ipaddr_t *remote_addr, uint16_t remote_port,
+                        simple_udp_callback receive_callback)
+{
+  c->local_port = local_port;
+  c->remote_port = remote_port;
+  c->receive_callback = receive_callback;
+  c->client_process = PROCESS_CURRENT();
+  return 1;
+}
+
+
+static void gateway_deliver(void *ptr)
+{
+  struct simple_udp_connection *c = gateway_reply.conn;
+  uint8_t *d = gateway_reply.data;
+
+  if (d[1] == 0x05) {
+    stats.connects++;
+    broker.conn = 1;
+  } else if (d[1] == 0x0D && d[6] == 0) {
+    stats.pubacks++;
+    stats.samples += broker.samples;
+  }
+  PROCESS_CONTEXT_BEGIN(c->client_process);
+  c->receive_callback(c, NULL, c->remote_port, NULL, c->local_port,
+                      d, gateway_reply.len);
+  PROCESS_CONTEXT_END(c->client_process);
+}
+
+
+/** Sends a reply to the client after half of the round trip time. */
+static void gateway_send(struct simple_udp_connection *c, const uint8_t *data,
+                         uint16_t len)
+{
+  gateway_reply.conn = c;
+  memcpy(gateway_reply.data, data, len);
+  gateway_reply.len = len;
+  ctimer_set(&gateway_reply.timer, SIM_MQTT_RTT / 2, gateway_deliver, NULL);
+}
+
+
+int simple_udp_sendto_port(struct simple_udp_connection *c,
+                           const void *data, uint16_t datalen,
+                           const uip_ipaddr_t *to, uint16_t to_port)
+{
+  /* Datagrams sent before joining the network are lost */
+  if (!sim_joined())
+    return 0;
+
+  const uint8_t *d = data;
+  uint16_t len = datalen > 0 ? d[0] : 0;
+  if (len == 0x01 && datalen >= 3) {
+    len = ((d[1] << 8) | d[2]) - 2;
+    d += 2;
+  }
+  if (len < 2 || len != datalen - (d - (const uint8_t *)data)) {
+    gateway_errors++;
+    return 0;
+  }
+
+  switch (d[1]) {
+    case 0x04: {
+      /* CONNECT */
+      if (len < 7 || d[3] != 0x01) {
+        gateway_errors++;
+        break;
+      }
+      int clean = d[2] & 0x04;
+      uint8_t connack[] = { 3, 0x05, 0 };
+      broker.session = !clean;
+      gateway_send(c, connack, sizeof(connack));
+      break;
+    }
+
+    case 0x0C: {
+      /* PUBLISH, on a predefined topic id */
+      uint8_t qos = d[2] & 0x60;
+      if (len < 7 || (d[2] & 0x03) != 1 || qos == 0x40) {
+        gateway_errors++;
+        break;
+      }
+      if (qos == 0x60) {
+        /* QoS -1: the gateway forwards the message without a session */
+        broker.conn = 1;
+        if (broker_receive(d + 7, len - 7)) {
+          stats.pubacks++;
+          stats.samples += broker.samples;
+        }
+        break;
+      }
+      int known = broker_receive(d + 7, len - 7);
+      if (qos == 0x20) {
+        /* PUBACK, rejected with "invalid topic id" for unknown clients */
+        uint8_t puback[] = { 7, 0x0D, d[3], d[4], d[5], d[6], known ? 0 : 2 };
+        gateway_send(c, puback, sizeof(puback));
+      } else if (known) {
+        stats.samples += broker.samples;
+      }
+      break;
+    }
+
+    case 0x18: {
+      /* DISCONNECT */
+      uint8_t disconnect[] = { 2, 0x18 };
+      broker.conn = 0;
+      gateway_send(c, disconnect, sizeof(disconnect));
+      break;
+    }
+
+    default:
+      gateway_errors++;
+      break;
+  }
+  return datalen;
+}
+
+
+#if MQTT_TRANSPORT_SN
+/** Loses the MQTT-SN reply in flight when the radio is turned off. An
+ * established connection is kept by the gateway. */
+static void mqtt_radio_off(void)
+{
+  ctimer_stop(&gateway_reply.timer);
+  if (mqtt_sn_connected(&conn))
+    broker.kept = 1;
+  else if (conn.state != MQTT_SN_STATE_DISCONNECTING)
+    broker.conn = 0;
+}
+#else
+/** Drops the MQTT connections not fully established when the radio is
+ * turned off. Established connections stay open, but any reply in flight
+ * is lost. */
+static void mqtt_radio_off(void)
+{
+  ctimer_stop(&conn.sim_timer);
+  if (mqtt_connected(&conn)) {
+    broker.kept = 1;
+  } else {
+    conn.state = MQTT_CONN_STATE_NOT_CONNECTED;
+    ctimer_stop(&conn.keep_alive_timer);
+    broker.conn = 0;
+  }
+}
+#endif
+
+
+/*
+ * SIMULATION
+ */
+
+/** Tracks the movement state changes notified to client_process. */
+static void sim_on_client_event(process_event_t ev)
+{
+  if (ev != mvmt_state_change || is_moving == last_is_moving)
+    return;
+  last_is_moving = is_moving;
+
+  if (is_moving) {
+    stats.starts++;
+    parent_lost = 1;
+    broker.conn = 0;
+    broker.session = 0;
+    if (waiting_publish) {
+      stats.stops_unpublished++;
+      waiting_publish = 0;
+    }
+    t_start = clock_time();
+    if (radio_is_on)
+      waiting_radio_off = 1;
+    else
+      duration_add(&stats.to_radio_off, 0);
+  } else {
+    stats.stops++;
+    t_stop = clock_time();
+    waiting_publish = 1;
+  }
+}
+
+
+static void usage(const char *name)
+{
+  fprintf(stderr, "usage: %s [-v level] [-o start,length] [-c command] "
+          "[-b mV] [hours]\n", name);
+  fprintf(stderr, "  -v level  print log messages up to level (1=ERR, 4=DBG)\n");
+  fprintf(stderr, "  -o start,length  no network from start for length hours\n");
+  fprintf(stderr, "  -c command  remote configuration command retained by the "
+          "broker\n");
+  fprintf(stderr, "  -b mV     battery voltage, -1 if unknown (default 3000)\n");
+  exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+  int opt;
+  double start, length;
+  while ((opt = getopt(argc, argv, "v:o:c:b:")) != -1) {
+    switch (opt) {
+      case 'v':
+        sim_log_level = atoi(optarg);
+        break;
+      case 'o':
+        if (sscanf(optarg, "%lf,%lf", &start, &length) != 2 || start < 0 ||
+            length <= 0)
+          usage(argv[0]);
+        outage_start = (clock_time_t)(start * 3600 * CLOCK_SECOND);
+        outage_end = (clock_time_t)((start + length) * 3600 * CLOCK_SECOND);
+        break;
+      case 'c':
+        retained_command = optarg;
+        break;
+      case 'b':
+        battery_mv = atoi(optarg);
+        break;
+      default:
+        usage(argv[0]);
+    }
+  }
+  double hours = 1;
+  if (optind < argc)
+    hours = atof(argv[optind]);
+  if (hours <= 0)
+    usage(argv[0]);
+  clock_time_t end = (clock_time_t)(hours * 3600 * CLOCK_SECOND);
+
+  for (int i = 0; autostart_processes[i] != NULL; i++)
+    process_start(autostart_processes[i], NULL);
+
+  while (1) {
+    process_run_all();
+
+    struct etimer *next = etimer_next();
+    if (next == NULL || etimer_expiration_time(next) > end)
+      break;
+    if (etimer_expiration_time(next) > sim_now || stats.mcu_wakeups == 0)
+      stats.mcu_wakeups++;
+    sim_now = MAX(sim_now, etimer_expiration_time(next));
+    etimer_fire(next);
+  }
+  sim_now = end;
+  sim_radio_off();
+
+  printf("%-32s %.2f h\n", "simulated time", hours);
+  printf("%-32s %lu (%lu stops, %lu starts)\n", "movement state transitions",
+         stats.stops + stats.starts, stats.stops, stats.starts);
+  printf("%-32s %.2f s (%.2f%%)\n", "radio on time",
+         (double)stats.radio_time / CLOCK_SECOND,
+         100.0 * stats.radio_time / end);
+  printf("%-32s %lu\n", "radio on cycles", stats.radio_cycles);
+  printf("%-32s %lu\n", "MQTT connections", stats.connects);
+  printf("%-32s %lu (%lu reset by the broker)\n", "MQTT connections resumed",
+         stats.resumes, stats.resumes_reset);
+  printf("%-32s %lu (%lu with the radio off, %lu expired)\n",
+         "MQTT keep alives", stats.pings, stats.pings_lost,
+         stats.keep_alive_expired);
+  printf("%-32s %lu (%lu acknowledged)\n", "MQTT publishes", stats.publishes,
+         stats.pubacks);
+  printf("%-32s %.1f dBm (%lu over a lossy link)\n", "publish TX power",
+         stats.publishes ? (double)stats.tx_power_sum / stats.publishes : 0.0,
+         stats.weak_publishes);
+  printf("%-32s %lu (%.1f bytes each)\n", "MQTT payload bytes",
+         stats.payload_bytes, stats.publishes ? 
+         (double)stats.payload_bytes / stats.publishes : 0.0);
+  printf("%-32s %lu (%.2f s of radio on time each)\n", "samples delivered",
+         stats.samples, stats.samples ? 
+         (double)stats.radio_time / CLOCK_SECOND / stats.samples : 0.0);
+  #if PUBLISH_BATCHING
+  printf("%-32s %lu\n", "records discarded",
+         (unsigned long)publish_queue_dropped());
+  #endif
+  #if PUBLISH_BATCHING && PUBLISH_STORE
+  printf("%-32s %lu (%lu over written data)\n", "store bytes written",
+         stats.cfs_bytes_written, stats.cfs_bytes_rewritten);
+  #endif
+  #if PUBLISH_FILTER
+  printf("%-32s %lu (%lu held back by the rate limit)\n", "samples suppressed",
+         (unsigned long)publish_filter_suppressed(),
+         (unsigned long)publish_filter_limited());
+  #endif
+  #if NET_SEARCH_TIMEOUT > 0
+  printf("%-32s %u\n", "network searches abandoned", net_searches_abandoned);
+  #endif
+  #if REMOTE_CONFIG_ENABLED
+  printf("%-32s %lu (%lu commands, %lu confirmations, version %u in use)\n",
+         "MQTT subscriptions", stats.subscribes, stats.commands,
+         stats.confirmations, remote_config.version);
+  #endif
+  #if SPECULATE
+  printf("%-32s %u (%u paid off, %.2f s ahead each, %.2f s of radio on "
+         "time wasted)\n", "speculative joins", speculation.attempts,
+         speculation.hits, speculation.hits ?
+         (double)speculation.lead / CLOCK_SECOND / speculation.hits : 0.0,
+         (double)speculation.wasted / CLOCK_SECOND);
+  #endif
+  duration_print("time to first publish", &stats.to_first_publish);
+  printf("%-32s %lu\n", "stops without publish", stats.stops_unpublished);
+  duration_print("time to radio off", &stats.to_radio_off);
+  duration_print("time to join the network", &stats.to_join);
+  #if CLIENT_FAST_REJOIN
+  printf("%-32s %lu (%lu fell back to discovery)\n", "fast RPL rejoins",
+         stats.rejoins, stats.rejoins_failed);
+  #endif
+  #if MQTT_TRANSPORT_SN
+  printf("%-32s %lu\n", "MQTT-SN protocol errors", gateway_errors);
+  #endif
+  #if ENERGEST_LOG_STATES
+  /* Only the radio listen time is simulated, deep LPM is the total time */
+  printf("%-32s %10s %10s\n", "client states (ticks)", "radio on", "total");
+  for (int i = 0; i < sizeof(mqtt_state_names) / sizeof(mqtt_state_names[0]);
+       i++) {
+    printf("  %-30s %10llu %10llu\n", mqtt_state_names[i],
+           (unsigned long long)energest_log_state_time(i, ENERGEST_LOG_LISTEN),
+           (unsigned long long)energest_log_state_time(i, 
+                                                       ENERGEST_LOG_DEEP_LPM));
+  }
+  #endif
+  printf("%-32s %lu (%lu of %lu deadlines merged)\n", "timer wakeups",
+         stats.mcu_wakeups, (unsigned long)wake_sched_merged(),
+         (unsigned long)wake_sched_requested());
+  unsigned long wakeups = 0;
+  for (int i = 0; i < WAKEUP_CAUSES; i++)
+    wakeups += client_wakeups[i];
+  printf("%-32s %lu (%lu state machine runs)\n", "client process wakeups",
+         wakeups, wakeups - client_wakeups[WAKEUP_IGNORED]);
+  for (int i = 0; i < WAKEUP_CAUSES; i++)
+    printf("  %-30s %lu\n", wakeup_cause_names[i], (unsigned long)client_wakeups[i]);
+  return 0;
+}
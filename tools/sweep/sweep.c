@@ -0,0 +1,465 @@
+/** @file
+ * @brief Parameter sweep of the movement detection over recorded traces.
+ *
+ * Replays the acceleration values recorded in one or more traces (logs of
+ * the MQTT messages published by the client, like the files in data/)
+ * through the movement detection of the firmware, for every combination of
+ * the T_MOD, T_DMOD, MOVEMENT_PERIOD and G values given, using all the
+ * available cores.
+ *
+ * The decision is taken by movement_monitor_update(), the same code used by
+ * movement_monitor_process, including the backoff of the reading period,
+ * the delay G after a stop and the tilt feature when enabled. At each wake,
+ * the records whose time has come are read at once, like the trace replay
+ * backend of the simulator does.
+ *
+ * The reference against which each configuration is compared does not
+ * depend on the detection. If a file named like the trace followed by
+ * ".labels" exists, it holds the reference: one "seconds state" line for
+ * each change of state, with the time in seconds from the first record and
+ * state 1 for moving and 0 for still. Otherwise, the device is considered
+ * moving from each record whose acceleration differs from the previous one
+ * by at least an activity threshold (sum of the absolute differences of the
+ * axes), until no such record has been seen for a hold time.
+ *
+ * For each configuration, the tool prints the average latency of the stop and
+ * start transitions matched to a reference transition, the number of false
+ * (unmatched) and missed transitions, and the estimated number of radio
+ * bring-ups in manual duty cycling mode: one per stop, plus one for every
+ * sample taken every K while still, or with batching one every time the
+ * queue is full or its oldest record is PUBLISH_BATCH_MAX_AGE old, each
+ * followed by the join time.
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "movement.h"
+#include "movement-monitor.h"
+#include "publish-queue.h"
+
+
+/* Maximum number of values of each parameter */
+#define MAX_VALUES    32
+/* Maximum number of trace files */
+#define MAX_TRACES    64
+/* Time between two records, in ms, for traces without uptime */
+#define TRACE_PERIOD_MS 500
+
+/* Conversions between clock ticks and ms */
+#define TICKS_TO_MS(t)  ((uint32_t)((uint64_t)(t) * 1000 / CLOCK_SECOND))
+#define MS_TO_TICKS(ms) ((clock_time_t)((uint64_t)(ms) * CLOCK_SECOND / 1000))
+
+
+/** A recorded trace. */
+typedef struct {
+  const char *name;
+  /** Acceleration values. */
+  int (*acc)[3];
+  /** Time of each record in ms from the first. */
+  uint32_t *t;
+  /** Number of records. */
+  size_t n;
+  /** Times of the reference transitions, in ms. */
+  uint32_t *ref_t;
+  /** Type of the reference transitions (1 = started moving). */
+  uint8_t *ref_moving;
+  /** Number of reference transitions. */
+  size_t ref_n;
+} trace_t;
+
+/** A list of parameter values. */
+typedef struct {
+  long v[MAX_VALUES];
+  int n;
+} values_t;
+
+/** Results of a configuration. */
+typedef struct {
+  unsigned long stops, starts;
+  unsigned long false_transitions, missed;
+  unsigned long matched_stops, matched_starts;
+  uint64_t stop_latency, start_latency;
+  unsigned long bringups;
+} result_t;
+
+
+static trace_t traces[MAX_TRACES];
+static int n_traces = 0;
+static values_t t_mods, t_dmods, periods, gs;
+static uint32_t hold_ms = 5000;
+static int activity = 20;
+static uint32_t tolerance_ms = 60000;
+static uint32_t join_ms = 12000;
+#if defined(PUBLISH_CONF_BATCHING)
+static int batching = PUBLISH_CONF_BATCHING;
+#else
+static int batching = 0;
+#endif
+
+static result_t *results;
+static int n_configs;
+static int next_config = 0;
+static pthread_mutex_t next_config_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/** Parses a comma separated list of values, multiplied by `scale`. */
+static void parse_values(values_t *vals, const char *s, double scale)
+{
+  vals->n = 0;
+  while (*s != '\0' && vals->n < MAX_VALUES) {
+    char *end;
+    vals->v[vals->n++] = (long)(strtod(s, &end) * scale);
+    s = *end == ',' ? end + 1 : end;
+    if (end == s && *s != '\0')
+      break;
+  }
+}
+
+
+/** Adds a reference transition, if it changes the state.
+ * @note  The device is moving at the beginning of the trace, like the
+ *        client assumes. */
+static void add_reference(trace_t *tr, uint32_t t, int moving)
+{
+  int state = tr->ref_n > 0 ? tr->ref_moving[tr->ref_n - 1] : 1;
+  if (moving == state || tr->ref_n == tr->n)
+    return;
+  tr->ref_t[tr->ref_n] = t;
+  tr->ref_moving[tr->ref_n] = moving;
+  tr->ref_n++;
+}
+
+
+/** Reads the reference transitions of a trace from its labels file.
+ * @returns 1 on success, 0 if the trace has no labels file. */
+static int load_labels(trace_t *tr, const char *path)
+{
+  char labels[1024];
+  snprintf(labels, sizeof(labels), "%s.labels", path);
+  FILE *fp = fopen(labels, "r");
+  if (fp == NULL)
+    return 0;
+
+  char line[256];
+  double secs;
+  int moving;
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if (line[0] == '#' || sscanf(line, "%lf %d", &secs, &moving) != 2)
+      continue;
+    add_reference(tr, (uint32_t)(secs * 1000 + 0.5), moving != 0);
+  }
+  fclose(fp);
+  return 1;
+}
+
+
+/** Computes the reference transitions of a trace from the activity of the
+ * raw samples: the device starts moving at a record which differs from the
+ * previous one by at least `activity`, and stops at the last such record
+ * if no other follows within hold_ms. */
+static void activity_reference(trace_t *tr)
+{
+  uint32_t t_active = 0;
+  for (size_t i = 1; i < tr->n; i++) {
+    int delta = abs(tr->acc[i][0] - tr->acc[i - 1][0]) +
+                abs(tr->acc[i][1] - tr->acc[i - 1][1]) +
+                abs(tr->acc[i][2] - tr->acc[i - 1][2]);
+    int moving = tr->ref_n > 0 ? tr->ref_moving[tr->ref_n - 1] : 1;
+    if (moving && tr->t[i] - t_active >= hold_ms)
+      add_reference(tr, t_active, 0);
+    if (delta >= activity) {
+      add_reference(tr, tr->t[i], 1);
+      t_active = tr->t[i];
+    }
+  }
+}
+
+
+/** Loads a trace and computes its reference transitions.
+ * @returns 1 on success, 0 if the trace could not be read. */
+static int load_trace(trace_t *tr, const char *path)
+{
+  FILE *fp = fopen(path, "r");
+  if (fp == NULL) {
+    perror(path);
+    return 0;
+  }
+
+  size_t cap = 1024;
+  tr->name = path;
+  tr->n = 0;
+  tr->acc = malloc(cap * sizeof(tr->acc[0]));
+  tr->t = malloc(cap * sizeof(tr->t[0]));
+
+  char line[1024];
+  uint32_t t = 0, last_uptime = UINT32_MAX;
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    char *p = strstr(line, "\"last_accel\":");
+    int x, y, z;
+    if (p == NULL)
+      continue;
+    p += strlen("\"last_accel\":");
+    p += strspn(p, "[\" ");
+    if (sscanf(p, "%d, %d, %d", &x, &y, &z) != 3)
+      continue;
+
+    /* Same time keeping as the trace replay backend */
+    uint32_t uptime = UINT32_MAX;
+    double secs;
+    p = strstr(line, "\"uptime\":");
+    if (p != NULL && sscanf(p + strlen("\"uptime\":"), "%lf", &secs) == 1)
+      uptime = (uint32_t)(secs * 1000 + 0.5);
+    if (tr->n > 0) {
+      if (uptime != UINT32_MAX && last_uptime != UINT32_MAX &&
+          uptime > last_uptime)
+        t += uptime - last_uptime;
+      else
+        t += TRACE_PERIOD_MS;
+    }
+    last_uptime = uptime;
+
+    if (tr->n == cap) {
+      cap *= 2;
+      tr->acc = realloc(tr->acc, cap * sizeof(tr->acc[0]));
+      tr->t = realloc(tr->t, cap * sizeof(tr->t[0]));
+    }
+    tr->acc[tr->n][LAST_ACC_X] = x;
+    tr->acc[tr->n][LAST_ACC_Y] = y;
+    tr->acc[tr->n][LAST_ACC_Z] = z;
+    tr->t[tr->n] = t;
+    tr->n++;
+  }
+  fclose(fp);
+
+  if (tr->n == 0) {
+    fprintf(stderr, "%s: no records\n", path);
+    return 0;
+  }
+
+  tr->ref_t = malloc(tr->n * sizeof(tr->ref_t[0]));
+  tr->ref_moving = malloc(tr->n * sizeof(tr->ref_moving[0]));
+  tr->ref_n = 0;
+  if (!load_labels(tr, path))
+    activity_reference(tr);
+  return 1;
+}
+
+
+/** @returns The estimated number of radio bring-ups while still for
+ *          `still_ms`, after the bring-up for the stop. */
+static unsigned long still_bringups(uint32_t still_ms)
+{
+  /* A sample is taken every K, and sent at once or when the queue is due */
+  uint32_t k_ms = TICKS_TO_MS(K);
+  uint32_t samples = 1;
+  if (batching) {
+    uint32_t age = (PUBLISH_BATCH_MAX_AGE + K - 1) / K;
+    samples = MIN((uint32_t)PUBLISH_BATCH_SIZE, age + 1);
+  }
+  return still_ms / (samples * k_ms + join_ms);
+}
+
+
+/** Runs the movement detection with a configuration over a trace, like
+ * movement_monitor_process does, and adds the outcome to `res`.
+ * @param period The minimum reading period, in ms.
+ * @param g      The time between a stop and the next reading, in ms. */
+static void run(const trace_t *tr, long t_mod, long t_dmod, uint32_t period,
+                uint32_t g, result_t *res)
+{
+  movement_monitor_params_t params = {
+    .t_mod = t_mod,
+    .t_dmod = t_dmod,
+    .period = MS_TO_TICKS(period),
+    .g = MS_TO_TICKS(g)
+  };
+  movement_monitor_t monitor;
+  movement_monitor_init(&monitor, &params);
+  uint8_t *matched = calloc(tr->ref_n, 1);
+  uint32_t t_wake = 0, t_stopped = 0;
+  size_t i = 0, ref_i = 0;
+  int batch[MOVEMENT_BATCH_SIZE][3];
+
+  while (1) {
+    /* Read the records whose time has come, keeping the most recent ones
+     * like the accelerometer FIFO, or the last one again if none is new */
+    int n = 0;
+    while (i < tr->n && tr->t[i] <= t_wake) {
+      if (n == MOVEMENT_BATCH_SIZE) {
+        memmove(batch[0], batch[1], sizeof(batch[0]) * (n - 1));
+        n--;
+      }
+      memcpy(batch[n++], tr->acc[i++], sizeof(batch[0]));
+    }
+    if (i >= tr->n)
+      break;
+    if (n == 0)
+      memcpy(batch[n++], tr->acc[i > 0 ? i - 1 : 0], sizeof(batch[0]));
+
+    clock_time_t next_wake;
+    movement_monitor_change_t change =
+      movement_monitor_update(&monitor, &params, batch, n, &next_wake);
+
+    if (change != MOVEMENT_MONITOR_NO_CHANGE) {
+      int is_moving = change == MOVEMENT_MONITOR_STARTED;
+      if (is_moving) {
+        res->starts++;
+        res->bringups += still_bringups(t_wake - t_stopped);
+      } else {
+        res->stops++;
+        res->bringups++;
+        t_stopped = t_wake;
+      }
+
+      /* Match with the latest unmatched reference transition of the same
+       * type within the tolerance */
+      while (ref_i < tr->ref_n && tr->ref_t[ref_i] <= t_wake)
+        ref_i++;
+      size_t j = ref_i;
+      int found = 0;
+      while (j > 0 && t_wake - tr->ref_t[j - 1] <= tolerance_ms) {
+        j--;
+        if (!matched[j] && tr->ref_moving[j] == is_moving) {
+          found = 1;
+          break;
+        }
+      }
+      if (found) {
+        matched[j] = 1;
+        if (is_moving) {
+          res->matched_starts++;
+          res->start_latency += t_wake - tr->ref_t[j];
+        } else {
+          res->matched_stops++;
+          res->stop_latency += t_wake - tr->ref_t[j];
+        }
+      } else {
+        res->false_transitions++;
+      }
+    }
+    t_wake += TICKS_TO_MS(next_wake);
+  }
+
+  if (!monitor.is_moving)
+    res->bringups += still_bringups(tr->t[tr->n - 1] - t_stopped);
+  for (size_t j = 0; j < tr->ref_n; j++) {
+    if (!matched[j])
+      res->missed++;
+  }
+  free(matched);
+}
+
+
+static void config_params(int c, long *t_mod, long *t_dmod, long *period,
+                          long *g)
+{
+  *g = gs.v[c % gs.n];
+  c /= gs.n;
+  *period = periods.v[c % periods.n];
+  c /= periods.n;
+  *t_dmod = t_dmods.v[c % t_dmods.n];
+  c /= t_dmods.n;
+  *t_mod = t_mods.v[c];
+}
+
+
+static void *worker(void *arg)
+{
+  while (1) {
+    pthread_mutex_lock(&next_config_lock);
+    int c = next_config++;
+    pthread_mutex_unlock(&next_config_lock);
+    if (c >= n_configs)
+      break;
+
+    long t_mod, t_dmod, period, g;
+    config_params(c, &t_mod, &t_dmod, &period, &g);
+    for (int i = 0; i < n_traces; i++)
+      run(&traces[i], t_mod, t_dmod, period, g, &results[c]);
+  }
+  return NULL;
+}
+
+
+static void usage(const char *name)
+{
+  fprintf(stderr,
+    "usage: %s [options] trace...\n"
+    "  -m list   values of T_MOD (default 250,500,1000,1500,2000)\n"
+    "  -d list   values of T_DMOD (default 250,500,750,1000)\n"
+    "  -p list   values of MOVEMENT_PERIOD in s (default 0.5,1,2,3,5)\n"
+    "  -g list   values of G in s (default 0,10,30,50,90)\n"
+    "  -r secs   hold time of the activity reference (default 5)\n"
+    "  -a delta  activity threshold of the reference (default 20)\n"
+    "  -t secs   maximum latency of a matched transition (default 60)\n"
+    "  -J secs   estimated time to join the network (default 12)\n"
+    "  -b 0|1    whether the samples are batched (default PUBLISH_BATCHING)\n"
+    "  -j n      number of threads (default: number of cores)\n", name);
+  exit(1);
+}
+
+
+int main(int argc, char *argv[])
+{
+  long n_threads = sysconf(_SC_NPROCESSORS_ONLN);
+  parse_values(&t_mods, "250,500,1000,1500,2000", 1);
+  parse_values(&t_dmods, "250,500,750,1000", 1);
+  parse_values(&periods, "0.5,1,2,3,5", 1000);
+  parse_values(&gs, "0,10,30,50,90", 1000);
+
+  int opt;
+  while ((opt = getopt(argc, argv, "m:d:p:g:r:a:t:J:b:j:")) != -1) {
+    switch (opt) {
+      case 'm': parse_values(&t_mods, optarg, 1); break;
+      case 'd': parse_values(&t_dmods, optarg, 1); break;
+      case 'p': parse_values(&periods, optarg, 1000); break;
+      case 'g': parse_values(&gs, optarg, 1000); break;
+      case 'r': hold_ms = (uint32_t)(atof(optarg) * 1000); break;
+      case 'a': activity = atoi(optarg); break;
+      case 't': tolerance_ms = (uint32_t)(atof(optarg) * 1000); break;
+      case 'J': join_ms = (uint32_t)(atof(optarg) * 1000); break;
+      case 'b': batching = atoi(optarg); break;
+      case 'j': n_threads = atol(optarg); break;
+      default: usage(argv[0]);
+    }
+  }
+  if (optind == argc || t_mods.n == 0 || t_dmods.n == 0 || periods.n == 0 ||
+      gs.n == 0 || n_threads < 1)
+    usage(argv[0]);
+
+  for (int i = optind; i < argc && n_traces < MAX_TRACES; i++) {
+    if (load_trace(&traces[n_traces], argv[i]))
+      n_traces++;
+  }
+  if (n_traces == 0)
+    return 1;
+  for (int i = 0; i < n_traces; i++) {
+    fprintf(stderr, "%s: %zu records, %zu reference transitions\n",
+            traces[i].name, traces[i].n, traces[i].ref_n);
+  }
+
+  n_configs = t_mods.n * t_dmods.n * periods.n * gs.n;
+  results = calloc(n_configs, sizeof(result_t));
+  pthread_t *threads = malloc(n_threads * sizeof(pthread_t));
+  for (long i = 0; i < n_threads; i++)
+    pthread_create(&threads[i], NULL, worker, NULL);
+  for (long i = 0; i < n_threads; i++)
+    pthread_join(threads[i], NULL);
+
+  printf("t_mod,t_dmod,period_s,g_s,stops,starts,stop_latency_s,"
+         "start_latency_s,false_transitions,missed_transitions,bringups\n");
+  for (int c = 0; c < n_configs; c++) {
+    long t_mod, t_dmod, period, g;
+    config_params(c, &t_mod, &t_dmod, &period, &g);
+    result_t *r = &results[c];
+    printf("%ld,%ld,%.1f,%.1f,%lu,%lu,%.2f,%.2f,%lu,%lu,%lu\n",
+           t_mod, t_dmod, period / 1000.0, g / 1000.0, r->stops, r->starts,
+           r->matched_stops ? r->stop_latency / 1000.0 / r->matched_stops : 0,
+           r->matched_starts ? r->start_latency / 1000.0 / r->matched_starts : 0,
+           r->false_transitions, r->missed, r->bringups);
+  }
+  return 0;
+}
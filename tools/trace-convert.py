@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+
+'''
+This tool converts a log of the MQTT messages published by the client (one
+message per line, optionally prefixed by the topic as printed by
+`mosquitto_sub -v`) to the binary trace format replayed by
+movement-impl-trace.h on the native target.
+Messages without uptime are assumed to be 500 ms apart.
+'''
+
+import sys
+import json
+import struct
+import traceback
+
+MAGIC = b'MVTRACE1'
+RECORD = struct.Struct('<IhhhH')
+PERIOD_MS = 500
+
+
+if len(sys.argv) < 3:
+  print("usage:", sys.argv[0], "<mqtt log file> <binary trace file>");
+  exit(0);
+
+count = 0
+uptime = 0
+
+with open(sys.argv[1]) as src, open(sys.argv[2], 'wb') as dst:
+  dst.write(MAGIC)
+  
+  for line in src:
+    try:
+      msg = line[line.index('{'):]
+      data = json.loads(msg)
+      accel = data['last_accel']
+      if isinstance(accel, str):
+        accel = json.loads('[' + accel + ']')
+      
+      if 'uptime' in data:
+        uptime = int(round(float(data['uptime']) * 1000))
+      else:
+        uptime += PERIOD_MS
+      
+      dst.write(RECORD.pack(uptime, accel[0], accel[1], accel[2], 0))
+      count += 1
+    except:
+      traceback.print_exc()
+
+print(count, "records written")
@@ -0,0 +1,115 @@
+/** @file
+ * @brief TSCH Association Hints implementation
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#include <string.h>
+#include "contiki.h"
+#include "sys/log.h"
+#include "tsch-hint.h"
+
+#if MAC_CONF_WITH_TSCH && TSCH_HINT_ENABLED
+#include "tsch.h"
+#include "sys/energest.h"
+
+
+#define LOG_MODULE "TSCH Hint"
+#ifdef LOG_CONF_LEVEL_TSCH_HINT
+#define LOG_LEVEL  LOG_CONF_LEVEL_TSCH_HINT
+#else
+#define LOG_LEVEL  LOG_LEVEL_ERR
+#endif
+
+
+uint8_t tsch_hint_join_sequence[TSCH_HINT_CHANNELS_LEN] = { TSCH_HINT_CHANNELS };
+
+/** The channels scanned without a hint. */
+static const uint8_t all_channels[TSCH_HINT_CHANNELS_LEN] = {
+  TSCH_HINT_CHANNELS
+};
+
+/** The hints from the last association. */
+static struct {
+  /** The channel, or 0 if there is no hint. */
+  uint8_t channel;
+  /** The ASN, and the time it was current. */
+  struct tsch_asn_t asn;
+  clock_time_t time;
+} hint;
+
+/** The time and the radio listen time when the scan was started, or 0 if no
+ * scan is in progress. */
+static clock_time_t wake_time;
+static uint64_t wake_listen;
+/** Ends the listening on the hinted channel. */
+static struct ctimer budget;
+/** Statistics. */
+static uint16_t joins, hinted_joins, fallbacks;
+
+
+/** Scans all the channels again. */
+static void scan_all(void *ptr)
+{
+  if (ptr != NULL) {
+    fallbacks++;
+    LOG_INFO("no EB on channel %u, scanning all channels\n", hint.channel);
+  }
+  memcpy(tsch_hint_join_sequence, all_channels, sizeof(all_channels));
+}
+
+
+void tsch_hint_wake(void)
+{
+  wake_time = clock_time();
+  energest_flush();
+  wake_listen = energest_type_time(ENERGEST_TYPE_LISTEN);
+
+  if (hint.channel == 0)
+    return;
+  LOG_DBG("listening on channel %u first\n", hint.channel);
+  memset(tsch_hint_join_sequence, hint.channel, sizeof(all_channels));
+  ctimer_set(&budget, TSCH_HINT_BUDGET, scan_all, &budget);
+}
+
+
+void tsch_hint_joined(void)
+{
+  radio_value_t channel;
+  int hinted = hint.channel != 0 && !ctimer_expired(&budget);
+
+  /* Replaces the default callback, which sets up RPL on the new network */
+  tsch_rpl_callback_joining_network();
+
+  ctimer_stop(&budget);
+  scan_all(NULL);
+
+  if (wake_time != 0) {
+    energest_flush();
+    joins++;
+    hinted_joins += hinted;
+    LOG_INFO("associated in %lu ms, %lu ms listening (%s, %u/%u hinted, "
+             "%u fallbacks)\n",
+             (unsigned long)((clock_time() - wake_time) * 1000 / CLOCK_SECOND),
+             (unsigned long)((energest_type_time(ENERGEST_TYPE_LISTEN) -
+                              wake_listen) * 1000 / ENERGEST_SECOND),
+             hinted ? "hinted channel" : "full scan", hinted_joins, joins,
+             fallbacks);
+  }
+  if (hint.channel != 0) {
+    /* An ASN which went on from the hint means the same network */
+    uint32_t slots = (uint32_t)((uint64_t)(clock_time() - hint.time) *
+                                1000000 / CLOCK_SECOND / TSCH_HINT_TIMESLOT_US);
+    LOG_INFO("ASN %ld slots from the one predicted\n",
+             (long)(int32_t)(tsch_current_asn.ls4b - hint.asn.ls4b - slots));
+  }
+
+  if (NETSTACK_RADIO.get_value(RADIO_PARAM_CHANNEL, &channel) ==
+      RADIO_RESULT_OK)
+    hint.channel = channel;
+  hint.asn = tsch_current_asn;
+  hint.time = clock_time();
+  wake_time = 0;
+}
+
+#endif /* MAC_CONF_WITH_TSCH && TSCH_HINT_ENABLED */
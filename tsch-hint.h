@@ -0,0 +1,77 @@
+/** @file
+ * @brief TSCH Association Hints
+ *
+ * To associate, TSCH listens for an Enhanced Beacon on channels picked at
+ * random in TSCH_JOIN_HOPPING_SEQUENCE, for TSCH_CONF_CHANNEL_SCAN_DURATION
+ * each, so the time needed to rejoin is unpredictable. This module remembers
+ * the channel on which the last association took place, and the ASN at that
+ * time. After tsch_hint_wake(), TSCH listens on that channel only, until the
+ * network is joined or TSCH_HINT_BUDGET expires; then the scan goes on as
+ * usual over all the channels.
+ *
+ * The scan is steered through the join hopping sequence itself: project-conf.h
+ * sets TSCH_CONF_JOIN_HOPPING_SEQUENCE to tsch_hint_join_sequence, whose
+ * entries are all set to the hinted channel during the budget, and restored
+ * to TSCH_HINT_CHANNELS afterwards. It also sets
+ * TSCH_CALLBACK_JOINING_NETWORK to tsch_hint_joined.
+ *
+ * The time and the radio listen time (from energest) spent to associate are
+ * logged at each association, together with the difference between the ASN
+ * found and the one predicted from the hint, which tells whether the same
+ * network was joined again.
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#ifndef _TSCH_HINT_H_
+#define _TSCH_HINT_H_
+
+#include "contiki.h"
+
+
+/** Enables the hints. Used only with MAC_CONF_WITH_TSCH. */
+#ifdef TSCH_HINT_CONF_ENABLED
+#define TSCH_HINT_ENABLED TSCH_HINT_CONF_ENABLED
+#else
+#define TSCH_HINT_ENABLED 0
+#endif
+
+/** The time spent listening on the hinted channel before scanning all of
+ * them. */
+#ifdef TSCH_HINT_CONF_BUDGET
+#define TSCH_HINT_BUDGET TSCH_HINT_CONF_BUDGET
+#else
+#define TSCH_HINT_BUDGET (4 * CLOCK_SECOND)
+#endif
+
+/** The channels scanned without a hint, and their number. */
+#ifdef TSCH_HINT_CONF_CHANNELS
+#define TSCH_HINT_CHANNELS TSCH_HINT_CONF_CHANNELS
+#define TSCH_HINT_CHANNELS_LEN TSCH_HINT_CONF_CHANNELS_LEN
+#else
+#define TSCH_HINT_CHANNELS 15, 25, 26, 20
+#define TSCH_HINT_CHANNELS_LEN 4
+#endif
+
+/** The length of a timeslot in microseconds, to predict the ASN. */
+#ifdef TSCH_HINT_CONF_TIMESLOT_US
+#define TSCH_HINT_TIMESLOT_US TSCH_HINT_CONF_TIMESLOT_US
+#else
+#define TSCH_HINT_TIMESLOT_US 10000
+#endif
+
+
+/** The join hopping sequence used by TSCH. */
+extern uint8_t tsch_hint_join_sequence[TSCH_HINT_CHANNELS_LEN];
+
+
+/** Restricts the scan to the hinted channel, if any, for TSCH_HINT_BUDGET.
+ * @note  Must be called right before TSCH starts scanning. */
+void tsch_hint_wake(void);
+
+/** Records the hints of the network just joined, and logs the association
+ * latency. Called by TSCH as TSCH_CALLBACK_JOINING_NETWORK. */
+void tsch_hint_joined(void);
+
+
+#endif
@@ -0,0 +1,83 @@
+/** @file
+ * @brief TSCH Sleep Mode implementation
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#include "contiki.h"
+#include "sys/log.h"
+#include "tsch-sleep.h"
+
+#if MAC_CONF_WITH_TSCH
+#include "tsch.h"
+
+
+#define LOG_MODULE "TSCH Sleep"
+#ifdef LOG_CONF_LEVEL_TSCH_SLEEP
+#define LOG_LEVEL  LOG_CONF_LEVEL_TSCH_SLEEP
+#else
+#define LOG_LEVEL  LOG_LEVEL_ERR
+#endif
+
+
+/* Defined in tsch.c */
+PROCESS_NAME(tsch_process);
+PROCESS_NAME(tsch_send_eb_process);
+
+/** 1 if TSCH has been stopped. */
+static uint8_t sleeping;
+/** Statistics. */
+static uint16_t sleeps;
+
+
+void tsch_sleep_enter(void)
+{
+  if (sleeping)
+    return;
+  if (!process_is_running(&tsch_process)) {
+    /* Never started yet: tsch_sleep_wake() will start it as usual */
+    NETSTACK_RADIO.off();
+    return;
+  }
+
+  if (tsch_is_associated) {
+    tsch_disassociate();
+    /* Let the TSCH process notice, and reset the queues and the schedule
+     * (TSCH_CALLBACK_LEAVING_NETWORK included) before it is stopped */
+    process_post_synch(&tsch_process, PROCESS_EVENT_POLL, NULL);
+  }
+
+  /* The slot operation ends by itself at the next slot, as we are not
+   * associated anymore; the scan is interrupted here */
+  process_exit(&tsch_process);
+  if (process_is_running(&tsch_send_eb_process))
+    process_exit(&tsch_send_eb_process);
+  NETSTACK_RADIO.off();
+
+  sleeping = 1;
+  sleeps++;
+  LOG_DBG("TSCH stopped (%u times)\n", sleeps);
+}
+
+
+void tsch_sleep_wake(void)
+{
+  if (!sleeping) {
+    /* Starts TSCH if it was never started, does nothing otherwise */
+    NETSTACK_MAC.on();
+    return;
+  }
+
+  sleeping = 0;
+  process_start(&tsch_process, NULL);
+  process_start(&tsch_send_eb_process, NULL);
+  LOG_DBG("TSCH started, scanning\n");
+}
+
+
+int tsch_sleep_is_sleeping(void)
+{
+  return sleeping;
+}
+
+#endif /* MAC_CONF_WITH_TSCH */
@@ -0,0 +1,43 @@
+/** @file
+ * @brief TSCH Sleep Mode
+ *
+ * Turning the MAC off does nothing with TSCH: after tsch_disassociate(), the
+ * TSCH process goes back to scanning for Enhanced Beacons with the radio
+ * always on, and the EB process keeps polling for the association every
+ * 100 ms. To let the radio sleep while the device is moving, this module
+ * leaves the TSCH network, lets the TSCH process reset its state, and then
+ * stops the TSCH and EB processes and the radio. When the device stops
+ * moving, the processes are started again, and the association begins from
+ * a fresh scan.
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#ifndef _TSCH_SLEEP_H_
+#define _TSCH_SLEEP_H_
+
+#include "contiki.h"
+
+
+/** Enables the TSCH sleep mode. Used only with MAC_CONF_WITH_TSCH. */
+#ifdef TSCH_SLEEP_CONF_ENABLED
+#define TSCH_SLEEP_ENABLED TSCH_SLEEP_CONF_ENABLED
+#else
+#define TSCH_SLEEP_ENABLED 0
+#endif
+
+
+/** Leaves the TSCH network, if any, and stops scanning, slot operation, and
+ * the radio until tsch_sleep_wake() is called. */
+void tsch_sleep_enter(void);
+
+/** Starts TSCH again, from a scan, if it was stopped by tsch_sleep_enter().
+ * Also starts TSCH for the first time if it was never started. */
+void tsch_sleep_wake(void);
+
+/** Returns whether TSCH is stopped.
+ * @returns 1 if TSCH is stopped by tsch_sleep_enter(), 0 otherwise. */
+int tsch_sleep_is_sleeping(void);
+
+
+#endif
@@ -0,0 +1,220 @@
+/** @file
+ * @brief Adaptive transmission power implementation
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#include <string.h>
+#include "contiki.h"
+#include "rpl.h"
+#include "net/linkaddr.h"
+#include "net/link-stats.h"
+#include "sys/log.h"
+#include "tx-power.h"
+
+#if TX_POWER_ENABLED
+
+
+#define LOG_MODULE "TX Power"
+#ifdef LOG_CONF_LEVEL_TX_POWER
+#define LOG_LEVEL  LOG_CONF_LEVEL_TX_POWER
+#else
+#define LOG_LEVEL  LOG_LEVEL_ERR
+#endif
+
+
+/** The power used with a parent. */
+typedef struct {
+  /** The link-layer address of the parent. */
+  linkaddr_t addr;
+  /** 1 if the entry is used. */
+  uint8_t used;
+  /** The power, in dBm. */
+  int8_t power;
+  /** The power of the last failure, in dBm. */
+  int8_t fail_power;
+  /** The publishes acknowledged since the last change of power. */
+  uint8_t acks;
+  /** The publishes acknowledged since the last failure. */
+  uint8_t fail_age;
+  /** The value of clock when the entry was last used. */
+  clock_time_t last_used;
+} parent_power_t;
+
+/** The parents remembered. */
+static parent_power_t parents[TX_POWER_PARENTS];
+/** The entry of the current preferred parent, if any. */
+static parent_power_t *current;
+/** The range of power of the radio. */
+static radio_value_t power_min, power_max;
+/** Statistics. */
+static uint16_t steps_down, steps_up, failures;
+
+
+/** Returns the current preferred parent.
+ * @returns The parent, or NULL if there is none. */
+static rpl_nbr_t *parent(void)
+{
+  return curr_instance.used ? curr_instance.dag.preferred_parent : NULL;
+}
+
+
+/** Computes the lowest power whose frames should reach a parent with
+ * TX_POWER_RSSI_TARGET, according to the RSSI of its frames.
+ * @param nbr   The parent, or NULL.
+ * @param power The power, clamped to the range of the radio, or power_min
+ *              if the RSSI of the parent is unknown.
+ * @returns 1 if the RSSI of the parent is known, 0 otherwise. */
+static int estimate(rpl_nbr_t *nbr, int *power)
+{
+  const struct link_stats *stats = nbr ? rpl_neighbor_get_link_stats(nbr) :
+                                         NULL;
+
+  *power = power_min;
+  if (stats == NULL || stats->rssi == 0
+      #ifdef LINK_STATS_RSSI_UNKNOWN
+      || stats->rssi == LINK_STATS_RSSI_UNKNOWN
+      #endif
+      )
+    return 0;
+  *power = TX_POWER_RSSI_TARGET - stats->rssi + TX_POWER_PEER;
+  *power = MAX(power_min, MIN(power_max, *power));
+  return 1;
+}
+
+
+/** Returns the ETX of a parent.
+ * @param nbr The parent, or NULL.
+ * @returns The ETX in tenths, or 0 if unknown. */
+static int etx(rpl_nbr_t *nbr)
+{
+  const struct link_stats *stats = nbr ? rpl_neighbor_get_link_stats(nbr) :
+                                         NULL;
+  return stats ? stats->etx * 10 / LINK_STATS_ETX_DIVISOR : 0;
+}
+
+
+/** Changes the power used with the current parent.
+ * @param power The new power, in dBm, clamped to the range of the radio. */
+static void set_power(int power)
+{
+  current->power = MAX(power_min, MIN(power_max, power));
+  current->acks = 0;
+  tx_power_apply();
+}
+
+
+void tx_power_init(void)
+{
+  memset(parents, 0, sizeof(parents));
+  current = NULL;
+  if (NETSTACK_RADIO.get_value(RADIO_CONST_TXPOWER_MIN, &power_min) !=
+      RADIO_RESULT_OK)
+    power_min = TX_POWER_DEFAULT;
+  if (NETSTACK_RADIO.get_value(RADIO_CONST_TXPOWER_MAX, &power_max) !=
+      RADIO_RESULT_OK)
+    power_max = TX_POWER_DEFAULT;
+}
+
+
+void tx_power_apply(void)
+{
+  radio_value_t power = current ? current->power : TX_POWER_DEFAULT;
+  NETSTACK_RADIO.set_value(RADIO_PARAM_TXPOWER, power);
+}
+
+
+void tx_power_parent(rpl_nbr_t *nbr)
+{
+  const linkaddr_t *addr = nbr ? rpl_neighbor_get_lladdr(nbr) : NULL;
+  parent_power_t *oldest = &parents[0];
+  int i, floor;
+
+  current = NULL;
+  for (i = 0; addr != NULL && i < TX_POWER_PARENTS && current == NULL; i++) {
+    if (parents[i].used && linkaddr_cmp(&parents[i].addr, addr))
+      current = &parents[i];
+    else if (!parents[i].used ||
+             (oldest->used && parents[i].last_used < oldest->last_used))
+      oldest = &parents[i];
+  }
+
+  if (addr != NULL && current == NULL) {
+    /* A new parent: start from the estimate, with a step of margin */
+    current = oldest;
+    memset(current, 0, sizeof(*current));
+    linkaddr_copy(&current->addr, addr);
+    current->used = 1;
+    current->fail_power = power_min - 1;
+    /* RPL calls us before the preferred parent changes */
+    if (estimate(nbr, &floor))
+      current->power = MIN(power_max, floor + TX_POWER_STEP);
+    else
+      current->power = TX_POWER_DEFAULT;
+  }
+  if (current != NULL)
+    current->last_used = clock_time();
+
+  tx_power_apply();
+  LOG_DBG("parent changed, %d dBm\n",
+           current ? current->power : TX_POWER_DEFAULT);
+}
+
+
+void tx_power_acked(void)
+{
+  if (current == NULL)
+    return;
+
+  int floor, lower, link_etx = etx(parent());
+
+  estimate(parent(), &floor);
+  lower = MAX(floor, current->power - TX_POWER_STEP);
+  if (current->fail_age < TX_POWER_FAIL_MEMORY)
+    current->fail_age++;
+  else
+    current->fail_power = power_min - 1;
+  current->last_used = clock_time();
+
+  if (current->power < floor) {
+    /* The link got worse */
+    set_power(floor);
+    steps_up++;
+  } else if (++current->acks >= TX_POWER_STABLE) {
+    current->acks = 0;
+    if (link_etx > TX_POWER_ETX_MAX && current->power < power_max) {
+      /* Not a failure yet, but the power is not enough either */
+      current->fail_power = current->power;
+      current->fail_age = 0;
+      set_power(current->power + TX_POWER_STEP);
+      steps_up++;
+    } else if (lower < current->power && lower > current->fail_power) {
+      set_power(lower);
+      steps_down++;
+    } else {
+      return;
+    }
+  } else {
+    return;
+  }
+  LOG_INFO("%d dBm (ETX %d.%d, %u down, %u up)\n", current->power,
+           link_etx / 10, link_etx % 10, steps_down, steps_up);
+}
+
+
+void tx_power_failed(void)
+{
+  failures++;
+  if (current == NULL)
+    return;
+
+  current->fail_power = current->power;
+  current->fail_age = 0;
+  set_power(current->power + TX_POWER_FAIL_STEP);
+  steps_up++;
+  LOG_INFO("publish failed, %d dBm (%u failures)\n", current->power,
+           failures);
+}
+
+
+#endif
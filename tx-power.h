@@ -0,0 +1,140 @@
+/** @file
+ * @brief Adaptive transmission power
+ *
+ * Instead of transmitting always at CLIENT_RADIO_POWER_CONF, the lowest
+ * power which keeps the link to the RPL preferred parent good enough is
+ * used. The power needed is estimated from the RSSI of the frames received
+ * from the parent, assuming a symmetric link and a parent transmitting at
+ * TX_POWER_PEER: our frames are received by the parent at about
+ * (RSSI - TX_POWER_PEER + power) dBm, which must stay above
+ * TX_POWER_RSSI_TARGET.
+ *
+ * The estimate is then corrected in a closed loop by the outcome of the
+ * publishes. After TX_POWER_STABLE publishes acknowledged in a row, the
+ * power is raised by TX_POWER_STEP if the ETX of the parent is above
+ * TX_POWER_ETX_MAX, or lowered by TX_POWER_STEP otherwise, but never below
+ * the estimate. When a publish fails, the power is raised right away by
+ * TX_POWER_FAIL_STEP. The power at which a publish failed, or the ETX was
+ * too high, is not used again for the next TX_POWER_FAIL_MEMORY publishes,
+ * so that the power does not keep going back and forth.
+ *
+ * The power reached is remembered for the last TX_POWER_PARENTS parents,
+ * so that it is used again at once when the radio is turned on or when the
+ * same parent is chosen again. The default power is used while there is no
+ * parent.
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#ifndef _TX_POWER_H_
+#define _TX_POWER_H_
+
+#include "contiki.h"
+#include "rpl.h"
+#include "remote-config.h"
+
+
+/** Enables the adaptive transmission power. When 0, TX_POWER_DEFAULT is
+ * always used. */
+#ifdef TX_POWER_CONF_ENABLED
+#define TX_POWER_ENABLED TX_POWER_CONF_ENABLED
+#else
+#define TX_POWER_ENABLED 0
+#endif
+
+/** The power used with no parent, or with a parent never heard, in dBm:
+ * CLIENT_RADIO_POWER_CONF, unless changed remotely (see remote-config.h). */
+#define TX_POWER_DEFAULT REMOTE_CONFIG_TX_POWER
+
+/** The minimum RSSI, in dBm, our frames should be received with by the
+ * parent. The sensitivity of the CC2650 is about -100 dBm. */
+#ifdef TX_POWER_CONF_RSSI_TARGET
+#define TX_POWER_RSSI_TARGET TX_POWER_CONF_RSSI_TARGET
+#else
+#define TX_POWER_RSSI_TARGET (-85)
+#endif
+
+/** The power the parent is assumed to transmit with, in dBm. */
+#ifdef TX_POWER_CONF_PEER
+#define TX_POWER_PEER TX_POWER_CONF_PEER
+#else
+#define TX_POWER_PEER 0
+#endif
+
+/** The maximum ETX of the parent, in tenths, before raising the power. */
+#ifdef TX_POWER_CONF_ETX_MAX
+#define TX_POWER_ETX_MAX TX_POWER_CONF_ETX_MAX
+#else
+#define TX_POWER_ETX_MAX 15
+#endif
+
+/** The change of power after TX_POWER_STABLE publishes, in dB. */
+#ifdef TX_POWER_CONF_STEP
+#define TX_POWER_STEP TX_POWER_CONF_STEP
+#else
+#define TX_POWER_STEP 3
+#endif
+
+/** The number of publishes acknowledged in a row before changing power. */
+#ifdef TX_POWER_CONF_STABLE
+#define TX_POWER_STABLE TX_POWER_CONF_STABLE
+#else
+#define TX_POWER_STABLE 4
+#endif
+
+/** The increase of power after a failed publish, in dB. */
+#ifdef TX_POWER_CONF_FAIL_STEP
+#define TX_POWER_FAIL_STEP TX_POWER_CONF_FAIL_STEP
+#else
+#define TX_POWER_FAIL_STEP 6
+#endif
+
+/** The number of publishes acknowledged before the power of a failure can
+ * be used again. */
+#ifdef TX_POWER_CONF_FAIL_MEMORY
+#define TX_POWER_FAIL_MEMORY TX_POWER_CONF_FAIL_MEMORY
+#else
+#define TX_POWER_FAIL_MEMORY 32
+#endif
+
+/** The number of parents whose power is remembered. */
+#ifdef TX_POWER_CONF_PARENTS
+#define TX_POWER_PARENTS TX_POWER_CONF_PARENTS
+#else
+#define TX_POWER_PARENTS 4
+#endif
+
+
+#if TX_POWER_ENABLED
+
+/** Reads the range of power of the radio, and forgets all parents. */
+void tx_power_init(void);
+
+/** Sets the power of the radio for the current preferred parent, or the
+ * default power if there is none. */
+void tx_power_apply(void);
+
+/** Notifies a change of the preferred parent, and sets the power of the radio
+ * for the new one.
+ * @param nbr The new preferred parent, or NULL if there is none. */
+void tx_power_parent(rpl_nbr_t *nbr);
+
+/** Notifies that a publish has been acknowledged. */
+void tx_power_acked(void);
+
+/** Notifies that a publish has failed, and raises the power right away. */
+void tx_power_failed(void);
+
+#else
+
+#define tx_power_init()
+#define tx_power_apply() \
+  NETSTACK_RADIO.set_value(RADIO_PARAM_TXPOWER, TX_POWER_DEFAULT)
+#define tx_power_parent(nbr)
+#define tx_power_acked()
+#define tx_power_failed()
+
+#endif
+
+
+#endif
@@ -0,0 +1,160 @@
+/** @file
+ * @brief Coalescing of the periodic wakeups implementation
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#include <stdlib.h>
+#include "contiki.h"
+#include "sys/log.h"
+#include "wake-sched.h"
+
+
+#define LOG_MODULE "Wake Sched"
+#ifdef LOG_CONF_LEVEL_WAKE_SCHED
+#define LOG_LEVEL  LOG_CONF_LEVEL_WAKE_SCHED
+#else
+#define LOG_LEVEL  LOG_LEVEL_ERR
+#endif
+
+
+/** The timers registered, their last period (0 if unknown), and the deadline
+ * last requested, before the alignment. The next deadlines of a periodic
+ * timer are predicted from its period, as only the first one is known. */
+static struct {
+  struct etimer *et;
+  clock_time_t period;
+  clock_time_t nominal;
+} timers[WAKE_SCHED_MAX_TIMERS];
+static int n_timers;
+/** Statistics. */
+static uint32_t requested, merged;
+
+
+/** Registers a timer, if needed.
+ * @param et The timer.
+ * @returns The index of the timer, or -1 if there is no room. */
+static int lookup(struct etimer *et)
+{
+  int i;
+
+  for (i = 0; i < n_timers; i++) {
+    if (timers[i].et == et)
+      return i;
+  }
+  if (n_timers == WAKE_SCHED_MAX_TIMERS) {
+    LOG_WARN("too many timers, %p not registered\n", et);
+    return -1;
+  }
+  timers[n_timers].et = et;
+  timers[n_timers].period = 0;
+  return n_timers++;
+}
+
+
+void wake_sched_register(struct etimer *et)
+{
+  lookup(et);
+}
+
+
+/** Returns the time a timer must expire at.
+ * @param et       The timer.
+ * @param interval The period of the timer.
+ * @param target   The deadline requested.
+ * @param slack    The maximum advance or delay allowed.
+ * @returns The deadline (actual or predicted) of another pending timer which
+ *          is the closest to target, within slack, or target if there is
+ *          none. */
+static clock_time_t align(struct etimer *et, clock_time_t interval,
+                          clock_time_t target, clock_time_t slack)
+{
+  long best = 0;
+  int found = 0;
+  int i;
+  i = lookup(et);
+  if (i >= 0) {
+    timers[i].period = interval;
+    timers[i].nominal = target;
+  }
+  requested++;
+
+  #if WAKE_SCHED_ENABLED
+  /* Times relative to target; the timer cannot expire before the next tick */
+  clock_time_t now = clock_time();
+  long min = (long)(target - now) > 0 ? -(long)MIN(slack, target - now - 1) : 0;
+  for (i = 0; i < n_timers; i++) {
+    if (timers[i].et == et || etimer_expired(timers[i].et))
+      continue;
+    long next = (long)(etimer_expiration_time(timers[i].et) - target);
+    long period = timers[i].period;
+    long before = next, after = next;
+    if (period > 0 && next < 0) {
+      /* Its deadlines around target, if its period does not change */
+      before = next + (-next) / period * period;
+      after = before == 0 ? 0 : before + period;
+    }
+    if (before >= min && before <= 0 && (!found || -before < labs(best))) {
+      best = before;
+      found = 1;
+    }
+    if (after >= 0 && after <= (long)slack && (!found || after < labs(best))) {
+      best = after;
+      found = 1;
+    }
+  }
+  #endif
+
+  if (found) {
+    merged++;
+    LOG_DBG("%p moved by %ld ticks (%lu/%lu merged)\n", et, best,
+            (unsigned long)merged, (unsigned long)requested);
+  }
+  return target + best;
+}
+
+
+void wake_sched_set(struct etimer *et, clock_time_t interval,
+                    clock_time_t slack)
+{
+  clock_time_t now = clock_time();
+  etimer_set(et, align(et, interval, now + interval, slack) - now);
+}
+
+
+void wake_sched_reset(struct etimer *et, clock_time_t interval,
+                      clock_time_t slack)
+{
+  clock_time_t now = clock_time();
+  clock_time_t start = etimer_expiration_time(et);
+  clock_time_t target = start + interval;
+  int i = lookup(et);
+
+  /* The period goes on from the deadline requested, not from the one the
+   * timer was moved to, or the timer would drift towards its neighbours */
+  if (i >= 0 && timers[i].period > 0)
+    target = timers[i].nominal + interval;
+  if ((long)(target - now) <= 0)
+    /* Too late to keep the phase */
+    target = now + interval;
+  target = align(et, interval, target, slack);
+  if ((long)(target - start) < 0) {
+    /* The timer was last set (or stopped) with etimer_set(), after the
+     * deadline: an interval from its expiration time would be negative */
+    etimer_set(et, target - now);
+    return;
+  }
+  etimer_reset_with_new_interval(et, target - start);
+}
+
+
+uint32_t wake_sched_requested(void)
+{
+  return requested;
+}
+
+
+uint32_t wake_sched_merged(void)
+{
+  return merged;
+}
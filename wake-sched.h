@@ -0,0 +1,77 @@
+/** @file
+ * @brief Coalescing of the periodic wakeups
+ *
+ * Each process of the client runs its own event timer: the accelerometer
+ * readings, the K period of the client, the LED patterns, and the energest
+ * log. Left alone, their deadlines drift apart, and the MCU leaves deep LPM
+ * separately for each of them. With this module, a timer is set with a
+ * slack: if another registered timer is due within the slack before or
+ * after the deadline requested, the timer is aligned to it instead, so that
+ * both expire in the same wakeup. As the timer is moved either way, its
+ * average period is preserved. Only the next deadline of the other timers is
+ * known: the following ones are predicted from their last period. Timers which must be exact (such as the LED
+ * patterns) can be registered with wake_sched_register() only, so that the
+ * other timers can be aligned to them.
+ *
+ * The number of deadlines requested and of those merged into an existing
+ * wakeup are counted.
+ *
+ * @author Marco Bacis
+ * @author Daniele Cattaneo */
+
+#ifndef _WAKE_SCHED_H_
+#define _WAKE_SCHED_H_
+
+#include "contiki.h"
+
+
+/** Enables the alignment. When 0, the slack is ignored and the timers are
+ * only counted. */
+#ifdef WAKE_SCHED_CONF_ENABLED
+#define WAKE_SCHED_ENABLED WAKE_SCHED_CONF_ENABLED
+#else
+#define WAKE_SCHED_ENABLED 1
+#endif
+
+/** The maximum number of timers registered. */
+#ifdef WAKE_SCHED_CONF_MAX_TIMERS
+#define WAKE_SCHED_MAX_TIMERS WAKE_SCHED_CONF_MAX_TIMERS
+#else
+#define WAKE_SCHED_MAX_TIMERS 8
+#endif
+
+
+/** Makes a timer visible to the other timers, which can then be aligned to
+ * its deadlines. Timers set with wake_sched_set() or wake_sched_reset() are
+ * registered automatically.
+ * @param et The event timer. */
+void wake_sched_register(struct etimer *et);
+
+/** Sets an event timer like etimer_set(), possibly moving it by up to
+ * slack, earlier or later, to expire together with another registered timer.
+ * @param et       The event timer.
+ * @param interval The interval before the timer expires.
+ * @param slack    The maximum advance or delay allowed. */
+void wake_sched_set(struct etimer *et, clock_time_t interval,
+                    clock_time_t slack);
+
+/** Resets an event timer like etimer_reset_with_new_interval() (from its
+ * last expiration time), possibly moving it by up to slack, earlier or
+ * later, to expire together with another registered timer.
+ * @param et       The event timer.
+ * @param interval The interval before the timer expires.
+ * @param slack    The maximum advance or delay allowed. */
+void wake_sched_reset(struct etimer *et, clock_time_t interval,
+                      clock_time_t slack);
+
+/** Returns the number of deadlines requested.
+ * @returns The number of calls to wake_sched_set() and wake_sched_reset(). */
+uint32_t wake_sched_requested(void);
+
+/** Returns the number of deadlines aligned to the deadline of another timer.
+ * @returns The number of deadlines which did not need a wakeup of their
+ *          own. */
+uint32_t wake_sched_merged(void);
+
+
+#endif